@@ -0,0 +1,426 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "scheduler.h"
+#include "scriptscache.h"
+#include "scriptsmemory.h"
+#include "shellmemory.h"
+
+#define ALIGN_SECTION(size) (((size) + 7) & ~(size_t)7)
+
+/*** FUNCTION SIGNATURES ***/
+
+int findScriptIndex(struct scriptFrames *scripts[], int *scriptsNumber,
+                    struct scriptFrames *scriptInfo);
+const void *takeSection(const char *data, size_t size, size_t *position, size_t length);
+struct scriptFrames *openCheckpointScript(const struct checkpointScript *record,
+                                          const char *name);
+int isFrameSnapshotValid(struct frameSnapshot frames[], int frameIdx);
+int writeCheckpointFile(char *fileName, const char *buffer, size_t size);
+
+/*** FUNCTIONS FOR THE CHECKPOINTS ***/
+
+/**
+ * Function that saves the state of the running exec in a checkpoint file (see
+ * checkpoint.h). The file is written aside in a single write then renamed so
+ * that a previous checkpoint is never left half written.
+ *
+ * @param fileName the name of the file to write
+ * @return 0 on success, non-zero if the state can't be checkpointed (e.g. a
+ * background job is running) or the file can't be written
+ */
+int checkpointSave(char *fileName) {
+    struct processSnapshot *processes;
+    struct frameSnapshot frames[FRAME_NUMBER];
+    struct checkpointHeader *header;
+    struct checkpointScript *scriptRecord;
+    struct checkpointProcess *processRecord;
+    struct checkpointFrame *frameRecord;
+    int processesNumber, scriptsNumber = 0, scriptIdx, processIdx, frameIdx, errorCode;
+    long clock, demotionClock;
+    size_t size, varsSize, nameLength;
+    char *buffer, *position, *cwd, *vars;
+    policy_t policy;
+
+    if (schedulerSnapshot(&processes, &processesNumber, &policy)) {
+        return 1;
+    }
+    cwd = getcwd(NULL, 0);
+    if (!cwd) {
+        free(processes);
+        return 1;
+    }
+    scriptsMemorySnapshot(frames, &clock, &demotionClock);
+    vars = mem_export(&varsSize);
+
+    // Every script used by a process or a frame is saved once
+    struct scriptFrames *scripts[processesNumber + FRAME_NUMBER];
+    for (processIdx = 0; processIdx < processesNumber; processIdx++) {
+        findScriptIndex(scripts, &scriptsNumber, processes[processIdx].scriptInfo);
+    }
+    for (frameIdx = 0; frameIdx < FRAME_NUMBER; frameIdx++) {
+        // The pages of a stream can't be read again
+        if (frames[frameIdx].scriptInfo && frames[frameIdx].scriptInfo->isStream) {
+            frames[frameIdx].scriptInfo = NULL;
+        }
+        if (frames[frameIdx].scriptInfo) {
+            findScriptIndex(scripts, &scriptsNumber, frames[frameIdx].scriptInfo);
+        }
+    }
+
+    size = sizeof(struct checkpointHeader) + ALIGN_SECTION(strlen(cwd) + 1) +
+           ALIGN_SECTION(processesNumber * sizeof(struct checkpointProcess)) +
+           FRAME_NUMBER * sizeof(struct checkpointFrame) + ALIGN_SECTION(varsSize);
+    for (scriptIdx = 0; scriptIdx < scriptsNumber; scriptIdx++) {
+        size += sizeof(struct checkpointScript) +
+                ALIGN_SECTION(strlen(scripts[scriptIdx]->scriptName) + 1);
+    }
+    buffer = (char *)calloc(1, size);
+
+    header = (struct checkpointHeader *)buffer;
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    header->pageSize = PAGE_SIZE;
+    header->framesNumber = FRAME_NUMBER;
+    header->policy = policy;
+    header->cwdLength = strlen(cwd);
+    header->scriptsNumber = scriptsNumber;
+    header->processesNumber = processesNumber;
+    header->varsSize = varsSize;
+    header->framesClock = clock;
+    header->framesDemotionClock = demotionClock;
+    position = buffer + sizeof(struct checkpointHeader);
+
+    memcpy(position, cwd, header->cwdLength + 1);
+    position += ALIGN_SECTION(header->cwdLength + 1);
+
+    for (scriptIdx = 0; scriptIdx < scriptsNumber; scriptIdx++) {
+        scriptRecord = (struct checkpointScript *)position;
+        nameLength = strlen(scripts[scriptIdx]->scriptName);
+        scriptRecord->nameLength = nameLength;
+        scriptRecord->lengthCode = scripts[scriptIdx]->lengthCode;
+        scriptRecord->size = scripts[scriptIdx]->size;
+        scriptRecord->modificationSeconds = scripts[scriptIdx]->modificationTime.tv_sec;
+        scriptRecord->modificationNanoseconds = scripts[scriptIdx]->modificationTime.tv_nsec;
+        position += sizeof(struct checkpointScript);
+        memcpy(position, scripts[scriptIdx]->scriptName, nameLength + 1);
+        position += ALIGN_SECTION(nameLength + 1);
+    }
+
+    for (processIdx = 0; processIdx < processesNumber; processIdx++) {
+        processRecord = (struct checkpointProcess *)position;
+        processRecord->pid = processes[processIdx].pid;
+        processRecord->lengthScore = processes[processIdx].lengthScore;
+        processRecord->virtualAddress = processes[processIdx].virtualAddress;
+        processRecord->timesliceLeft = processes[processIdx].timesliceLeft;
+        processRecord->scriptIdx =
+            findScriptIndex(scripts, &scriptsNumber, processes[processIdx].scriptInfo);
+        position += sizeof(struct checkpointProcess);
+    }
+    // The records of the processes aren't a multiple of 8 bytes
+    position = buffer + ALIGN_SECTION(position - buffer);
+
+    for (frameIdx = 0; frameIdx < FRAME_NUMBER; frameIdx++) {
+        frameRecord = (struct checkpointFrame *)position;
+        frameRecord->scriptIdx =
+            frames[frameIdx].scriptInfo
+                ? findScriptIndex(scripts, &scriptsNumber, frames[frameIdx].scriptInfo)
+                : -1;
+        frameRecord->pageNumber = frames[frameIdx].pageNumber;
+        frameRecord->lastUsed = frames[frameIdx].lastUsed;
+        position += sizeof(struct checkpointFrame);
+    }
+
+    memcpy(position, vars, varsSize);
+
+    errorCode = writeCheckpointFile(fileName, buffer, size);
+    free(buffer);
+    free(vars);
+    free(cwd);
+    free(processes);
+
+    return errorCode;
+}
+
+/**
+ * Function that restores the state saved in a checkpoint file and runs the
+ * processes left to completion. Only the scripts are read: the lines of the
+ * restored pages are read the first time they are used. Must be called before
+ * any script is loaded.
+ *
+ * @param fileName the name of the checkpoint file
+ * @return 0 on success, non-zero if the file is invalid or one of its scripts
+ * can't be opened or changed since the checkpoint
+ */
+int checkpointResume(char *fileName) {
+    const struct checkpointHeader *header;
+    const struct checkpointScript *scriptRecord;
+    const struct checkpointProcess *processRecords;
+    const struct checkpointFrame *frameRecords;
+    struct frameSnapshot frames[FRAME_NUMBER];
+    struct processSnapshot *processes = NULL;
+    struct scriptFrames **scripts = NULL;
+    const char *data, *cwd, *name, *vars;
+    struct stat fileStat;
+    size_t size, position = sizeof(struct checkpointHeader);
+    int fd, scriptIdx, scriptsNumber, scriptsLoaded = 0, processIdx, processesNumber = 0,
+        frameIdx, errorCode = 1;
+    policy_t policy;
+
+    fd = open(fileName, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 1;
+    }
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(struct checkpointHeader)) {
+        close(fd);
+        return 1;
+    }
+    size = fileStat.st_size;
+    data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return 1;
+    }
+
+    // The checkpoint must come from a shell with the same frame store
+    header = (const struct checkpointHeader *)data;
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->pageSize != PAGE_SIZE || header->framesNumber != FRAME_NUMBER ||
+        header->policy > INVALID_POLICY) {
+        goto done;
+    }
+    policy = (policy_t)header->policy;
+
+    // The script names are relative to the working directory of the checkpoint
+    cwd = (const char *)takeSection(data, size, &position, (size_t)header->cwdLength + 1);
+    if (!cwd || cwd[header->cwdLength] != '\0' || chdir(cwd) != 0) {
+        goto done;
+    }
+
+    // The counts can't exceed what the rest of the file holds (it is read
+    // before allocating for them)
+    if (header->scriptsNumber > (size - position) / sizeof(struct checkpointScript) ||
+        header->processesNumber > (size - position) / sizeof(struct checkpointProcess)) {
+        goto done;
+    }
+    scriptsNumber = header->scriptsNumber;
+    processesNumber = header->processesNumber;
+
+    scripts = (struct scriptFrames **)calloc(scriptsNumber + 1, sizeof(struct scriptFrames *));
+    for (scriptIdx = 0; scriptIdx < scriptsNumber; scriptIdx++) {
+        scriptRecord = (const struct checkpointScript *)takeSection(
+            data, size, &position, sizeof(struct checkpointScript));
+        if (!scriptRecord) {
+            goto done;
+        }
+        name = (const char *)takeSection(data, size, &position, (size_t)scriptRecord->nameLength + 1);
+        if (!name || name[scriptRecord->nameLength] != '\0') {
+            goto done;
+        }
+        scripts[scriptIdx] = openCheckpointScript(scriptRecord, name);
+        if (!scripts[scriptIdx]) {
+            goto done;
+        }
+        scriptsLoaded++;
+    }
+
+    processRecords = (const struct checkpointProcess *)takeSection(
+        data, size, &position, processesNumber * sizeof(struct checkpointProcess));
+    frameRecords = (const struct checkpointFrame *)takeSection(
+        data, size, &position, FRAME_NUMBER * sizeof(struct checkpointFrame));
+    vars = (const char *)takeSection(data, size, &position, header->varsSize);
+    if (!processRecords || !frameRecords || !vars) {
+        goto done;
+    }
+
+    processes = (struct processSnapshot *)malloc((processesNumber + 1) *
+                                                 sizeof(struct processSnapshot));
+    for (processIdx = 0; processIdx < processesNumber; processIdx++) {
+        scriptIdx = processRecords[processIdx].scriptIdx;
+        if (scriptIdx < 0 || scriptIdx >= scriptsLoaded ||
+            processRecords[processIdx].virtualAddress < 0 ||
+            processRecords[processIdx].virtualAddress >= scripts[scriptIdx]->lengthCode ||
+            processRecords[processIdx].timesliceLeft < 0) {
+            goto done;
+        }
+        processes[processIdx].pid = processRecords[processIdx].pid;
+        processes[processIdx].lengthScore = processRecords[processIdx].lengthScore;
+        processes[processIdx].virtualAddress = processRecords[processIdx].virtualAddress;
+        processes[processIdx].timesliceLeft = processRecords[processIdx].timesliceLeft;
+        processes[processIdx].scriptInfo = scripts[scriptIdx];
+    }
+
+    for (frameIdx = 0; frameIdx < FRAME_NUMBER; frameIdx++) {
+        scriptIdx = frameRecords[frameIdx].scriptIdx;
+        if (scriptIdx < -1 || scriptIdx >= scriptsLoaded) {
+            goto done;
+        }
+        frames[frameIdx].scriptInfo = scriptIdx < 0 ? NULL : scripts[scriptIdx];
+        frames[frameIdx].pageNumber = frameRecords[frameIdx].pageNumber;
+        frames[frameIdx].lastUsed = frameRecords[frameIdx].lastUsed;
+        if (!isFrameSnapshotValid(frames, frameIdx)) {
+            goto done;
+        }
+    }
+
+    if (mem_import(vars, header->varsSize)) {
+        goto done;
+    }
+    scriptsMemoryRestore(frames, header->framesClock, header->framesDemotionClock);
+    schedulerRestore(processes, processesNumber);
+    errorCode = 0;
+
+done:
+    // The frames and the processes hold their own references to the scripts
+    for (scriptIdx = 0; scriptIdx < scriptsLoaded; scriptIdx++) {
+        scriptsCacheRelease(scripts[scriptIdx]);
+    }
+    if (!errorCode && processesNumber) {
+        schedulerRun(policy, 0, 0);
+    }
+    free(scripts);
+    free(processes);
+    munmap((void *)data, size);
+
+    return errorCode;
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * Function that returns the index of a script in the scripts of a checkpoint,
+ * adding it if it isn't there yet
+ *
+ * @param scripts the scripts of the checkpoint
+ * @param scriptsNumber the number of scripts (incremented if one is added)
+ * @param scriptInfo the script to find
+ * @return the index of the script
+ */
+int findScriptIndex(struct scriptFrames *scripts[], int *scriptsNumber,
+                    struct scriptFrames *scriptInfo) {
+    int scriptIdx;
+
+    for (scriptIdx = 0; scriptIdx < *scriptsNumber; scriptIdx++) {
+        if (scripts[scriptIdx] == scriptInfo) {
+            return scriptIdx;
+        }
+    }
+    scripts[(*scriptsNumber)++] = scriptInfo;
+
+    return scriptIdx;
+}
+
+/**
+ * Function that returns the next section of a checkpoint file if it lies
+ * within the file
+ *
+ * @param data the content of the file
+ * @param size the size of the file
+ * @param position the offset of the section, moved to the next section
+ * @param length the length of the section
+ * @return a pointer to the section or NULL if the file is too short
+ */
+const void *takeSection(const char *data, size_t size, size_t *position, size_t length) {
+    const char *section;
+
+    if (size - *position < length) {
+        return NULL;
+    }
+    section = data + *position;
+    *position += ALIGN_SECTION(length);
+    if (*position > size) {
+        *position = size;
+    }
+
+    return section;
+}
+
+/**
+ * Function that opens a script saved in a checkpoint. The file must still be
+ * the one the checkpoint was taken with since the restored processes and pages
+ * refer to its lines.
+ *
+ * @param record the saved information of the script
+ * @param name the name of the script
+ * @return the script (the caller owns a reference) or NULL if it can't be
+ * opened or changed
+ */
+struct scriptFrames *openCheckpointScript(const struct checkpointScript *record,
+                                          const char *name) {
+    struct scriptFrames *scriptInfo;
+
+    scriptInfo = scriptsCacheLookup((char *)name);
+    if (!scriptInfo) {
+        scriptInfo = scriptsCacheLoad((char *)name);
+    }
+    if (scriptInfo && (scriptInfo->lengthCode != record->lengthCode ||
+                       scriptInfo->size != record->size ||
+                       scriptInfo->modificationTime.tv_sec != record->modificationSeconds ||
+                       scriptInfo->modificationTime.tv_nsec != record->modificationNanoseconds)) {
+        scriptsCacheRelease(scriptInfo);
+        scriptInfo = NULL;
+    }
+
+    return scriptInfo;
+}
+
+/**
+ * Function that checks that a restored frame holds a page of its script that
+ * no previous frame holds
+ *
+ * @param frames the restored frames
+ * @param frameIdx the frame to check
+ * @return 1 if the frame is valid, 0 otherwise
+ */
+int isFrameSnapshotValid(struct frameSnapshot frames[], int frameIdx) {
+    int previousIdx;
+
+    if (!frames[frameIdx].scriptInfo) {
+        return 1;
+    }
+    if (frames[frameIdx].pageNumber < 0 || frames[frameIdx].pageNumber >= PAGE_TABLE_SIZE ||
+        frames[frameIdx].pageNumber > frames[frameIdx].scriptInfo->lengthCode / PAGE_SIZE) {
+        return 0;
+    }
+    for (previousIdx = 0; previousIdx < frameIdx; previousIdx++) {
+        if (frames[previousIdx].scriptInfo == frames[frameIdx].scriptInfo &&
+            frames[previousIdx].pageNumber == frames[frameIdx].pageNumber) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Function that writes a checkpoint file aside in a single write then renames
+ * it
+ *
+ * @param fileName the name of the file
+ * @param buffer the content of the file
+ * @param size the size of the content
+ * @return 0 on success, non-zero if the file can't be written
+ */
+int writeCheckpointFile(char *fileName, const char *buffer, size_t size) {
+    char temporaryName[strlen(fileName) + 8];
+    int fd, errorCode;
+
+    sprintf(temporaryName, "%s.tmp", fileName);
+    fd = open(temporaryName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    errorCode = fd < 0 || write(fd, buffer, size) != (ssize_t)size;
+    if (fd >= 0) {
+        errorCode |= close(fd) != 0;
+    }
+    if (!errorCode) {
+        errorCode = rename(temporaryName, fileName) != 0;
+    } else {
+        unlink(temporaryName);
+    }
+
+    return errorCode;
+}
@@ -0,0 +1,55 @@
+// A checkpoint saves what the shell needs to carry on with the running exec:
+// the processes left (in the order in which they execute, with the time slice
+// left to the running process and the scores of the aged queue), the page of
+// every frame with its LRU timestamp, the variables and the working directory.
+// The scripts are saved by name and opened again on restore (they must not
+// have changed) and the lines of the restored pages are only read once used.
+//
+// File layout (native byte order, every section 8 bytes aligned):
+//   struct checkpointHeader
+//   working directory (cwdLength bytes + null byte)
+//   scriptsNumber x (struct checkpointScript + name + null byte)
+//   processesNumber x struct checkpointProcess
+//   FRAME_NUMBER x struct checkpointFrame
+//   variables (varsSize bytes, see mem_export)
+
+// First bytes of the files written by checkpointSave
+#define CHECKPOINT_MAGIC "MYSHCKP2"
+
+struct checkpointHeader {
+    char magic[8];
+    unsigned int pageSize;        // Layout of the frame store that wrote it
+    unsigned int framesNumber;
+    unsigned int policy;          // INVALID_POLICY if no exec was running
+    unsigned int cwdLength;
+    unsigned int scriptsNumber;
+    unsigned int processesNumber;
+    unsigned long long varsSize;
+    long long framesClock;
+    long long framesDemotionClock;
+};
+
+struct checkpointScript {
+    unsigned int nameLength;
+    int lengthCode;
+    long long size;  // Size and modification time of the file when saved
+    long long modificationSeconds;
+    long long modificationNanoseconds;
+};
+
+struct checkpointProcess {
+    int pid;
+    int lengthScore;
+    int virtualAddress;
+    int timesliceLeft;  // Instructions left in its time slice (RR, RR30) or 0
+    int scriptIdx;
+};
+
+struct checkpointFrame {
+    int scriptIdx;  // -1 if the frame is empty
+    int pageNumber;
+    long long lastUsed;
+};
+
+int checkpointSave(char *fileName);
+int checkpointResume(char *fileName);
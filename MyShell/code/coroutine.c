@@ -0,0 +1,191 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "coroutine.h"
+#include "output.h"
+
+/*** FUNCTION SIGNATURES ***/
+
+void startCoroutine();
+
+// Coroutine executing on the running thread (NULL if none)
+__thread struct coroutine *runningCoroutine = NULL;
+
+// Coroutines destroyed whose stacks are handed out again (mapping a stack
+// costs a few system calls and page faults, every process has one)
+struct coroutine *freeStacks;
+pthread_mutex_t stacksLock;
+
+// Stack counters (guarded by stacksLock)
+unsigned long stacksMapped;
+unsigned long stacksInUse;
+unsigned long peakStacksInUse;
+
+/**
+ * This function intializes the stacks of the coroutines.
+ * @param void
+ * @return void
+ */
+void coroutine_init() {
+    freeStacks = NULL;
+    pthread_mutex_init(&stacksLock, NULL);
+    stacksMapped = 0;
+    stacksInUse = 0;
+    peakStacksInUse = 0;
+}
+
+/*** FUNCTIONS FOR THE COROUTINES ***/
+
+/**
+ * Function that creates a coroutine, it starts running the entry function the
+ * first time it is resumed. The stack is mapped with an inaccessible page below
+ * it so that an overflow crashes instead of overwriting other memory.
+ *
+ * @param entry the function run by the coroutine
+ * @param arg the argument passed to the function
+ * @return the coroutine or NULL if its stack couldn't be mapped
+ */
+struct coroutine *coroutineCreate(coroutineEntry_t entry, void *arg) {
+    struct coroutine *coroutine;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    char *memory;
+
+    pthread_mutex_lock(&stacksLock);
+    if ((coroutine = freeStacks)) {
+        freeStacks = coroutine->next;
+    } else {
+        memory = mmap(NULL, pageSize + COROUTINE_STACK_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if (memory == MAP_FAILED) {
+            pthread_mutex_unlock(&stacksLock);
+            return NULL;
+        }
+        mprotect(memory, pageSize, PROT_NONE);
+        // The stack grows down from the structure at the top of the memory
+        coroutine = (struct coroutine *)(((uintptr_t)(memory + pageSize +
+                                                      COROUTINE_STACK_SIZE) -
+                                          sizeof(struct coroutine)) &
+                                         ~(uintptr_t)15);
+        coroutine->stack = memory + pageSize;
+        stacksMapped++;
+    }
+    stacksInUse++;
+    if (stacksInUse > peakStacksInUse) {
+        peakStacksInUse = stacksInUse;
+    }
+    pthread_mutex_unlock(&stacksLock);
+
+    coroutine->entry = entry;
+    coroutine->arg = arg;
+    coroutine->isStarted = 0;
+    coroutine->isFinished = 0;
+
+    return coroutine;
+}
+
+/**
+ * Function that runs a coroutine until it yields or its entry function
+ * returns. The first switch sets up the stack with makecontext, the others
+ * only save and restore the registers with _setjmp and _longjmp (swapcontext
+ * would also save and restore the signal mask with two system calls).
+ *
+ * @param coroutine the coroutine (not finished)
+ * @return void
+ */
+void coroutineResume(struct coroutine *coroutine) {
+    jmp_buf resumer;
+    ucontext_t start;
+    struct coroutine *previousCoroutine = runningCoroutine;
+
+    coroutine->resumer = &resumer;
+    runningCoroutine = coroutine;
+    if (!_setjmp(resumer)) {
+        if (coroutine->isStarted) {
+            _longjmp(coroutine->context, 1);
+        }
+        coroutine->isStarted = 1;
+        getcontext(&start);
+        start.uc_stack.ss_sp = coroutine->stack;
+        start.uc_stack.ss_size = (char *)coroutine - coroutine->stack;
+        start.uc_link = NULL;
+        makecontext(&start, startCoroutine, 0);
+        setcontext(&start);
+    }
+    runningCoroutine = previousCoroutine;
+}
+
+/**
+ * Function that gives the control back to the function that resumed the
+ * running coroutine. It returns when the coroutine is resumed again, which
+ * may be by another thread.
+ *
+ * @param void
+ * @return void
+ */
+void coroutineYield() {
+    struct coroutine *coroutine = runningCoroutine;
+
+    if (!_setjmp(coroutine->context)) {
+        _longjmp(*coroutine->resumer, 1);
+    }
+}
+
+/**
+ * Function that gives the stack of a coroutine back, the coroutine is
+ * abandoned if it didn't finish
+ *
+ * @param coroutine the coroutine (not running)
+ * @return void
+ */
+void coroutineDestroy(struct coroutine *coroutine) {
+    pthread_mutex_lock(&stacksLock);
+    coroutine->next = freeStacks;
+    freeStacks = coroutine;
+    stacksInUse--;
+    pthread_mutex_unlock(&stacksLock);
+}
+
+/**
+ * Function that returns the coroutine executing on the running thread
+ *
+ * @param void
+ * @return the coroutine or NULL if the thread runs on its own stack
+ */
+struct coroutine *coroutineRunning() {
+    return runningCoroutine;
+}
+
+/**
+ * Function that prints the counters of the stacks of the coroutines
+ *
+ * @param void
+ * @return void
+ */
+void coroutinePrintStats() {
+    pthread_mutex_lock(&stacksLock);
+    shellPrintf("Coroutine stacks: %lu mapped (%d KB each), %lu in use (peak %lu)\n",
+                stacksMapped, COROUTINE_STACK_SIZE >> 10, stacksInUse,
+                peakStacksInUse);
+    pthread_mutex_unlock(&stacksLock);
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * Function that runs the entry function of a coroutine on its stack (started
+ * by coroutineResume) and then goes back to the function that resumed the
+ * coroutine for the last time
+ *
+ * @param void
+ * @return void
+ */
+void startCoroutine() {
+    struct coroutine *coroutine = runningCoroutine;
+
+    coroutine->entry(coroutine->arg);
+    coroutine->isFinished = 1;
+    _longjmp(*coroutine->resumer, 1);
+}
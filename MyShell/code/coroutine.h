@@ -0,0 +1,34 @@
+#include <setjmp.h>
+
+// Bytes of the stack of a coroutine (the largest frames are the page buffers
+// of the scripts memory, the iovec array used to flush an output buffer and
+// the frames of a checkpoint, which grow with the frame store)
+#ifndef COROUTINE_STACK_SIZE
+#define COROUTINE_STACK_SIZE (256 << 10)
+#endif
+
+typedef void (*coroutineEntry_t)(void *arg);
+
+// Function running on its own stack that can give the control back to the
+// function that resumed it (yield) and carry on where it left off when resumed
+// again, possibly by another thread (so the address of a thread local variable
+// mustn't be kept across a yield). The structure lives at the top of the
+// memory of its stack.
+struct coroutine {
+    jmp_buf context;   // Where the coroutine carries on when resumed
+    jmp_buf *resumer;  // Where the coroutine goes back to when it yields
+    char *stack;       // Lowest address of the stack (above the guard page)
+    coroutineEntry_t entry;
+    void *arg;
+    int isStarted;
+    int isFinished;          // Set once the entry function returned
+    struct coroutine *next;  // Free list of the stacks
+};
+
+void coroutine_init();
+struct coroutine *coroutineCreate(coroutineEntry_t entry, void *arg);
+void coroutineResume(struct coroutine *coroutine);
+void coroutineYield();
+void coroutineDestroy(struct coroutine *coroutine);
+struct coroutine *coroutineRunning();
+void coroutinePrintStats();
@@ -0,0 +1,410 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "input.h"
+
+// Block of the stdin made of complete lines (except for the last block which
+// ends with the incomplete last line if any)
+struct inputBlock {
+    char *data;
+    size_t length;
+    size_t capacity;
+    size_t *separators;  // Offsets of every '\n' and ';' of the block in order
+    size_t separatorsNumber;
+    size_t separatorsCapacity;
+    size_t position;      // Offset of the next line to hand out
+    size_t separatorIdx;  // First separator of the next line
+    int isLast;           // Whether the end of the stdin follows the block
+    int linesHandedOut;   // Lines not released yet
+    int isConsumed;       // Whether every line of the block was handed out
+    struct inputBlock *next;
+};
+
+// Blocks read (and scanned) but not entirely handed out, oldest first, and
+// blocks ready to be reused
+struct inputBlock *readyBlocksHead;
+struct inputBlock *readyBlocksTail;
+int readyBlocksNumber;
+struct inputBlock *freeBlocks;
+
+// Incomplete line at the end of the last block read, moved to the next block
+// (only accessed by the thread reading the stdin)
+char *carry;
+size_t carryLength;
+size_t carryCapacity;
+
+// In batch mode, the stdin is read by the parse-ahead thread while the shell
+// executes the lines read before. In interactive mode, a block is read (i.e. a
+// line) whenever the shell needs one.
+int isParsingAhead;
+pthread_t parseAheadThread;
+
+// Whether the last line of the stdin was handed out
+int isInputAtEnd;
+
+// Line handed out once the end of the stdin is reached
+char endLine[1];
+
+// Mutex lock and conditions used whenever the blocks are accessed
+pthread_mutex_t inputLock;
+pthread_cond_t blockReadyCond;
+pthread_cond_t blockConsumedCond;
+
+/*** FUNCTION SIGNATURES ***/
+
+void *parseAhead(void *args);
+struct inputBlock *readBlock();
+void queueBlock(struct inputBlock *block);
+void retireBlock(struct inputBlock *block);
+void reserveBlock(struct inputBlock *block, size_t capacity);
+void scanSeparators(struct inputBlock *block, size_t start, size_t end);
+void appendSeparator(struct inputBlock *block, size_t offset);
+
+/*** FUNCTIONS FOR THE INPUT ***/
+
+/**
+ * This function initializes the input of the shell and starts the parse-ahead
+ * thread if the stdin isn't a terminal.
+ * @param void
+ * @return void
+ */
+void input_init() {
+    readyBlocksHead = NULL;
+    readyBlocksTail = NULL;
+    readyBlocksNumber = 0;
+    freeBlocks = NULL;
+    carry = NULL;
+    carryLength = 0;
+    carryCapacity = 0;
+    isInputAtEnd = 0;
+    endLine[0] = '\0';
+
+    pthread_mutex_init(&inputLock, NULL);
+    pthread_cond_init(&blockReadyCond, NULL);
+    pthread_cond_init(&blockConsumedCond, NULL);
+
+    isParsingAhead = !isatty(STDIN_FILENO);
+    if (isParsingAhead) {
+        pthread_create(&parseAheadThread, NULL, parseAhead, NULL);
+        pthread_detach(parseAheadThread);
+    }
+}
+
+/**
+ * Function that hands out the next line of the stdin. Like fgets, an empty
+ * line is handed out when the stdin ends after a newline (or is empty), after
+ * which inputAtEnd is true. The line must be released with inputReleaseLine.
+ *
+ * @param line the line to fill
+ * @return void
+ */
+void inputNextLine(struct inputLine *line) {
+    struct inputBlock *block, *readyBlock;
+    size_t separatorIdx, end;
+
+    pthread_mutex_lock(&inputLock);
+    if (isInputAtEnd) {
+        pthread_mutex_unlock(&inputLock);
+        line->data = endLine;
+        line->length = 0;
+        line->separators = NULL;
+        line->separatorsNumber = 0;
+        line->block = NULL;
+        return;
+    }
+
+    while (1) {
+        block = readyBlocksHead;
+        if (!block) {
+            if (isParsingAhead) {
+                pthread_cond_wait(&blockReadyCond, &inputLock);
+            } else {
+                pthread_mutex_unlock(&inputLock);
+                readyBlock = readBlock();
+                pthread_mutex_lock(&inputLock);
+                queueBlock(readyBlock);
+            }
+            continue;
+        }
+        if (block->position < block->length || block->isLast) {
+            break;
+        }
+
+        // Every line of the block was handed out
+        readyBlocksHead = block->next;
+        if (!readyBlocksHead) {
+            readyBlocksTail = NULL;
+        }
+        readyBlocksNumber--;
+        block->isConsumed = 1;
+        if (!block->linesHandedOut) {
+            retireBlock(block);
+        }
+        pthread_cond_signal(&blockConsumedCond);
+    }
+
+    // The line ends at the next newline, the ';' before it are its separators
+    for (separatorIdx = block->separatorIdx;
+         separatorIdx < block->separatorsNumber &&
+         block->data[block->separators[separatorIdx]] != '\n';
+         separatorIdx++) {
+        block->separators[separatorIdx] -= block->position;
+    }
+    line->data = block->data + block->position;
+    line->separators = block->separators + block->separatorIdx;
+    line->separatorsNumber = separatorIdx - block->separatorIdx;
+    line->block = block;
+    if (separatorIdx < block->separatorsNumber) {
+        end = block->separators[separatorIdx] + 1;
+        separatorIdx++;
+    } else {
+        // Last line of the stdin (without a newline or empty)
+        end = block->length;
+        isInputAtEnd = 1;
+    }
+    line->length = end - block->position;
+    block->position = end;
+    block->separatorIdx = separatorIdx;
+    block->linesHandedOut++;
+    pthread_mutex_unlock(&inputLock);
+}
+
+/**
+ * Function that gives back a line handed out by inputNextLine. Its block is
+ * reused once all its lines were given back.
+ *
+ * @param line the line to give back
+ * @return void
+ */
+void inputReleaseLine(struct inputLine *line) {
+    if (!line->block) {
+        return;
+    }
+
+    pthread_mutex_lock(&inputLock);
+    line->block->linesHandedOut--;
+    if (line->block->isConsumed && !line->block->linesHandedOut) {
+        retireBlock(line->block);
+    }
+    pthread_mutex_unlock(&inputLock);
+    line->block = NULL;
+}
+
+/**
+ * Predicate determining whether the last line of the stdin was handed out
+ * (the equivalent of feof for the stdin of the shell)
+ * @param void
+ * @return 1 if the end of the stdin was reached, 0 otherwise
+ */
+int inputAtEnd() {
+    int rv;
+
+    pthread_mutex_lock(&inputLock);
+    rv = isInputAtEnd;
+    pthread_mutex_unlock(&inputLock);
+
+    return rv;
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * The main function of the parse-ahead thread. It reads and scans the blocks
+ * of the stdin until its end, staying at most INPUT_BLOCKS_AHEAD blocks ahead
+ * of the shell.
+ * @param args A pointer to the arguments passed to the thread (unused).
+ * @return void
+ */
+void *parseAhead(void *args) {
+    struct inputBlock *block;
+
+    (void)args;
+    do {
+        block = readBlock();
+        pthread_mutex_lock(&inputLock);
+        while (readyBlocksNumber >= INPUT_BLOCKS_AHEAD) {
+            pthread_cond_wait(&blockConsumedCond, &inputLock);
+        }
+        queueBlock(block);
+        pthread_mutex_unlock(&inputLock);
+    } while (!block->isLast);
+
+    return NULL;
+}
+
+/**
+ * Function that reads the next block of the stdin and finds its separators.
+ * The block is handed over as soon as it holds a complete line: the read
+ * fills it at once for a file but only returns the line typed in a terminal.
+ * A line longer than a block makes the block grow.
+ * @param void
+ * @return the block (not queued yet)
+ */
+struct inputBlock *readBlock() {
+    struct inputBlock *block;
+    size_t separatorIdx;
+    ssize_t bytesRead;
+    int hasNewline = 0;
+
+    pthread_mutex_lock(&inputLock);
+    block = freeBlocks;
+    if (block) {
+        freeBlocks = block->next;
+    }
+    pthread_mutex_unlock(&inputLock);
+    if (!block) {
+        block = (struct inputBlock *)calloc(1, sizeof(struct inputBlock));
+    }
+
+    // The block starts with the incomplete line left by the previous one
+    reserveBlock(block, carryLength + INPUT_BLOCK_SIZE + 1);
+    memcpy(block->data, carry, carryLength);
+    block->length = carryLength;
+    block->separatorsNumber = 0;
+    block->isLast = 0;
+    scanSeparators(block, 0, carryLength);
+    carryLength = 0;
+
+    while (!hasNewline) {
+        if (block->length + 1 == block->capacity) {
+            reserveBlock(block, block->capacity * 2);
+        }
+        bytesRead = read(STDIN_FILENO, block->data + block->length,
+                         block->capacity - 1 - block->length);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            block->isLast = 1;
+            break;
+        }
+        separatorIdx = block->separatorsNumber;
+        scanSeparators(block, block->length, block->length + bytesRead);
+        block->length += bytesRead;
+        for (; separatorIdx < block->separatorsNumber && !hasNewline; separatorIdx++) {
+            hasNewline = block->data[block->separators[separatorIdx]] == '\n';
+        }
+    }
+
+    // The incomplete line at the end is read again with the next block
+    if (!block->isLast) {
+        while (block->data[block->separators[block->separatorsNumber - 1]] != '\n') {
+            block->separatorsNumber--;
+        }
+        carryLength = block->length - block->separators[block->separatorsNumber - 1] - 1;
+        if (carryLength > carryCapacity) {
+            carryCapacity = carryLength;
+            carry = (char *)realloc(carry, carryCapacity);
+        }
+        block->length -= carryLength;
+        memcpy(carry, block->data + block->length, carryLength);
+    }
+
+    block->position = 0;
+    block->separatorIdx = 0;
+    block->linesHandedOut = 0;
+    block->isConsumed = 0;
+    block->next = NULL;
+
+    return block;
+}
+
+/**
+ * Function that appends a block to the blocks ready to be handed out. Must be
+ * called with the inputLock held.
+ *
+ * @param block the block to append
+ * @return void
+ */
+void queueBlock(struct inputBlock *block) {
+    if (readyBlocksTail) {
+        readyBlocksTail->next = block;
+    } else {
+        readyBlocksHead = block;
+    }
+    readyBlocksTail = block;
+    readyBlocksNumber++;
+    pthread_cond_signal(&blockReadyCond);
+}
+
+/**
+ * Function that keeps a block whose lines were all given back for reuse. Must
+ * be called with the inputLock held.
+ *
+ * @param block the block to reuse
+ * @return void
+ */
+void retireBlock(struct inputBlock *block) {
+    block->next = freeBlocks;
+    freeBlocks = block;
+}
+
+/**
+ * Function that makes sure that a block can hold a number of bytes
+ *
+ * @param block the block
+ * @param capacity the number of bytes
+ * @return void
+ */
+void reserveBlock(struct inputBlock *block, size_t capacity) {
+    if (block->capacity < capacity) {
+        block->capacity = capacity;
+        block->data = (char *)realloc(block->data, capacity);
+    }
+}
+
+/**
+ * Function that finds the newlines and semicolons of a part of a block. With
+ * SSE2, 16 bytes are compared with both characters at once and the matches
+ * are read from the resulting bit mask.
+ *
+ * @param block the block
+ * @param start the offset of the first byte to scan
+ * @param end the offset following the last byte to scan
+ * @return void
+ */
+void scanSeparators(struct inputBlock *block, size_t start, size_t end) {
+    size_t offset = start;
+#ifdef __SSE2__
+    const __m128i newlines = _mm_set1_epi8('\n'), semicolons = _mm_set1_epi8(';');
+    __m128i bytes;
+    unsigned int matches;
+
+    for (; offset + 16 <= end; offset += 16) {
+        bytes = _mm_loadu_si128((const __m128i *)(block->data + offset));
+        matches = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, newlines),
+                                                 _mm_cmpeq_epi8(bytes, semicolons)));
+        while (matches) {
+            appendSeparator(block, offset + __builtin_ctz(matches));
+            matches &= matches - 1;
+        }
+    }
+#endif
+    for (; offset < end; offset++) {
+        if (block->data[offset] == '\n' || block->data[offset] == ';') {
+            appendSeparator(block, offset);
+        }
+    }
+}
+
+/**
+ * Function that records the offset of a separator of a block
+ *
+ * @param block the block
+ * @param offset the offset of the separator
+ * @return void
+ */
+void appendSeparator(struct inputBlock *block, size_t offset) {
+    if (block->separatorsNumber == block->separatorsCapacity) {
+        block->separatorsCapacity = block->separatorsCapacity ? block->separatorsCapacity * 2 : 4096;
+        block->separators = (size_t *)realloc(block->separators,
+                                              block->separatorsCapacity * sizeof(size_t));
+    }
+    block->separators[block->separatorsNumber++] = offset;
+}
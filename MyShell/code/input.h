@@ -0,0 +1,28 @@
+#include <stddef.h>
+
+// Size of the blocks in which the stdin is read
+#ifndef INPUT_BLOCK_SIZE
+#define INPUT_BLOCK_SIZE (1 << 20)
+#endif
+
+// Number of blocks the parse-ahead thread can read and scan before the shell
+// executes them (batch mode only)
+#define INPUT_BLOCKS_AHEAD 4
+
+struct inputBlock;
+
+// Line of the stdin handed out without being copied. It stays valid until
+// released with inputReleaseLine and can be modified in place. A line without
+// a newline (the last one) can be null terminated right after its end.
+struct inputLine {
+    char *data;
+    size_t length;             // Newline inclusive (the last line may have none)
+    const size_t *separators;  // Offsets of the ';' of the line (from data)
+    size_t separatorsNumber;
+    struct inputBlock *block;
+};
+
+void input_init();
+void inputNextLine(struct inputLine *line);
+void inputReleaseLine(struct inputLine *line);
+int inputAtEnd();
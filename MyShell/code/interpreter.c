@@ -1,5 +1,4 @@
 #include <ctype.h>
-#include <dirent.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,10 +6,19 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "checkpoint.h"
+#include "listing.h"
+#include "output.h"
+#include "pipeline.h"
+#include "pool.h"
 #include "scheduler.h"
+#include "scriptscache.h"
 #include "scriptsmemory.h"
 #include "shell.h"
 #include "shellmemory.h"
+#include "spawner.h"
+#include "trace.h"
+#include "victimcache.h"
 
 // Max arg size for a single command (name of the command inclusive)
 int MAX_ARGS_SIZE = 7;
@@ -23,7 +31,13 @@ typedef enum commandError_t {
     COMMAND_ERROR_CD,
     COMMAND_ERROR_SCANDIR,
     COMMAND_ERROR_FILE_OPEN,
-    COMMAND_ERROR_NON_ALPHANUM
+    COMMAND_ERROR_NON_ALPHANUM,
+    COMMAND_ERROR_TRACE,
+    COMMAND_ERROR_WAIT,
+    COMMAND_ERROR_SPAWN,
+    COMMAND_ERROR_PIPELINE,
+    COMMAND_ERROR_VARS,
+    COMMAND_ERROR_CHECKPOINT
 } commandError_t;
 
 // Global variable that indicates whether an exec command with '#' was run
@@ -44,13 +58,21 @@ int my_ls();
 int my_touch(char *input);
 int my_mkdir(char *input);
 int my_cd(char *input);
+int trace(char *action, char *fileName);
+int jobs();
+int waitFor(char *jobId);
+int spawn(char *args[], int argsNumber);
+int pipeline(char *args[], int argsNumber);
+int vars(char *action, char *fileName);
+int checkpoint(char *fileName);
+int stats();
+int simulate(char *copies, char *scripts[], int scriptsNumber);
 int is_alphanumeric(char *str);
-int filterOutParentAndCurrentDirectory(const struct dirent *entry);
-int custom_sort(const struct dirent **d1, const struct dirent **d2);
 int is_alphanumeric_list(char **lst, int len_lst);
 policy_t policy_parser(char policy_str[]);
 int exec(char *scripts[], int scripts_number, policy_t policy,
          int isRunningInBackground, int isRunningConcurrently);
+void endSetupOutput(struct outputBuffer *setupOutput, struct outputBuffer *previousOutput);
 
 /**
  * Function that interprets commands and their arguments
@@ -64,17 +86,25 @@ int interpreter(char *command_args[], int args_size) {
     int i, isRunningInBackground, isRunningConcurrently;
     policy_t policy;
 
-    // Make sure that the number of arguments isn't out of bounds
     if (args_size < 1) {
         return badcommand(COMMAND_ERROR_BAD_COMMAND);
-    } else if (args_size > MAX_ARGS_SIZE) {
-        return badcommand(COMMAND_ERROR_TOO_MANY_TOKENS);
     }
 
     for (i = 0; i < args_size; i++) {  // terminate args at newlines
         command_args[i][strcspn(command_args[i], "\r\n")] = 0;
     }
 
+    // The number of arguments is checked for every stage of a pipeline
+    if (isPipeline(command_args, args_size)) {
+        return pipeline(command_args, args_size);
+    }
+
+    // Make sure that the number of arguments isn't out of bounds (spawn
+    // hands any number of arguments over to the command it launches)
+    if (args_size > MAX_ARGS_SIZE && strcmp(command_args[0], "spawn") != 0) {
+        return badcommand(COMMAND_ERROR_TOO_MANY_TOKENS);
+    }
+
     if (strcmp(command_args[0], "help") == 0) {
         if (args_size != 1) return badcommand(COMMAND_ERROR_BAD_COMMAND);
         return help();
@@ -117,6 +147,38 @@ int interpreter(char *command_args[], int args_size) {
         if (args_size != 2) return badcommand(COMMAND_ERROR_BAD_COMMAND);
         return my_cd(command_args[1]);
 
+    } else if (strcmp(command_args[0], "trace") == 0) {
+        if (args_size < 2 || args_size > 3) return badcommand(COMMAND_ERROR_BAD_COMMAND);
+        return trace(command_args[1], args_size == 3 ? command_args[2] : NULL);
+
+    } else if (strcmp(command_args[0], "jobs") == 0) {
+        if (args_size != 1) return badcommand(COMMAND_ERROR_BAD_COMMAND);
+        return jobs();
+
+    } else if (strcmp(command_args[0], "wait") == 0) {
+        if (args_size != 2) return badcommand(COMMAND_ERROR_BAD_COMMAND);
+        return waitFor(command_args[1]);
+
+    } else if (strcmp(command_args[0], "spawn") == 0) {
+        if (args_size < 2) return badcommand(COMMAND_ERROR_BAD_COMMAND);
+        return spawn(command_args + 1, args_size - 1);
+
+    } else if (strcmp(command_args[0], "vars") == 0) {
+        if (args_size != 3) return badcommand(COMMAND_ERROR_BAD_COMMAND);
+        return vars(command_args[1], command_args[2]);
+
+    } else if (strcmp(command_args[0], "checkpoint") == 0) {
+        if (args_size != 2) return badcommand(COMMAND_ERROR_BAD_COMMAND);
+        return checkpoint(command_args[1]);
+
+    } else if (strcmp(command_args[0], "stats") == 0) {
+        if (args_size != 1) return badcommand(COMMAND_ERROR_BAD_COMMAND);
+        return stats();
+
+    } else if (strcmp(command_args[0], "simulate") == 0) {
+        if (args_size < 3) return badcommand(COMMAND_ERROR_BAD_COMMAND);
+        return simulate(command_args[1], command_args + 2, args_size - 2);
+
     } else if (strcmp(command_args[0], "exec") == 0) {
         // Determine whether to execute the command using multithreading
         isRunningConcurrently = strcmp(command_args[args_size - 1], "MT") == 0 ? 1 : 0;
@@ -155,8 +217,17 @@ help			Displays all the commands\n \
 quit			Exits / terminates the shell with “Bye!”\n \
 set VAR STRING		Assigns a value to shell memory\n \
 print VAR		Displays the STRING assigned to VAR\n \
-run SCRIPT.TXT		Executes the file SCRIPT.TXT\n ";
-    printf("%s\n", help_string);
+run SCRIPT.TXT		Executes the file SCRIPT.TXT\n \
+spawn COMMAND ARGS	Launches the external command COMMAND with ARGS\n \
+jobs			Lists the background jobs (exec ... MT)\n \
+wait JOB		Waits for the background job JOB to be done\n \
+vars save|load FILE	Saves / loads the variables to / from FILE\n \
+checkpoint FILE		Saves the state of the running exec in FILE\n \
+stats			Displays the statistics of the shell\n \
+trace start|stop	Starts / stops recording the events\n \
+trace dump|refs FILE	Writes the events / records the page references in FILE\n \
+simulate N SCRIPTS	Dry-runs every policy on N copies of SCRIPTS\n ";
+    shellPrintf("%s\n", help_string);
     return 0;
 }
 
@@ -169,19 +240,28 @@ run SCRIPT.TXT		Executes the file SCRIPT.TXT\n ";
  * @return Returns an integer indicating success (0)
  */
 int quit() {
-    printf("Bye!\n");
-
-    // Case where the main thread is exiting
+    // Case where the main thread is exiting, the jobs still running are done
+    // and their output is written before saying goodbye
     if (isMainThread(pthread_self())) {
+        waitAllJobs();
         joinAllThreads();
+        reapChildren(1);
+        outputFlushAll();
+        shellPrintf("Bye!\n");
+        fflush(stdout);
+        mem_sync_file();
         exit(0);
     } else {
-        // Case where the worker threads signal the main thread to exit
-        pthread_mutex_lock(&finishedWorkLock);
+        // Case where the worker threads signal the main thread to exit (the
+        // goodbye is written in order with the output of the process)
+        shellPrintf("Bye!\n");
+        pthread_mutex_lock(&jobsLock);
         startExitProcedure = 1;
-        pthread_cond_signal(&finishedWorkCond);
-        pthread_mutex_unlock(&finishedWorkLock);
+        pthread_cond_broadcast(&jobsCond);
+        pthread_mutex_unlock(&jobsLock);
     }
+
+    return 0;
 }
 
 /**
@@ -197,8 +277,6 @@ int quit() {
  * @return Returns an integer indicating success (0)
  */
 int set(char *var, char *values[], int number_values) {
-    char *link = "=";
-
     // Input validation ensuring the given arguments are strings
     if (!is_alphanumeric(var) || !is_alphanumeric_list(values, number_values)) {
         return badcommand(COMMAND_ERROR_NON_ALPHANUM);
@@ -217,9 +295,15 @@ int set(char *var, char *values[], int number_values) {
  * @return Returns an integer indicating success (0)
  */
 int print(char *var) {
-    char buffer[MAX_VARIABLE_VALUE_SIZE];
-    mem_get_value(var, buffer);
-    printf("%s\n", buffer);
+    struct valueView value;
+
+    if (mem_get_value(var, &value) != 0) {
+        shellPrintf("Variable does not exist\n");
+        return 0;
+    }
+    shellWrite(value.data, value.length);
+    shellWrite("\n", 1);
+    mem_release_value(&value);
     return 0;
 }
 
@@ -233,7 +317,7 @@ int print(char *var) {
  * @return Returns an integer indicating success (0) or non-zero on failure
  */
 int echo(char *input) {
-    char buffer[MAX_VARIABLE_VALUE_SIZE];  // Buffer to store the variable value
+    struct valueView value;  // Value of the variable
 
     if (input[0] == '$') {           // Case for variable in memory
         char *var_name = input + 1;  // Ignore the '$'
@@ -243,16 +327,15 @@ int echo(char *input) {
             return badcommand(COMMAND_ERROR_NON_ALPHANUM);
         }
 
-        mem_get_value(var_name, buffer);  // Retrieve variable value into buffer
-        if (strcmp(buffer, "Variable does not exist") != 0 ||
-            mem_get_variable_index(var_name) > -1) {
-            printf("%s\n", buffer);  // Print the value (empty if not found)
-        } else {
-            printf("\n");
+        // Print the value (empty if not found)
+        if (mem_get_value(var_name, &value) == 0) {
+            shellWrite(value.data, value.length);
+            mem_release_value(&value);
         }
+        shellWrite("\n", 1);
 
     } else {  // Case for displaying string on a new line
-        printf("%s\n", input);
+        shellPrintf("%s\n", input);
     }
 
     return 0;
@@ -266,23 +349,11 @@ int echo(char *input) {
  * @return Returns an integer indicating success (0) or non-zero on failure
  */
 int my_ls() {
-    // Pointer to an array of pointers that point to the content
-    struct dirent **content;
-
-    // store in content the list of file/folder names in the proper order
-    int n = scandir(".", &content, filterOutParentAndCurrentDirectory, custom_sort);
-
-    // Check for potential errors from scandir
-    if (n < 0) {
+    // List the current directory with numeric entries first, followed by
+    // alphabetic entries, prioritizing capital letters over lowercase ones
+    if (listDirectory(".")) {
         return badcommand(COMMAND_ERROR_SCANDIR);
-    } else {
-        for (int i = 0; i < n; i++) {
-            // Print each file/directory name
-            printf("%s\n", content[i]->d_name);
-            free(content[i]);  // Free allocated memory for each entry
-        }
     }
-    free(content);  // Free the array of directory entries
     return 0;
 }
 
@@ -325,7 +396,7 @@ int my_touch(char *input) {
  * @return Returns an integer indicating success (0) or non-zero on failure
  */
 int my_mkdir(char *input) {
-    char buffer[MAX_VARIABLE_VALUE_SIZE];  // Buffer to store the variable value
+    struct valueView value;  // Value of the variable
 
     if (input[0] == '$') {           // Case for variable in memory
         char *var_name = input + 1;  // Ignore the '$'
@@ -334,14 +405,17 @@ int my_mkdir(char *input) {
         if (!is_alphanumeric(var_name)) {
             return badcommand(COMMAND_ERROR_NON_ALPHANUM);  // Input validation error
         }
-        mem_get_value(var_name, buffer);  // Retrieve variable value into buffer
 
-        // Make sure that the value of the variable is valid
-        if (strcmp(buffer, "Variable does not exist") != 0 && strstr(buffer, " ") == NULL) {
-            mkdir(buffer, 0777);
-        } else {
+        // Make sure that the value of the variable is valid (a single token)
+        if (mem_get_value(var_name, &value) != 0) {
             return badcommand(COMMAND_ERROR_MKDIR);
         }
+        if (value.tokensNumber != 1) {
+            mem_release_value(&value);
+            return badcommand(COMMAND_ERROR_MKDIR);
+        }
+        mkdir(value.data, 0777);
+        mem_release_value(&value);
     } else {  // Case where dirname is not a variable
         // Input validation
         if (!is_alphanumeric(input)) {
@@ -373,6 +447,198 @@ int my_cd(char *input) {
     return 0;
 }
 
+/**
+ * Controls the event trace of the scheduler and of the paging.
+ * "trace start" clears the trace and starts recording, "trace stop" stops
+ * recording and "trace dump FILE" writes the recorded events to FILE as a
+ * Chrome trace (viewable in Perfetto or chrome://tracing). "trace refs FILE"
+ * records the pages referenced by the instructions into FILE until
+ * "trace stop" (to be replayed by pagesim).
+ *
+ * @param action The action to perform (start, stop, dump or refs).
+ * @param fileName The file to dump the trace into (only for dump and refs).
+ * @return 0 on successful execution or non-zero on failure
+ */
+int trace(char *action, char *fileName) {
+    if (strcmp(action, "start") == 0 && !fileName) {
+        traceStart();
+    } else if (strcmp(action, "stop") == 0 && !fileName) {
+        traceStop();
+    } else if (strcmp(action, "dump") == 0 && fileName) {
+        if (traceDump(fileName)) {
+            return badcommand(COMMAND_ERROR_TRACE);
+        }
+    } else if (strcmp(action, "refs") == 0 && fileName) {
+        if (traceRecordReferences(fileName, PAGE_SIZE, FRAME_NUMBER)) {
+            return badcommand(COMMAND_ERROR_TRACE);
+        }
+    } else {
+        return badcommand(COMMAND_ERROR_BAD_COMMAND);
+    }
+
+    return 0;
+}
+
+/**
+ * Lists the background jobs started by exec ... MT that weren't waited for.
+ *
+ * @return 0 on successful execution
+ */
+int jobs() {
+    listJobs();
+    return 0;
+}
+
+/**
+ * Waits for a background job (or all of them with "all") to be done.
+ *
+ * @param jobId A string representing the id of the job to wait for or "all".
+ * @return 0 on successful execution or non-zero if there is no such job
+ */
+int waitFor(char *jobId) {
+    char *end;
+    long id;
+
+    if (strcmp(jobId, "all") == 0) {
+        waitAllJobs();
+        return 0;
+    }
+
+    id = strtol(jobId, &end, 10);
+    if (*jobId == '\0' || *end != '\0' || id <= 0 || waitJob((int)id)) {
+        return badcommand(COMMAND_ERROR_WAIT);
+    }
+
+    return 0;
+}
+
+/**
+ * Launches an external command (searched in the PATH) with its arguments
+ * without waiting for it to exit.
+ *
+ * @param args The name of the command followed by its arguments.
+ * @param argsNumber The number of elements in args.
+ * @return 0 on successful execution or non-zero if the command can't be run
+ */
+int spawn(char *args[], int argsNumber) {
+    if (spawnCommand(args, argsNumber)) {
+        return badcommand(COMMAND_ERROR_SPAWN);
+    }
+
+    return 0;
+}
+
+/**
+ * Runs a pipeline of builtins and external commands ("|") whose output may be
+ * redirected to a file ("> FILE").
+ *
+ * @param args The tokens of the pipeline.
+ * @param argsNumber The number of tokens.
+ * @return 0 on successful execution or non-zero if the pipeline is malformed
+ * or one of its commands or its file can't be opened
+ */
+int pipeline(char *args[], int argsNumber) {
+    if (runPipeline(args, argsNumber)) {
+        return badcommand(COMMAND_ERROR_PIPELINE);
+    }
+
+    return 0;
+}
+
+/**
+ * Saves all the variables into a file or defines the variables saved in a
+ * file (in the binary format of mem_save_file).
+ *
+ * @param action A string that is either "save" or "load".
+ * @param fileName A string representing the path to the variables file.
+ * @return 0 on successful execution or non-zero on failure
+ */
+int vars(char *action, char *fileName) {
+    int errorCode;
+
+    if (strcmp(action, "save") == 0) {
+        errorCode = mem_save_file(fileName);
+    } else if (strcmp(action, "load") == 0) {
+        errorCode = mem_load_file(fileName);
+    } else {
+        return badcommand(COMMAND_ERROR_BAD_COMMAND);
+    }
+
+    if (errorCode) {
+        return badcommand(COMMAND_ERROR_VARS);
+    }
+    return 0;
+}
+
+/**
+ * Saves the state of the running exec (processes, frames and variables) into
+ * a file so that another shell can carry on with it (mysh --restore FILE).
+ * The process executing the command resumes at its next line.
+ *
+ * @param fileName A string representing the path to the checkpoint file.
+ * @return 0 on successful execution or non-zero on failure
+ */
+int checkpoint(char *fileName) {
+    if (checkpointSave(fileName)) {
+        return badcommand(COMMAND_ERROR_CHECKPOINT);
+    }
+    return 0;
+}
+
+/**
+ * Prints the allocation counters of the pools of the shell.
+ *
+ * @return 0 on successful execution
+ */
+int stats() {
+    poolPrintStats(&pcbPool);
+    poolPrintStats(&scriptsPool);
+    poolPrintStats(&sharersPool);
+    victimCachePrintStats();
+    scriptsMemoryPrintStats();
+    schedulerPrintStats();
+    return 0;
+}
+
+/**
+ * Predicts the turnaround and wait times of every policy for COPIES processes
+ * of each script without executing them (see simulateSchedules).
+ *
+ * @param copies A string representing the number of processes per script.
+ * @param scripts An array of strings representing the scripts to simulate.
+ * @param scriptsNumber The number of scripts in the array.
+ * @return 0 on successful execution or non-zero on failure
+ */
+int simulate(char *copies, char *scripts[], int scriptsNumber) {
+    struct scriptFrames *scriptsInfo[MAX_ARGS_SIZE];
+    int copiesNumber, scriptIdx, loadedNumber;
+    char *end;
+
+    copiesNumber = (int)strtol(copies, &end, 10);
+    if (*end || copiesNumber < 1) {
+        return badcommand(COMMAND_ERROR_BAD_COMMAND);
+    }
+
+    // Only the length of the scripts is needed, none of their pages is loaded
+    for (loadedNumber = 0; loadedNumber < scriptsNumber; loadedNumber++) {
+        scriptsInfo[loadedNumber] = scriptsCacheLookup(scripts[loadedNumber]);
+        if (!scriptsInfo[loadedNumber]) {
+            scriptsInfo[loadedNumber] = scriptsCacheLoad(scripts[loadedNumber]);
+        }
+        if (!scriptsInfo[loadedNumber]) {
+            break;
+        }
+    }
+    if (loadedNumber == scriptsNumber) {
+        simulateSchedules(scriptsInfo, scriptsNumber, copiesNumber);
+    }
+    for (scriptIdx = 0; scriptIdx < loadedNumber; scriptIdx++) {
+        scriptsCacheRelease(scriptsInfo[scriptIdx]);
+    }
+
+    return loadedNumber == scriptsNumber ? 0 : badcommand(COMMAND_ERROR_FILE_INEXISTENT);
+}
+
 /**
  * This function takes a script as input and executes it through the scheduler.
  *
@@ -381,7 +647,6 @@ int my_cd(char *input) {
  */
 int run(char *script) {
     int errCode = 0;
-    struct PCB *newPCB;
     struct scriptFrames *scriptInfo;
 
     // First we check to see if in another exec or run command
@@ -390,6 +655,7 @@ int run(char *script) {
     // In which case we don't reload it
     if (scriptInfo) {
         createPCB(FCFS, scriptInfo);
+        scriptsCacheRelease(scriptInfo);
     } else {  // Otherwise we load the script
         errCode = mem_load_script(script, FCFS);
     }
@@ -424,8 +690,17 @@ int run(char *script) {
  */
 int exec(char *scripts[], int scripts_number, policy_t policy,
          int isRunningInBackground, int isRunningConcurrently) {
-    int script_idx, errCode = 0, sameAs;
+    int script_idx, isStartingBackground;
     struct scriptFrames *scriptInfo;
+    struct outputBuffer *setupOutput = NULL, *previousOutput = NULL;
+
+    // The main thread loads the scripts of a job while the other jobs run so
+    // the page faults of the loading are buffered to be written in order with
+    // the output of the jobs (i.e. right before the output of the new job)
+    if (isRunningConcurrently && isMainThread(pthread_self())) {
+        setupOutput = outputCreateBuffer();
+        previousOutput = outputSwitchTo(setupOutput);
+    }
 
     // Loading scripts into memory and checking for any errors
     for (script_idx = 0; script_idx < scripts_number; script_idx++) {
@@ -436,27 +711,36 @@ int exec(char *scripts[], int scripts_number, policy_t policy,
         if (!scriptInfo) {
             // Check for errors when loading the script
             if (mem_load_script(scripts[script_idx], policy)) {
+                endSetupOutput(setupOutput, previousOutput);
                 return badcommand(COMMAND_ERROR_FILE_INEXISTENT);
             }
         } else {
             // Create a new PCB with the same memory as the previous script
             createPCB(policy, scriptInfo);
+            scriptsCacheRelease(scriptInfo);
         }
     }
 
-    // Loading main shell if isRunningInBackground (#) set to True
-    if (isRunningInBackground) {
+    // Loading main shell if isRunningInBackground (#) set to True.
+    // The main shell only needs to be loaded once since it keeps on
+    // streaming the stdin until its end
+    isStartingBackground = isRunningInBackground && !execOnlyLoading;
+    if (isStartingBackground) {
         if (mem_load_script(NULL, INVALID_POLICY)) {
+            endSetupOutput(setupOutput, previousOutput);
             return badcommand(COMMAND_ERROR_FILE_INEXISTENT);
         }
         execOnlyLoading = 1;
     }
+    endSetupOutput(setupOutput, previousOutput);
 
     // Only executing the schedulerRun function if the exec command
     // wasn't preceded by another exec command with # option
-    if (!execOnlyLoading || isRunningInBackground) {
+    if (!execOnlyLoading || isStartingBackground) {
         schedulerRun(policy, isRunningInBackground, isRunningConcurrently);
     }
+
+    return 0;
 }
 
 /*** HELPER FUNCTIONS ***/
@@ -500,74 +784,6 @@ int is_alphanumeric_list(char **lst, int len_lst) {
     return 1;
 }
 
-/**
- * Helper function that filters out current and parent direction during my_ls
- *
- * @param entry A pointer to the directory entry structure to be checked.
- * @return Returns 0 if the entry is . or .. returns 1 others
- */
-int filterOutParentAndCurrentDirectory(const struct dirent *entry) {
-    // Skip Over: "." -> Current Directory & ".." -> Parent Directory
-    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-        return 0;  // False (i.e. Ignore this one)
-    }
-    return 1;  // True  (i.e Don't Ignore)
-}
-
-/**
- * This function is used to sort entries during my_ls with numeric entries
- * first, followed by alphabetic entries, prioritizing capital letters over
- * lowercase ones.
- *
- * @param d1  A pointer to the my_ls entry to compare.
- * @param d2  A pointer to the second my_ls entry to compare.
- * @return    A -1 if d1 is less than d2,
- *            a 1 if d1 is greater than d2,
- *            and 0 if they are equal.
- */
-int custom_sort(const struct dirent **d1, const struct dirent **d2) {
-    // Store name to compare in name1 and name2
-    const char *name1 = (*d1)->d_name;
-    const char *name2 = (*d2)->d_name;
-
-    // Case when both start with same type (i.e. int or letters)
-    int i = 0;
-    while (name1[i] != '\0' && name2[i] != '\0') {
-        // Case when one starts with a [0-9] and the other with [A-Za-z]
-        if (isdigit(name1[i]) && isalpha(name2[i])) {
-            return -1;  // name1 before name2
-        } else if (isalpha(name1[i]) && isdigit(name2[i])) {
-            return 1;  // name2 before name1
-        }
-        // ith char are different
-        if (tolower(name1[i]) != tolower(name2[i])) {
-            if (tolower(name1[i]) < tolower(name2[i])) {
-                return -1;  // name1 before name2
-            } else {
-                return 1;  // name2 before name1
-            }
-        }
-        // Same character but different capitalization
-        if (name1[i] != name2[i]) {
-            if (name1[i] < name2[i]) {
-                return -1;  // name1 before name2
-            } else {
-                return 1;  // name2 before name1
-            }
-        }
-        i++;
-    }
-
-    // Case when two string have the same beginning, but different ending (e.g.
-    // shell.c and shellmemory.c)
-    if (name1[i] == '\0' && name2[i] != '\0') {
-        return -1;  // name1 is shorter, should come first
-    } else if (name2[i] == '\0' && name1[i] != '\0') {
-        return 1;  // name2 is shorter, should come first
-    }
-    return 0;  // When names are identical
-}
-
 /**
  * This function takes a string representing a policy and parses it to return
  * the corresponding 'policy_t' enumeration. Choices are FCFS, SJF, RR, RR30,
@@ -606,23 +822,58 @@ policy_t policy_parser(char policy_str[]) {
 int badcommand(commandError_t errorCode) {
     switch (errorCode) {
         case COMMAND_ERROR_BAD_COMMAND:
-            printf("Unknown Command\n");
+            shellPrintf("Unknown Command\n");
             break;
         case COMMAND_ERROR_TOO_MANY_TOKENS:
-            printf("Bad command: Too many tokens\n");
+            shellPrintf("Bad command: Too many tokens\n");
             break;
         case COMMAND_ERROR_FILE_INEXISTENT:
-            printf("Bad command: File not found\n");
+            shellPrintf("Bad command: File not found\n");
             break;
         case COMMAND_ERROR_MKDIR:
-            printf("Bad command: my_mkdir\n");
+            shellPrintf("Bad command: my_mkdir\n");
             break;
         case COMMAND_ERROR_CD:
-            printf("Bad command: my_cd\n");
+            shellPrintf("Bad command: my_cd\n");
+            break;
+        case COMMAND_ERROR_TRACE:
+            shellPrintf("Bad command: trace\n");
+            break;
+        case COMMAND_ERROR_WAIT:
+            shellPrintf("Bad command: wait\n");
+            break;
+        case COMMAND_ERROR_SPAWN:
+            shellPrintf("Bad command: spawn\n");
+            break;
+        case COMMAND_ERROR_PIPELINE:
+            shellPrintf("Bad command: pipeline\n");
+            break;
+        case COMMAND_ERROR_VARS:
+            shellPrintf("Bad command: vars\n");
+            break;
+        case COMMAND_ERROR_CHECKPOINT:
+            shellPrintf("Bad command: checkpoint\n");
             break;
         default:
             break;
     }
 
     return (int)errorCode;
-}
\ No newline at end of file
+}
+
+/**
+ * Function that ends the buffer receiving the output of the loading of the
+ * scripts of an exec, it is written once the buffers before it are
+ *
+ * @param setupOutput the buffer of the loading (NULL if the output wasn't
+ * buffered)
+ * @param previousOutput the output used before the loading
+ * @return void
+ */
+void endSetupOutput(struct outputBuffer *setupOutput, struct outputBuffer *previousOutput) {
+    if (!setupOutput) {
+        return;
+    }
+    outputSwitchTo(previousOutput);
+    outputProcessEnd(setupOutput);
+}
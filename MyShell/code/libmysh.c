@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "coroutine.h"
+#include "interpreter.h"
+#include "libmysh.h"
+#include "listing.h"
+#include "output.h"
+#include "scheduler.h"
+#include "scriptscache.h"
+#include "scriptsmemory.h"
+#include "shell.h"
+#include "shellmemory.h"
+#include "spawner.h"
+#include "trace.h"
+#include "victimcache.h"
+
+struct myshContext {
+    struct outputBuffer *output;  // Capture of its stdout (NULL if not collected)
+    // Variables saved while another context is active (NULL if none)
+    char *variables;
+    size_t variablesSize;
+};
+
+// Whether the modules of the shell were initialized (once per process)
+int isShellInitialized = 0;
+
+// Context whose variables are in the shell memory (NULL if none)
+struct myshContext *activeContext = NULL;
+
+/*** FUNCTION SIGNATURES ***/
+
+void initializeShell();
+void activateContext(struct myshContext *context);
+
+/*** FUNCTIONS OF THE EMBEDDING API ***/
+
+/**
+ * Function that creates a context and makes it the active one, the shell is
+ * initialized by the first one
+ *
+ * @param isCollectingOutput whether the output of the commands is kept to be
+ * collected with myshCollect rather than written to the stdout
+ * @return the context (to be destroyed with myshDestroy)
+ */
+struct myshContext *myshCreate(int isCollectingOutput) {
+    struct myshContext *context;
+
+    if (!isShellInitialized) {
+        initializeShell();
+        isShellInitialized = 1;
+    }
+
+    context = (struct myshContext *)malloc(sizeof(struct myshContext));
+    context->output = isCollectingOutput ? outputCreateCapture() : NULL;
+    context->variables = NULL;
+    context->variablesSize = 0;
+    activateContext(context);
+
+    return context;
+}
+
+/**
+ * Function that executes lines of commands like the shell does with the lines
+ * of its stdin. The processes of the jobs started (exec ... MT) may still be
+ * running when it returns.
+ *
+ * @param context the context
+ * @param commands the lines of commands (separated by newlines)
+ * @return the error code of the last command
+ */
+int myshSubmit(struct myshContext *context, const char *commands) {
+    char *lines, *line, *nextLine;
+    int errorCode = 0;
+
+    activateContext(context);
+    lines = strdup(commands);
+    // Unlike the stdin, an empty line after the last newline isn't executed
+    for (line = lines; *line; line = nextLine) {
+        nextLine = strchr(line, '\n');
+        nextLine = nextLine ? nextLine + 1 : line + strlen(line);
+        errorCode = convertInputToOneLiners(line);
+        // External commands that exited are reaped in batches
+        reapChildren(0);
+        // A process of a background job may have executed quit
+        exitIfRequested();
+    }
+    free(lines);
+
+    return errorCode;
+}
+
+/**
+ * Function that runs scripts like exec (in the foreground)
+ *
+ * @param context the context
+ * @param scripts the names of the scripts (at most 3)
+ * @param scriptsNumber the number of scripts
+ * @param policy the name of the scheduling policy (e.g. "RR")
+ * @return the error code of exec
+ */
+int myshRun(struct myshContext *context, char *scripts[], int scriptsNumber,
+            const char *policy) {
+    char **words;
+    int word_idx, errorCode;
+
+    activateContext(context);
+    // The interpreter modifies the words in place
+    words = (char **)malloc((scriptsNumber + 2) * sizeof(char *));
+    words[0] = strdup("exec");
+    for (word_idx = 0; word_idx < scriptsNumber; word_idx++) {
+        words[word_idx + 1] = strdup(scripts[word_idx]);
+    }
+    words[scriptsNumber + 1] = strdup(policy);
+    errorCode = interpreter(words, scriptsNumber + 2);
+    for (word_idx = 0; word_idx < scriptsNumber + 2; word_idx++) {
+        free(words[word_idx]);
+    }
+    free(words);
+    reapChildren(0);
+    exitIfRequested();
+
+    return errorCode;
+}
+
+/**
+ * Function that hands out the output of a context since the last time it was
+ * collected, once its jobs are done
+ *
+ * @param context the context (collecting its output)
+ * @param length set to the number of bytes handed out
+ * @return an allocated copy of the output, null terminated (to be freed)
+ */
+char *myshCollect(struct myshContext *context, size_t *length) {
+    activateContext(context);
+    waitAllJobs();
+
+    return outputTakeCapture(context->output, length);
+}
+
+/**
+ * Function that destroys a context once its jobs are done. The variables are
+ * written back to the attached variables file if any (see mem_attach_file).
+ *
+ * @param context the context
+ * @return void
+ */
+void myshDestroy(struct myshContext *context) {
+    if (context == activeContext) {
+        waitAllJobs();
+        reapChildren(1);
+        outputFlushAll();
+        mem_sync_file();
+        outputCaptureStdout(NULL);
+        mem_clear_all();
+        activeContext = NULL;
+    }
+    if (context->output) {
+        outputDestroyCapture(context->output);
+    }
+    free(context->variables);
+    free(context);
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * Function that initializes the modules of the shell (except the input, only
+ * read by the client of the stdin)
+ *
+ * @param void
+ * @return void
+ */
+void initializeShell() {
+    // initialize the event trace (before the modules subscribing to it)
+    trace_init();
+    // initialize shell memory array and associated concurrency variable
+    mem_init();
+    // initialize scheduler scripts memory array and associated concurrency
+    // variables
+    scheduler_init();
+    // initialize the stacks of the processes run as coroutines
+    coroutine_init();
+    // initialize memory for scripts and associated concurrency variables
+    scripts_memory_init();
+    // initialize the cache of script metadata and line indexes
+    scripts_cache_init();
+    // initialize the output buffers of the processes run by worker threads
+    output_init();
+    // initialize the bookkeeping of the external commands launched
+    spawner_init();
+    // initialize the table used to sort the directory listings
+    listing_init();
+    // initialize the cache of the evicted pages
+    victim_cache_init();
+}
+
+/**
+ * Function that makes a context the one the commands run in: once the jobs of
+ * the previous context are done, the variables are swapped and the stdout is
+ * captured for the context
+ *
+ * @param context the context
+ * @return void
+ */
+void activateContext(struct myshContext *context) {
+    if (context == activeContext) {
+        return;
+    }
+    if (activeContext) {
+        waitAllJobs();
+        activeContext->variables = mem_export(&activeContext->variablesSize);
+        mem_clear_all();
+    }
+    if (context->variables) {
+        mem_import(context->variables, context->variablesSize);
+        free(context->variables);
+        context->variables = NULL;
+    }
+    outputCaptureStdout(context->output);
+    activeContext = context;
+}
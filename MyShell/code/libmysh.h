@@ -0,0 +1,18 @@
+#include <stddef.h>
+
+// Shell embedded in a host program (libmysh.a, the mysh binary being the
+// client reading the stdin). The frames, the cache of the scripts and the
+// worker threads belong to the process so they stay warm from one batch of
+// commands to the next, while every context has its own variables and output.
+// The calls must come from a single thread (the one running the processes that
+// aren't in a job) and switching contexts waits for the jobs of the previous
+// one. External commands write to the stdout of the host directly and quit
+// ends the host like it ends the shell.
+struct myshContext;
+
+struct myshContext *myshCreate(int isCollectingOutput);
+int myshSubmit(struct myshContext *context, const char *commands);
+int myshRun(struct myshContext *context, char *scripts[], int scriptsNumber,
+            const char *policy);
+char *myshCollect(struct myshContext *context, size_t *length);
+void myshDestroy(struct myshContext *context);
@@ -0,0 +1,409 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "listing.h"
+#include "output.h"
+
+// Layout of the records returned by the getdents64 system call
+struct kernelDirent {
+    unsigned long long inode;
+    long long offset;
+    unsigned short recordLength;
+    unsigned char type;
+    char name[];
+};
+
+// Entry of a listing. The name is only kept as its sort key (see
+// appendEntry) from which it is decoded when it is written.
+struct listingEntry {
+    unsigned long long prefix;  // First bytes of the key (big-endian)
+    size_t keyOffset;           // Offset of the key in the keys of the listing
+    unsigned int keyLength;
+};
+
+struct listing {
+    struct listingEntry *entries;
+    size_t entriesNumber;
+    size_t entriesCapacity;
+    unsigned char *keys;
+    size_t keysLength;
+    size_t keysCapacity;
+};
+
+// Range of entries sorted or merged by a thread
+struct sortTask {
+    struct listing *listing;
+    struct listingEntry *entries;
+    struct listingEntry *scratch;
+    size_t start;
+    size_t middle;
+    size_t end;
+};
+
+// Keys of the listing being sorted by qsort on the running thread
+__thread const unsigned char *sortedKeys;
+
+// Rank of every character in the order of custom_sort (by tolower(c) then by
+// c) and the character of every rank. A sort key is the name with every
+// character replaced by its rank.
+unsigned char charRanks[256];
+unsigned char rankChars[256];
+
+/*** FUNCTION SIGNATURES ***/
+
+int compareChars(int byte1, int byte2);
+int readEntries(int fd, struct listing *listing);
+void appendEntry(struct listing *listing, const char *name);
+int compareEntries(const void *entry1, const void *entry2);
+int compareKeys(const unsigned char *keys, const struct listingEntry *entry1,
+                const struct listingEntry *entry2);
+void sortEntries(struct listing *listing);
+void *sortRange(void *task);
+void *mergeRanges(void *task);
+void writeEntries(struct listing *listing);
+
+/*** FUNCTIONS FOR DIRECTORY LISTINGS ***/
+
+/**
+ * This function intializes the table used to build the sort keys of the
+ * directory listings.
+ * @param void
+ * @return void
+ */
+void listing_init() {
+    int byte, rankIdx;
+
+    // Insertion sort of the 256 characters
+    for (byte = 0; byte < 256; byte++) {
+        for (rankIdx = byte; rankIdx > 0 && compareChars(rankChars[rankIdx - 1], byte) > 0;
+             rankIdx--) {
+            rankChars[rankIdx] = rankChars[rankIdx - 1];
+        }
+        rankChars[rankIdx] = (unsigned char)byte;
+    }
+    for (rankIdx = 0; rankIdx < 256; rankIdx++) {
+        charRanks[rankChars[rankIdx]] = (unsigned char)rankIdx;
+    }
+}
+
+/**
+ * Function that writes the names of the entries of a directory (except "."
+ * and "..") to the output of the running thread, one per line. Names starting
+ * with a digit come first, then names are ordered alphabetically ignoring the
+ * case and uppercase letters come before lowercase ones on ties (i.e. the
+ * order of the custom_sort comparator used with scandir previously).
+ * The entries are read in large batches straight from the kernel and each
+ * name is turned into a sort key once so that comparisons are plain memcmp.
+ *
+ * @param path the path of the directory
+ * @return 0 on success, non-zero if the directory can't be read
+ */
+int listDirectory(const char *path) {
+    struct listing listing;
+    int fd, errorCode;
+
+    fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return 1;
+    }
+
+    memset(&listing, 0, sizeof(listing));
+    errorCode = readEntries(fd, &listing);
+    close(fd);
+
+    if (!errorCode) {
+        sortEntries(&listing);
+        writeEntries(&listing);
+    }
+
+    free(listing.entries);
+    free(listing.keys);
+    return errorCode;
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * Function that compares two characters like custom_sort: ignoring the case
+ * first, then uppercase before lowercase. The characters are compared as
+ * chars, like in the names.
+ *
+ * @param byte1 the first character
+ * @param byte2 the second character
+ * @return negative if byte1 comes first, positive if byte2 comes first
+ */
+int compareChars(int byte1, int byte2) {
+    char char1 = (char)byte1, char2 = (char)byte2;
+
+    if (tolower(char1) != tolower(char2)) {
+        return tolower(char1) < tolower(char2) ? -1 : 1;
+    }
+    return (char1 > char2) - (char1 < char2);
+}
+
+/**
+ * Function that reads all the entries of a directory with getdents64 (many
+ * entries per system call and no per-entry allocation unlike readdir/scandir)
+ *
+ * @param fd the open directory
+ * @param listing the listing to fill
+ * @return 0 on success, non-zero if the directory can't be read
+ */
+int readEntries(int fd, struct listing *listing) {
+    struct kernelDirent *entry;
+    char *buffer;
+    long bytesRead, position;
+
+    buffer = (char *)malloc(LISTING_READ_SIZE);
+    while ((bytesRead = syscall(SYS_getdents64, fd, buffer, LISTING_READ_SIZE)) > 0) {
+        for (position = 0; position < bytesRead; position += entry->recordLength) {
+            entry = (struct kernelDirent *)(buffer + position);
+            // Skip Over: "." -> Current Directory & ".." -> Parent Directory
+            if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) {
+                continue;
+            }
+            appendEntry(listing, entry->name);
+        }
+    }
+    free(buffer);
+
+    return bytesRead < 0;
+}
+
+/**
+ * Function that adds a name to a listing as its sort key (every character
+ * replaced by its rank). Since custom_sort is decided by the first character
+ * that differs (the shorter name first on a common prefix), comparing the
+ * keys with memcmp gives the same order.
+ *
+ * @param listing the listing to add to
+ * @param name the name of the entry
+ * @return void
+ */
+void appendEntry(struct listing *listing, const char *name) {
+    struct listingEntry *entry;
+    size_t nameLength = strlen(name), charIdx;
+    unsigned char *key;
+    int byteIdx;
+
+    if (listing->entriesNumber == listing->entriesCapacity) {
+        listing->entriesCapacity = listing->entriesCapacity ? listing->entriesCapacity * 2 : 1024;
+        listing->entries = (struct listingEntry *)realloc(
+            listing->entries, listing->entriesCapacity * sizeof(struct listingEntry));
+    }
+    if (listing->keysLength + nameLength > listing->keysCapacity) {
+        while (listing->keysLength + nameLength > listing->keysCapacity) {
+            listing->keysCapacity = listing->keysCapacity ? listing->keysCapacity * 2 : 1 << 16;
+        }
+        listing->keys = (unsigned char *)realloc(listing->keys, listing->keysCapacity);
+    }
+
+    key = listing->keys + listing->keysLength;
+    for (charIdx = 0; charIdx < nameLength; charIdx++) {
+        key[charIdx] = charRanks[(unsigned char)name[charIdx]];
+    }
+
+    entry = &listing->entries[listing->entriesNumber++];
+    entry->keyOffset = listing->keysLength;
+    entry->keyLength = nameLength;
+    // Shorter keys are padded with zeros, ties are settled by compareKeys
+    entry->prefix = 0;
+    for (byteIdx = 0; byteIdx < 8; byteIdx++) {
+        entry->prefix <<= 8;
+        if ((size_t)byteIdx < entry->keyLength) {
+            entry->prefix |= key[byteIdx];
+        }
+    }
+    listing->keysLength += entry->keyLength;
+}
+
+/**
+ * Comparator for qsort of the entries of the listing being sorted on the
+ * running thread
+ *
+ * @param entry1 a pointer to the first entry
+ * @param entry2 a pointer to the second entry
+ * @return negative if entry1 comes first, positive if entry2 comes first
+ */
+int compareEntries(const void *entry1, const void *entry2) {
+    return compareKeys(sortedKeys, (const struct listingEntry *)entry1,
+                       (const struct listingEntry *)entry2);
+}
+
+/**
+ * Function that compares the keys of two entries
+ *
+ * @param keys the keys of the listing
+ * @param entry1 the first entry
+ * @param entry2 the second entry
+ * @return negative if entry1 comes first, positive if entry2 comes first
+ */
+int compareKeys(const unsigned char *keys, const struct listingEntry *entry1,
+                const struct listingEntry *entry2) {
+    unsigned int commonLength;
+    int result;
+
+    if (entry1->prefix != entry2->prefix) {
+        return entry1->prefix < entry2->prefix ? -1 : 1;
+    }
+    commonLength = entry1->keyLength < entry2->keyLength ? entry1->keyLength : entry2->keyLength;
+    result = memcmp(keys + entry1->keyOffset, keys + entry2->keyOffset, commonLength);
+    if (result != 0) {
+        return result;
+    }
+    // Same beginning, the shorter name comes first
+    return (entry1->keyLength > entry2->keyLength) - (entry1->keyLength < entry2->keyLength);
+}
+
+/**
+ * Function that sorts the entries of a listing. Large listings are split in
+ * ranges sorted by separate threads and merged pairwise (in parallel too).
+ *
+ * @param listing the listing to sort
+ * @return void
+ */
+void sortEntries(struct listing *listing) {
+    struct sortTask tasks[LISTING_MAX_THREADS];
+    pthread_t threads[LISTING_MAX_THREADS];
+    struct listingEntry *scratch, *swap;
+    size_t bounds[LISTING_MAX_THREADS + 1];
+    long cpus;
+    int threadsNumber, rangesNumber, taskIdx, rangeIdx;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threadsNumber = cpus < LISTING_MAX_THREADS ? (int)cpus : LISTING_MAX_THREADS;
+    if (listing->entriesNumber < LISTING_PARALLEL_THRESHOLD || threadsNumber < 2) {
+        sortedKeys = listing->keys;
+        qsort(listing->entries, listing->entriesNumber, sizeof(struct listingEntry),
+              compareEntries);
+        return;
+    }
+
+    rangesNumber = threadsNumber;
+    for (rangeIdx = 0; rangeIdx <= rangesNumber; rangeIdx++) {
+        bounds[rangeIdx] = listing->entriesNumber * rangeIdx / rangesNumber;
+    }
+    for (taskIdx = 0; taskIdx < rangesNumber; taskIdx++) {
+        tasks[taskIdx].listing = listing;
+        tasks[taskIdx].entries = listing->entries;
+        tasks[taskIdx].start = bounds[taskIdx];
+        tasks[taskIdx].end = bounds[taskIdx + 1];
+        pthread_create(&threads[taskIdx], NULL, sortRange, &tasks[taskIdx]);
+    }
+    for (taskIdx = 0; taskIdx < rangesNumber; taskIdx++) {
+        pthread_join(threads[taskIdx], NULL);
+    }
+
+    // Every round merges the sorted ranges two by two into the other array
+    scratch = (struct listingEntry *)malloc(listing->entriesNumber * sizeof(struct listingEntry));
+    while (rangesNumber > 1) {
+        for (taskIdx = 0; taskIdx < rangesNumber / 2; taskIdx++) {
+            tasks[taskIdx].listing = listing;
+            tasks[taskIdx].entries = listing->entries;
+            tasks[taskIdx].scratch = scratch;
+            tasks[taskIdx].start = bounds[2 * taskIdx];
+            tasks[taskIdx].middle = bounds[2 * taskIdx + 1];
+            tasks[taskIdx].end = bounds[2 * taskIdx + 2];
+            pthread_create(&threads[taskIdx], NULL, mergeRanges, &tasks[taskIdx]);
+        }
+        // The last range is copied as is when the number of ranges is odd
+        if (rangesNumber % 2) {
+            memcpy(scratch + bounds[rangesNumber - 1], listing->entries + bounds[rangesNumber - 1],
+                   (bounds[rangesNumber] - bounds[rangesNumber - 1]) * sizeof(struct listingEntry));
+        }
+        for (taskIdx = 0; taskIdx < rangesNumber / 2; taskIdx++) {
+            pthread_join(threads[taskIdx], NULL);
+        }
+
+        for (rangeIdx = 0; 2 * rangeIdx < rangesNumber; rangeIdx++) {
+            bounds[rangeIdx] = bounds[2 * rangeIdx];
+        }
+        bounds[rangeIdx] = listing->entriesNumber;
+        rangesNumber = rangeIdx;
+
+        swap = listing->entries;
+        listing->entries = scratch;
+        scratch = swap;
+    }
+    free(scratch);
+}
+
+/**
+ * Thread routine sorting a range of the entries of a listing
+ *
+ * @param task the range to sort (struct sortTask)
+ * @return NULL
+ */
+void *sortRange(void *task) {
+    struct sortTask *range = (struct sortTask *)task;
+
+    sortedKeys = range->listing->keys;
+    qsort(range->entries + range->start, range->end - range->start,
+          sizeof(struct listingEntry), compareEntries);
+    return NULL;
+}
+
+/**
+ * Thread routine merging two consecutive sorted ranges of the entries of a
+ * listing into the same range of the scratch array
+ *
+ * @param task the ranges to merge (struct sortTask)
+ * @return NULL
+ */
+void *mergeRanges(void *task) {
+    struct sortTask *ranges = (struct sortTask *)task;
+    const unsigned char *keys = ranges->listing->keys;
+    struct listingEntry *entries = ranges->entries;
+    size_t left = ranges->start, right = ranges->middle, merged = ranges->start;
+
+    while (left < ranges->middle && right < ranges->end) {
+        if (compareKeys(keys, &entries[right], &entries[left]) < 0) {
+            ranges->scratch[merged++] = entries[right++];
+        } else {
+            ranges->scratch[merged++] = entries[left++];
+        }
+    }
+    memcpy(ranges->scratch + merged, entries + left,
+           (ranges->middle - left) * sizeof(struct listingEntry));
+    merged += ranges->middle - left;
+    memcpy(ranges->scratch + merged, entries + right,
+           (ranges->end - right) * sizeof(struct listingEntry));
+    return NULL;
+}
+
+/**
+ * Function that decodes the names of the sorted entries and writes them to the
+ * output of the running thread in large blocks
+ *
+ * @param listing the sorted listing
+ * @return void
+ */
+void writeEntries(struct listing *listing) {
+    char *block;
+    size_t blockLength = 0, entryIdx;
+    unsigned int byteIdx;
+    struct listingEntry *entry;
+    const unsigned char *key;
+
+    block = (char *)malloc(LISTING_OUTPUT_SIZE);
+    for (entryIdx = 0; entryIdx < listing->entriesNumber; entryIdx++) {
+        entry = &listing->entries[entryIdx];
+        if (blockLength + entry->keyLength + 1 > LISTING_OUTPUT_SIZE) {
+            shellWrite(block, blockLength);
+            blockLength = 0;
+        }
+        key = listing->keys + entry->keyOffset;
+        for (byteIdx = 0; byteIdx < entry->keyLength; byteIdx++) {
+            block[blockLength++] = (char)rankChars[key[byteIdx]];
+        }
+        block[blockLength++] = '\n';
+    }
+    shellWrite(block, blockLength);
+    free(block);
+}
@@ -0,0 +1,13 @@
+// Size of the buffer receiving the directory entries from the kernel
+#define LISTING_READ_SIZE (1 << 20)
+// Size of the blocks in which the listing is written to the output
+#define LISTING_OUTPUT_SIZE (1 << 16)
+
+// Number of entries from which the sort is split among threads
+#ifndef LISTING_PARALLEL_THRESHOLD
+#define LISTING_PARALLEL_THRESHOLD 65536
+#endif
+#define LISTING_MAX_THREADS 8
+
+void listing_init();
+int listDirectory(const char *path);
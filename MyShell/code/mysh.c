@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "input.h"
+#include "libmysh.h"
+#include "scheduler.h"
+#include "scriptsmemory.h"
+#include "shell.h"
+#include "shellmemory.h"
+#include "spawner.h"
+
+// Client of the shell (libmysh.a) executing the lines of the stdin
+
+/**
+ * Start of everything
+ *
+ * @param argc The number of command-line arguments passed to the program.
+ * @param argv An array of pointers to the command-line arguments.
+ * @return Returns an integer status code, 0 for success
+ */
+int main(int argc, char *argv[]) {
+    printf("Frame Store Size = %d; Variable Store Size = %d\n", FRAME_STORE_SIZE, VAR_MEMSIZE);
+    // help();  //Not printing the help text anymore at start of shell
+
+    char prompt = '$';             // Shell prompt
+    struct inputLine userInput;  // user's input (read in blocks)
+    struct myshContext *context;
+    char *varsFileName = NULL, *checkpointFileName = NULL;
+    int errorCode;
+
+    // The variables can persist across runs in a file (--vars FILE) and an
+    // exec can carry on from a checkpoint (--restore FILE)
+    for (int i = 1; i < argc; i += 2) {
+        if (strcmp(argv[i], "--vars") == 0 && i + 1 < argc) {
+            varsFileName = argv[i + 1];
+            continue;
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            checkpointFileName = argv[i + 1];
+            continue;
+        } else if (strcmp(argv[i], "--vars") == 0 || strcmp(argv[i], "--restore") == 0) {
+            printf("Bad command: Missing file after %s\n", argv[i]);
+        } else {
+            printf("Bad command: Unknown option %s\n", argv[i]);
+        }
+        printf("Usage: mysh [--vars FILE] [--restore FILE]\n");
+        return 1;
+    }
+
+    // initialize the shell, its output goes to the stdout
+    context = myshCreate(0);
+    // initialize the reading of the stdin (ahead of the execution in batch
+    // mode)
+    input_init();
+
+    if (varsFileName && (errorCode = mem_attach_file(varsFileName))) {
+        printf(errorCode == 2 ? "Bad command: Variable store full\n"
+                              : "Bad command: Invalid variables file\n");
+        return 1;
+    }
+    if (checkpointFileName && checkpointResume(checkpointFileName)) {
+        printf("Bad command: Invalid checkpoint file\n");
+        return 1;
+    }
+
+    // In batch mode, quit once the end of the input is reached
+    while (!inputAtEnd()) {
+        // if print the prompt only if the stdin is pointing to terminal
+        if (isatty(fileno(stdin))) {
+            printf("%c ", prompt);
+            fflush(stdout);
+        }
+
+        inputNextLine(&userInput);
+        executeInputLine(&userInput);
+        inputReleaseLine(&userInput);
+        // External commands that exited are reaped in batches
+        reapChildren(0);
+        // A process of a background job may have executed quit
+        exitIfRequested();
+    }
+
+    // Let the background jobs and the external commands finish before exiting
+    waitAllJobs();
+    joinAllThreads();
+    myshDestroy(context);
+
+    return 0;
+}
@@ -0,0 +1,411 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "output.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// Buffer in which the running thread writes its output. NULL means that the
+// output goes directly to the stdout (main thread)
+__thread struct outputBuffer *currentOutput = NULL;
+
+// Buffers not entirely written yet in the order of their creation
+struct outputBuffer *pendingOutputHead;
+struct outputBuffer *pendingOutputTail;
+
+// Buffer receiving what is written to the stdout instead of it (NULL if none),
+// used by a host embedding the shell to collect the output (see libmysh.c)
+struct outputBuffer *stdoutCapture = NULL;
+
+// Mutex lock used whenever the pending buffers or the stdout are accessed
+pthread_mutex_t outputLock;
+
+/*** FUNCTION SIGNATURES ***/
+
+struct outputBuffer *allocateBuffer();
+void appendToBuffer(struct outputBuffer *buffer, const char *data, size_t length);
+void writeReadyBuffers(int isIgnoringOrder, int isFlushingAll, struct outputBuffer *callerBuffer);
+void writeBuffers(struct iovec *vectors, int vectorsNumber);
+void writeStdout(const char *data, size_t length);
+
+/*** FUNCTIONS FOR THE OUTPUT ***/
+
+/**
+ * This function intializes the list of pending output buffers and the
+ * associated concurrency variables.
+ * @param void
+ * @return void
+ */
+void output_init() {
+    pendingOutputHead = NULL;
+    pendingOutputTail = NULL;
+
+    pthread_mutex_init(&outputLock, NULL);
+}
+
+/**
+ * Function that formats its arguments like printf into the output of the
+ * running thread (i.e. the buffer of the process it is executing or stdout)
+ *
+ * @param format the printf format string
+ * @return the number of characters written
+ */
+int shellPrintf(const char *format, ...) {
+    char stackBuffer[512], *formatted = stackBuffer;
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    if (!currentOutput && !stdoutCapture) {
+        length = vprintf(format, args);
+        va_end(args);
+        return length;
+    }
+    length = vsnprintf(stackBuffer, sizeof(stackBuffer), format, args);
+    va_end(args);
+
+    // Case where the output doesn't fit in the stack buffer
+    if (length >= (int)sizeof(stackBuffer)) {
+        formatted = (char *)malloc(length + 1);
+        va_start(args, format);
+        vsnprintf(formatted, length + 1, format, args);
+        va_end(args);
+    }
+    if (currentOutput) {
+        appendToBuffer(currentOutput, formatted, length);
+    } else {
+        writeStdout(formatted, length);
+    }
+    if (formatted != stackBuffer) {
+        free(formatted);
+    }
+
+    return length;
+}
+
+/**
+ * Function that writes raw bytes into the output of the running thread
+ *
+ * @param data the bytes to write
+ * @param length the number of bytes to write
+ * @return void
+ */
+void shellWrite(const char *data, size_t length) {
+    if (!currentOutput) {
+        writeStdout(data, length);
+    } else {
+        appendToBuffer(currentOutput, data, length);
+    }
+}
+
+/**
+ * Function that creates the output buffer of a process. The order of creation
+ * is the order in which the buffers are written with OUTPUT_ORDER_PROCESS.
+ * @param void
+ * @return the new output buffer
+ */
+struct outputBuffer *outputCreateBuffer() {
+    struct outputBuffer *buffer = allocateBuffer();
+
+    pthread_mutex_lock(&outputLock);
+    if (pendingOutputTail) {
+        pendingOutputTail->next = buffer;
+    } else {
+        pendingOutputHead = buffer;
+    }
+    pendingOutputTail = buffer;
+    pthread_mutex_unlock(&outputLock);
+
+    return buffer;
+}
+
+/**
+ * Function that creates a buffer capturing the output of a command (e.g. a
+ * builtin in a pipeline). Unlike the buffers of the processes, it is never
+ * written to the stdout: its owner consumes its content and destroys it.
+ * @param void
+ * @return the new capture buffer
+ */
+struct outputBuffer *outputCreateCapture() {
+    return allocateBuffer();
+}
+
+/**
+ * Function that frees a capture buffer
+ *
+ * @param buffer the buffer created by outputCreateCapture
+ * @return void
+ */
+void outputDestroyCapture(struct outputBuffer *buffer) {
+    free(buffer->data);
+    free(buffer);
+}
+
+/**
+ * Function that redirects everything written to the stdout (directly or by
+ * flushing the buffers of the processes) into a capture buffer
+ *
+ * @param capture the buffer created by outputCreateCapture or NULL to write to
+ * the stdout again
+ * @return void
+ */
+void outputCaptureStdout(struct outputBuffer *capture) {
+    pthread_mutex_lock(&outputLock);
+    fflush(stdout);
+    stdoutCapture = capture;
+    pthread_mutex_unlock(&outputLock);
+}
+
+/**
+ * Function that hands out what a capture buffer holds and empties it
+ *
+ * @param capture the buffer created by outputCreateCapture
+ * @param length set to the number of bytes handed out
+ * @return an allocated copy of the content, null terminated (to be freed)
+ */
+char *outputTakeCapture(struct outputBuffer *capture, size_t *length) {
+    char *content;
+
+    pthread_mutex_lock(&outputLock);
+    content = (char *)malloc(capture->length + 1);
+    memcpy(content, capture->data, capture->length);
+    content[capture->length] = '\0';
+    *length = capture->length;
+    capture->length = 0;
+    pthread_mutex_unlock(&outputLock);
+
+    return content;
+}
+
+/**
+ * Function that redirects the output of the running thread to a buffer
+ *
+ * @param buffer the buffer to write into or NULL for stdout
+ * @return the buffer that was used before
+ */
+struct outputBuffer *outputSwitchTo(struct outputBuffer *buffer) {
+    struct outputBuffer *previous = currentOutput;
+    currentOutput = buffer;
+    return previous;
+}
+
+/**
+ * Function to call at the end of every time slice of a process. The output
+ * accumulated is written if the ordering policy allows it.
+ *
+ * @param buffer the buffer of the process that was preempted
+ * @return void
+ */
+void outputSliceEnd(struct outputBuffer *buffer) {
+    struct iovec vector;
+
+    pthread_mutex_lock(&outputLock);
+    if (OUTPUT_ORDER == OUTPUT_ORDER_SLICE) {
+        vector.iov_base = buffer->data;
+        vector.iov_len = buffer->length;
+        writeBuffers(&vector, 1);
+        buffer->length = 0;
+    } else if (buffer == pendingOutputHead) {
+        // Nothing precedes the oldest buffer so its output can stream out
+        writeReadyBuffers(0, 0, buffer);
+    }
+    pthread_mutex_unlock(&outputLock);
+}
+
+/**
+ * Function to call once a process terminated. Its buffer is written (as well as
+ * the buffers that were waiting on it) once allowed by the ordering policy
+ * and freed.
+ *
+ * @param buffer the buffer of the process that terminated
+ * @return void
+ */
+void outputProcessEnd(struct outputBuffer *buffer) {
+    pthread_mutex_lock(&outputLock);
+    buffer->isComplete = 1;
+    writeReadyBuffers(OUTPUT_ORDER == OUTPUT_ORDER_SLICE, 0, buffer);
+    pthread_mutex_unlock(&outputLock);
+}
+
+/**
+ * Function that writes everything that is still buffered regardless of the
+ * ordering policy (e.g. before exiting the shell). No process may be running
+ * on the worker threads.
+ * @param void
+ * @return void
+ */
+void outputFlushAll() {
+    pthread_mutex_lock(&outputLock);
+    writeReadyBuffers(1, 1, NULL);
+    pthread_mutex_unlock(&outputLock);
+    fflush(stdout);
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * Function that allocates an empty output buffer
+ * @param void
+ * @return the new buffer
+ */
+struct outputBuffer *allocateBuffer() {
+    struct outputBuffer *buffer;
+
+    buffer = (struct outputBuffer *)malloc(sizeof(struct outputBuffer));
+    buffer->data = (char *)malloc(OUTPUT_BUFFER_INITIAL_SIZE);
+    buffer->length = 0;
+    buffer->capacity = OUTPUT_BUFFER_INITIAL_SIZE;
+    buffer->isComplete = 0;
+    buffer->next = NULL;
+
+    return buffer;
+}
+
+/**
+ * Function that appends bytes to a buffer, growing it if needed
+ *
+ * @param buffer the buffer to append to
+ * @param data the bytes to append
+ * @param length the number of bytes to append
+ * @return void
+ */
+void appendToBuffer(struct outputBuffer *buffer, const char *data, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        while (buffer->length + length > buffer->capacity) {
+            buffer->capacity *= 2;
+        }
+        buffer->data = (char *)realloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+/**
+ * Function that writes in a single batch the pending buffers that can be
+ * written: the complete buffers at the head of the list as well as what the
+ * buffer of the calling thread already holds if it is reached. Complete
+ * buffers that were written are freed. Must be called with the outputLock held.
+ * Note that the other incomplete buffers are left alone since the threads
+ * running their process append to them without holding the outputLock.
+ *
+ * @param isIgnoringOrder whether to write the buffers that can be written
+ * regardless of the order of the list
+ * @param isFlushingAll whether to also write the other incomplete buffers
+ * (only when no process is running)
+ * @param callerBuffer the buffer of the process of the calling thread or NULL
+ * @return void
+ */
+void writeReadyBuffers(int isIgnoringOrder, int isFlushingAll, struct outputBuffer *callerBuffer) {
+    struct iovec vectors[IOV_MAX];
+    struct outputBuffer *reached[IOV_MAX], *buffer, **link;
+    int isWritten[IOV_MAX];
+    int vectorsNumber = 0, reachedNumber = 0, reachedIdx;
+
+    // A buffer can only be written once all the buffers before it completed
+    buffer = pendingOutputHead;
+    while (buffer && reachedNumber < IOV_MAX) {
+        if (reachedNumber > 0 && !isIgnoringOrder &&
+            !reached[reachedNumber - 1]->isComplete) {
+            break;
+        }
+        reached[reachedNumber] = buffer;
+        isWritten[reachedNumber] =
+            buffer->isComplete || buffer == callerBuffer || isFlushingAll;
+        if (isWritten[reachedNumber] && buffer->length) {
+            vectors[vectorsNumber].iov_base = buffer->data;
+            vectors[vectorsNumber].iov_len = buffer->length;
+            vectorsNumber++;
+        }
+        reachedNumber++;
+        buffer = buffer->next;
+    }
+    writeBuffers(vectors, vectorsNumber);
+
+    // The buffers reached are at the start of the list, the complete ones
+    // are freed and the others that were written are emptied
+    link = &pendingOutputHead;
+    for (reachedIdx = 0; reachedIdx < reachedNumber; reachedIdx++) {
+        buffer = reached[reachedIdx];
+        if (isWritten[reachedIdx]) {
+            buffer->length = 0;
+        }
+        if (buffer->isComplete) {
+            *link = buffer->next;
+            free(buffer->data);
+            free(buffer);
+        } else {
+            link = &buffer->next;
+        }
+    }
+
+    // Find the new tail of the list
+    pendingOutputTail = NULL;
+    for (buffer = pendingOutputHead; buffer; buffer = buffer->next) {
+        pendingOutputTail = buffer;
+    }
+}
+
+/**
+ * Function that writes a batch of buffers to the stdout with the fewest system
+ * calls possible. Must be called with the outputLock held.
+ *
+ * @param vectors the buffers to write
+ * @param vectorsNumber the number of buffers to write
+ * @return void
+ */
+void writeBuffers(struct iovec *vectors, int vectorsNumber) {
+    ssize_t written;
+
+    if (vectorsNumber == 0) {
+        return;
+    }
+    if (stdoutCapture) {
+        for (; vectorsNumber > 0; vectors++, vectorsNumber--) {
+            appendToBuffer(stdoutCapture, vectors->iov_base, vectors->iov_len);
+        }
+        return;
+    }
+    // What was printed directly on the stdout must come first
+    fflush(stdout);
+    while (vectorsNumber > 0) {
+        written = writev(STDOUT_FILENO, vectors, vectorsNumber);
+        if (written < 0) {
+            return;
+        }
+        // Skip over what was written in case of a partial write
+        while (vectorsNumber > 0 && (size_t)written >= vectors->iov_len) {
+            written -= vectors->iov_len;
+            vectors++;
+            vectorsNumber--;
+        }
+        if (vectorsNumber > 0) {
+            vectors->iov_base = (char *)vectors->iov_base + written;
+            vectors->iov_len -= written;
+        }
+    }
+}
+
+/**
+ * Function that writes bytes to the stdout or to the buffer capturing it
+ *
+ * @param data the bytes to write
+ * @param length the number of bytes to write
+ * @return void
+ */
+void writeStdout(const char *data, size_t length) {
+    if (!stdoutCapture) {
+        fwrite(data, 1, length, stdout);
+        return;
+    }
+    pthread_mutex_lock(&outputLock);
+    appendToBuffer(stdoutCapture, data, length);
+    pthread_mutex_unlock(&outputLock);
+}
@@ -0,0 +1,42 @@
+#include <stddef.h>
+
+// Policies deciding in which order the buffered output of the processes run
+// by the worker threads (exec ... MT) reaches the stdout
+typedef enum outputOrder_t {
+    // Every process' output is written in the order the processes were
+    // created (preceded by the page faults of the loading of its exec) so the
+    // order of the output doesn't depend on the interleaving of the workers.
+    // Its content still does when pages are replaced: which page is the
+    // victim depends on the pages the other processes used meanwhile.
+    OUTPUT_ORDER_PROCESS = 0,
+    // Output is written at the end of every time slice in the order the
+    // slices end (lower latency but interleaved at the slice level)
+    OUTPUT_ORDER_SLICE
+} outputOrder_t;
+
+#ifndef OUTPUT_ORDER
+#define OUTPUT_ORDER OUTPUT_ORDER_PROCESS
+#endif
+
+#define OUTPUT_BUFFER_INITIAL_SIZE 256
+
+struct outputBuffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int isComplete;
+    struct outputBuffer *next;
+};
+
+void output_init();
+int shellPrintf(const char *format, ...);
+void shellWrite(const char *data, size_t length);
+struct outputBuffer *outputCreateBuffer();
+struct outputBuffer *outputCreateCapture();
+void outputDestroyCapture(struct outputBuffer *buffer);
+void outputCaptureStdout(struct outputBuffer *capture);
+char *outputTakeCapture(struct outputBuffer *capture, size_t *length);
+struct outputBuffer *outputSwitchTo(struct outputBuffer *buffer);
+void outputSliceEnd(struct outputBuffer *buffer);
+void outputProcessEnd(struct outputBuffer *buffer);
+void outputFlushAll();
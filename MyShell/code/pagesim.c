@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+// Replays a page-reference trace recorded by "trace refs FILE" and prints the
+// page faults it would take with every number of frames under Belady's OPT,
+// LRU, FIFO and CLOCK, e.g. to size the frame store without rebuilding the
+// shell for every framesize.
+// Usage: ./pagesim TRACE [max frames]
+// OPT and LRU are stack algorithms: a single pass computes the stack distance
+// of every reference, which gives the faults for all the numbers of frames at
+// once. FIFO and CLOCK aren't (see Belady's anomaly) so they are replayed once
+// per number of frames.
+
+// Size of the hash table mapping the pages of the trace to dense ids
+#define PAGES_TABLE_INITIAL_SIZE 1024
+
+// Next use of a page that is never referenced again
+#define NEVER_USED_AGAIN -1L
+
+// References of a trace, the pages being numbered in the order of their first
+// reference
+struct referenceTrace {
+    int *references;
+    long referencesNumber;
+    int pagesNumber;
+    int pageSize;
+    int framesNumber;  // Number of frames of the shell that recorded the trace
+};
+
+// Open addressing table of the pages of the trace (script id and page number)
+struct pagesTable {
+    unsigned long *keys;  // 0 for an empty slot
+    int *ids;
+    unsigned long size;
+};
+
+/*** FUNCTION SIGNATURES ***/
+
+int readTrace(char *fileName, struct referenceTrace *trace);
+int readVarint(unsigned char **cursor, unsigned char *end, unsigned long *value);
+int pageId(struct pagesTable *table, unsigned long key, int *pagesNumber);
+void distancesLRU(struct referenceTrace *trace, long hits[]);
+void distancesOPT(struct referenceTrace *trace, long hits[]);
+long replayFIFO(struct referenceTrace *trace, int framesNumber);
+long replayCLOCK(struct referenceTrace *trace, int framesNumber);
+
+/**
+ * Reads the trace and prints the faults of every policy for 1 to max frames
+ *
+ * @param argc The number of command-line arguments passed to the program.
+ * @param argv An array of pointers to the command-line arguments.
+ * @return Returns an integer status code, 0 for success
+ */
+int main(int argc, char *argv[]) {
+    struct referenceTrace trace;
+    long *hitsLRU, *hitsOPT, faultsLRU, faultsOPT;
+    int maxFrames, framesNumber;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s TRACE [max frames]\n", argv[0]);
+        return 1;
+    }
+    if (readTrace(argv[1], &trace)) {
+        fprintf(stderr, "%s: not a page-reference trace\n", argv[1]);
+        return 1;
+    }
+    // More frames than pages only leave the cold misses
+    maxFrames = argc > 2 ? atoi(argv[2]) : trace.pagesNumber;
+    if (maxFrames < 1 || maxFrames > trace.pagesNumber) {
+        maxFrames = trace.pagesNumber;
+    }
+
+    // hits[d] is the number of references at stack distance d
+    hitsLRU = (long *)calloc(trace.pagesNumber + 1, sizeof(long));
+    hitsOPT = (long *)calloc(trace.pagesNumber + 1, sizeof(long));
+    distancesLRU(&trace, hitsLRU);
+    distancesOPT(&trace, hitsOPT);
+
+    printf("%ld references to %d pages, recorded with %d frames of %d lines (*)\n",
+           trace.referencesNumber, trace.pagesNumber, trace.framesNumber, trace.pageSize);
+    printf("%6s %9s %10s %10s %10s %10s\n", "frames", "framesize", "OPT", "LRU", "FIFO",
+           "CLOCK");
+    faultsLRU = trace.referencesNumber;
+    faultsOPT = trace.referencesNumber;
+    for (framesNumber = 1; framesNumber <= maxFrames; framesNumber++) {
+        // A reference hits with as many frames as its stack distance
+        faultsLRU -= hitsLRU[framesNumber];
+        faultsOPT -= hitsOPT[framesNumber];
+        printf("%5d%c %9d %10ld %10ld %10ld %10ld\n", framesNumber,
+               framesNumber == trace.framesNumber ? '*' : ' ', framesNumber * trace.pageSize,
+               faultsOPT, faultsLRU, replayFIFO(&trace, framesNumber),
+               replayCLOCK(&trace, framesNumber));
+    }
+
+    free(hitsLRU);
+    free(hitsOPT);
+    free(trace.references);
+    return 0;
+}
+
+/*** FUNCTIONS FOR THE TRACE ***/
+
+/**
+ * Reads a page-reference trace (see REFERENCE_TRACE_MAGIC) in memory
+ *
+ * @param fileName The name of the trace.
+ * @param trace Set to the references of the trace.
+ * @return 0 on success, non-zero if the file can't be read or is malformed
+ */
+int readTrace(char *fileName, struct referenceTrace *trace) {
+    struct pagesTable table;
+    unsigned char *data, *cursor, *end;
+    unsigned long value, scriptId = 0, pageSize, framesNumber;
+    long dataSize, capacity;
+    FILE *p;
+
+    p = fopen(fileName, "rb");
+    if (p == NULL) {
+        return 1;
+    }
+    fseek(p, 0, SEEK_END);
+    dataSize = ftell(p);
+    rewind(p);
+    data = (unsigned char *)malloc(dataSize + 1);
+    if (fread(data, 1, dataSize, p) != (size_t)dataSize) {
+        dataSize = 0;
+    }
+    fclose(p);
+
+    cursor = data + REFERENCE_TRACE_MAGIC_SIZE;
+    end = data + dataSize;
+    if (dataSize < REFERENCE_TRACE_MAGIC_SIZE ||
+        memcmp(data, REFERENCE_TRACE_MAGIC, REFERENCE_TRACE_MAGIC_SIZE) ||
+        readVarint(&cursor, end, &pageSize) || readVarint(&cursor, end, &framesNumber)) {
+        free(data);
+        return 1;
+    }
+    trace->pageSize = (int)pageSize;
+    trace->framesNumber = (int)framesNumber;
+
+    table.size = PAGES_TABLE_INITIAL_SIZE;
+    table.keys = (unsigned long *)calloc(table.size, sizeof(unsigned long));
+    table.ids = (int *)malloc(table.size * sizeof(int));
+    trace->pagesNumber = 0;
+    trace->referencesNumber = 0;
+    // Every reference takes at least a byte
+    capacity = end - cursor;
+    trace->references = (int *)malloc((capacity + 1) * sizeof(int));
+    while (cursor < end) {
+        if (readVarint(&cursor, end, &value) ||
+            (value & 1 && readVarint(&cursor, end, &scriptId)) || !scriptId) {
+            break;
+        }
+        // The page numbers take the low 32 bits of the keys, which are never 0
+        // since the script ids start at 1
+        trace->references[trace->referencesNumber++] =
+            pageId(&table, scriptId << 32 | value >> 1, &trace->pagesNumber);
+    }
+
+    free(table.keys);
+    free(table.ids);
+    free(data);
+    return cursor < end;
+}
+
+/**
+ * Reads an unsigned integer written as a varint (LEB128)
+ *
+ * @param cursor The position to read at, moved past the varint.
+ * @param end The end of the data.
+ * @param value Set to the integer read.
+ * @return 0 on success, 1 if the varint is truncated
+ */
+int readVarint(unsigned char **cursor, unsigned char *end, unsigned long *value) {
+    int shift = 0;
+
+    *value = 0;
+    while (*cursor < end && shift < 64) {
+        *value |= (unsigned long)(**cursor & 0x7f) << shift;
+        if (!(*(*cursor)++ & 0x80)) {
+            return 0;
+        }
+        shift += 7;
+    }
+    return 1;
+}
+
+/**
+ * Returns the dense id of a page, numbering the pages in the order in which
+ * they are first looked up
+ *
+ * @param table The table of the pages (grown when half full).
+ * @param key The script id and page number of the page (non-zero).
+ * @param pagesNumber The number of pages in the table, increased for a new page.
+ * @return The id of the page
+ */
+int pageId(struct pagesTable *table, unsigned long key, int *pagesNumber) {
+    struct pagesTable grown;
+    unsigned long slot, slotIdx;
+
+    slot = (key * 0x9e3779b97f4a7c15UL) & (table->size - 1);
+    while (table->keys[slot] && table->keys[slot] != key) {
+        slot = (slot + 1) & (table->size - 1);
+    }
+    if (table->keys[slot]) {
+        return table->ids[slot];
+    }
+
+    table->keys[slot] = key;
+    table->ids[slot] = (*pagesNumber)++;
+    if ((unsigned long)*pagesNumber * 2 < table->size) {
+        return table->ids[slot];
+    }
+
+    grown.size = table->size * 2;
+    grown.keys = (unsigned long *)calloc(grown.size, sizeof(unsigned long));
+    grown.ids = (int *)malloc(grown.size * sizeof(int));
+    for (slotIdx = 0; slotIdx < table->size; slotIdx++) {
+        if (!table->keys[slotIdx]) {
+            continue;
+        }
+        slot = (table->keys[slotIdx] * 0x9e3779b97f4a7c15UL) & (grown.size - 1);
+        while (grown.keys[slot]) {
+            slot = (slot + 1) & (grown.size - 1);
+        }
+        grown.keys[slot] = table->keys[slotIdx];
+        grown.ids[slot] = table->ids[slotIdx];
+    }
+    free(table->keys);
+    free(table->ids);
+    *table = grown;
+    return pageId(table, key, pagesNumber);
+}
+
+/*** FUNCTIONS FOR THE POLICIES ***/
+
+/**
+ * Counts the references at every LRU stack distance: the number of distinct
+ * pages referenced since the previous reference of the page, itself included.
+ * A Fenwick tree over the references marks the last reference of every page
+ * so that a distance is the number of marks after the previous reference
+ * (O(log n) per reference).
+ *
+ * @param trace The references to replay.
+ * @param hits Incremented at the distance of every reference that isn't the
+ * first one of its page.
+ * @return void
+ */
+void distancesLRU(struct referenceTrace *trace, long hits[]) {
+    long *lastReference, *marks, referenceIdx, idx, distance;
+    int page;
+
+    lastReference = (long *)malloc(trace->pagesNumber * sizeof(long));
+    for (page = 0; page < trace->pagesNumber; page++) {
+        lastReference[page] = -1;
+    }
+    // marks[idx - 1] holds the sum of the marks of a range ending at idx - 1
+    marks = (long *)calloc(trace->referencesNumber + 1, sizeof(long));
+
+    for (referenceIdx = 0; referenceIdx < trace->referencesNumber; referenceIdx++) {
+        page = trace->references[referenceIdx];
+        if (lastReference[page] >= 0) {
+            // Marks after the previous reference: prefix(now) - prefix(previous)
+            distance = 1;
+            for (idx = referenceIdx; idx > 0; idx -= idx & -idx) {
+                distance += marks[idx - 1];
+            }
+            for (idx = lastReference[page] + 1; idx > 0; idx -= idx & -idx) {
+                distance -= marks[idx - 1];
+            }
+            hits[distance]++;
+            for (idx = lastReference[page] + 1; idx <= trace->referencesNumber;
+                 idx += idx & -idx) {
+                marks[idx - 1]--;
+            }
+        }
+        for (idx = referenceIdx + 1; idx <= trace->referencesNumber; idx += idx & -idx) {
+            marks[idx - 1]++;
+        }
+        lastReference[page] = referenceIdx;
+    }
+
+    free(lastReference);
+    free(marks);
+}
+
+/**
+ * Counts the references at every OPT stack distance. OPT keeps the pages
+ * referenced again the soonest, so the stack is ordered by priority (Mattson
+ * et al.): the referenced page goes on top and every page it passes over is
+ * pushed down only if the page carried down is referenced again sooner.
+ *
+ * @param trace The references to replay.
+ * @param hits Incremented at the distance of every reference that isn't the
+ * first one of its page.
+ * @return void
+ */
+void distancesOPT(struct referenceTrace *trace, long hits[]) {
+    long *nextUse, *pageNextUse, referenceIdx;
+    int *stack, stackSize = 0, depth, page, carried, passed;
+
+    // Next reference of the page of every reference
+    nextUse = (long *)malloc(trace->referencesNumber * sizeof(long));
+    pageNextUse = (long *)malloc(trace->pagesNumber * sizeof(long));
+    for (page = 0; page < trace->pagesNumber; page++) {
+        pageNextUse[page] = NEVER_USED_AGAIN;
+    }
+    for (referenceIdx = trace->referencesNumber - 1; referenceIdx >= 0; referenceIdx--) {
+        page = trace->references[referenceIdx];
+        nextUse[referenceIdx] = pageNextUse[page];
+        pageNextUse[page] = referenceIdx;
+    }
+
+    stack = (int *)malloc(trace->pagesNumber * sizeof(int));
+    for (referenceIdx = 0; referenceIdx < trace->referencesNumber; referenceIdx++) {
+        page = trace->references[referenceIdx];
+        pageNextUse[page] = nextUse[referenceIdx];
+        if (!stackSize) {
+            stack[stackSize++] = page;
+            continue;
+        }
+        carried = stack[0];
+        stack[0] = page;
+        for (depth = 1; carried != page && depth < stackSize; depth++) {
+            passed = stack[depth];
+            if (passed == page) {
+                stack[depth] = carried;
+                carried = page;
+                continue;
+            }
+            // The page referenced again the latest goes further down
+            if (pageNextUse[carried] != NEVER_USED_AGAIN &&
+                (pageNextUse[passed] == NEVER_USED_AGAIN ||
+                 pageNextUse[passed] > pageNextUse[carried])) {
+                stack[depth] = carried;
+                carried = passed;
+            }
+        }
+        // The loop stops right past the page referenced (if it was in the stack)
+        if (carried == page) {
+            hits[depth]++;
+        } else {
+            stack[stackSize++] = carried;
+        }
+    }
+
+    free(nextUse);
+    free(pageNextUse);
+    free(stack);
+}
+
+/**
+ * Replays the references with FIFO replacement: the page loaded first is
+ * replaced
+ *
+ * @param trace The references to replay.
+ * @param framesNumber The number of frames.
+ * @return The number of page faults
+ */
+long replayFIFO(struct referenceTrace *trace, int framesNumber) {
+    int *frames, *isResident, page, nextVictim = 0, framesUsed = 0;
+    long referenceIdx, faults = 0;
+
+    frames = (int *)malloc(framesNumber * sizeof(int));
+    isResident = (int *)calloc(trace->pagesNumber, sizeof(int));
+    for (referenceIdx = 0; referenceIdx < trace->referencesNumber; referenceIdx++) {
+        page = trace->references[referenceIdx];
+        if (isResident[page]) {
+            continue;
+        }
+        faults++;
+        if (framesUsed < framesNumber) {
+            frames[framesUsed++] = page;
+        } else {
+            isResident[frames[nextVictim]] = 0;
+            frames[nextVictim] = page;
+            nextVictim = (nextVictim + 1) % framesNumber;
+        }
+        isResident[page] = 1;
+    }
+
+    free(frames);
+    free(isResident);
+    return faults;
+}
+
+/**
+ * Replays the references with CLOCK replacement: the hand clears the
+ * reference bits of the frames it passes over and replaces the first page
+ * that wasn't referenced since the previous revolution
+ *
+ * @param trace The references to replay.
+ * @param framesNumber The number of frames.
+ * @return The number of page faults
+ */
+long replayCLOCK(struct referenceTrace *trace, int framesNumber) {
+    int *frames, *isReferenced, *pageFrame, page, hand = 0, framesUsed = 0;
+    long referenceIdx, faults = 0;
+
+    frames = (int *)malloc(framesNumber * sizeof(int));
+    isReferenced = (int *)malloc(framesNumber * sizeof(int));
+    pageFrame = (int *)malloc(trace->pagesNumber * sizeof(int));
+    for (page = 0; page < trace->pagesNumber; page++) {
+        pageFrame[page] = -1;
+    }
+    for (referenceIdx = 0; referenceIdx < trace->referencesNumber; referenceIdx++) {
+        page = trace->references[referenceIdx];
+        if (pageFrame[page] >= 0) {
+            isReferenced[pageFrame[page]] = 1;
+            continue;
+        }
+        faults++;
+        if (framesUsed < framesNumber) {
+            hand = framesUsed++;
+        } else {
+            while (isReferenced[hand]) {
+                isReferenced[hand] = 0;
+                hand = (hand + 1) % framesNumber;
+            }
+            pageFrame[frames[hand]] = -1;
+        }
+        frames[hand] = page;
+        isReferenced[hand] = 1;
+        pageFrame[page] = hand;
+        hand = (hand + 1) % framesNumber;
+    }
+
+    free(frames);
+    free(isReferenced);
+    free(pageFrame);
+    return faults;
+}
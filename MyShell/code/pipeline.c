@@ -0,0 +1,347 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "interpreter.h"
+#include "output.h"
+#include "pipeline.h"
+#include "spawner.h"
+
+struct pipelineStage {
+    char **args;
+    int argsNumber;
+    int isExternal;
+    struct outputBuffer *capture;  // Captured output of a builtin
+    pid_t pid;                     // Pid of an external command
+    int feedFd;  // Write end of the pipe feeding the captured output of the
+                 // previous builtin to the external command (-1 if none)
+};
+
+/*** FUNCTION SIGNATURES ***/
+
+int splitStages(char *args[], int argsNumber, struct pipelineStage stages[],
+                char **redirectFile);
+int launchStage(struct pipelineStage stages[], int stageIdx, int stagesNumber,
+                int *inputFd, int redirectFd);
+void runBuiltinStage(struct pipelineStage *stage, int isCaptured);
+void feedPipe(int fd, struct outputBuffer *buffer);
+int writeAll(int fd, const char *data, size_t length);
+int openNull();
+
+/*** FUNCTIONS FOR PIPELINES ***/
+
+/**
+ * Predicate determining whether a command is a pipeline
+ *
+ * @param args the tokens of the command
+ * @param argsNumber the number of tokens
+ * @return 1 if one of the tokens is "|" or ">", 0 otherwise
+ */
+int isPipeline(char *args[], int argsNumber) {
+    int argIdx;
+
+    for (argIdx = 0; argIdx < argsNumber; argIdx++) {
+        if (strcmp(args[argIdx], "|") == 0 || strcmp(args[argIdx], ">") == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Function that runs a pipeline until all of its stages are done.
+ * The stages are started from left to right: a builtin runs to completion
+ * with its output captured in memory while an external command is launched
+ * with its stdin and stdout connected to its neighbours. Once every command
+ * is launched, the output captured from the builtins is handed to the
+ * commands reading it (vmsplice moves the pages of the buffer into the pipe
+ * instead of copying them) and the commands are waited for.
+ * With "> FILE", the file is the stdout of a last external command and the
+ * output of a last builtin is written into it with a single large write.
+ *
+ * @param args the tokens of the command
+ * @param argsNumber the number of tokens
+ * @return 0 if the pipeline ran, non-zero if it is malformed or one of its
+ * commands or its file couldn't be opened
+ */
+int runPipeline(char *args[], int argsNumber) {
+    struct pipelineStage stages[argsNumber];
+    char *redirectFile;
+    int stagesNumber, stageIdx, inputFd = -1, redirectFd = -1, errorCode = 0;
+    struct pipelineStage *last;
+
+    stagesNumber = splitStages(args, argsNumber, stages, &redirectFile);
+    if (stagesNumber <= 0) {
+        return 1;
+    }
+    last = &stages[stagesNumber - 1];
+
+    if (redirectFile) {
+        redirectFd = open(redirectFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (redirectFd < 0) {
+            return 1;
+        }
+    }
+
+    // Children that exited since the last command are reaped in one go and
+    // what the shell printed so far must come before the commands' output
+    reapChildren(0);
+    fflush(stdout);
+
+    for (stageIdx = 0; stageIdx < stagesNumber && !errorCode; stageIdx++) {
+        if (stages[stageIdx].isExternal) {
+            errorCode = launchStage(stages, stageIdx, stagesNumber, &inputFd, redirectFd);
+        } else {
+            // The last builtin writes to the output of the shell directly
+            runBuiltinStage(&stages[stageIdx], stageIdx < stagesNumber - 1 || redirectFd >= 0);
+        }
+    }
+    if (inputFd >= 0) {
+        close(inputFd);  // A stage failed to launch before reading it
+    }
+
+    for (stageIdx = 0; stageIdx < stagesNumber; stageIdx++) {
+        if (stages[stageIdx].feedFd >= 0) {
+            feedPipe(stages[stageIdx].feedFd, stages[stageIdx - 1].capture);
+            close(stages[stageIdx].feedFd);
+        }
+    }
+    for (stageIdx = 0; stageIdx < stagesNumber; stageIdx++) {
+        if (stages[stageIdx].pid > 0) {
+            waitProcess(stages[stageIdx].pid);
+        }
+    }
+
+    if (redirectFd >= 0) {
+        if (!last->isExternal && !errorCode) {
+            errorCode = writeAll(redirectFd, last->capture->data, last->capture->length);
+        }
+        close(redirectFd);
+    }
+
+    // The buffers fed with vmsplice can only be reused once their commands exited
+    for (stageIdx = 0; stageIdx < stagesNumber; stageIdx++) {
+        if (stages[stageIdx].capture) {
+            outputDestroyCapture(stages[stageIdx].capture);
+        }
+    }
+
+    return errorCode;
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * Function that splits the tokens of a pipeline into its stages. A "> FILE"
+ * redirection is only allowed at the end of the pipeline.
+ *
+ * @param args the tokens of the command
+ * @param argsNumber the number of tokens
+ * @param stages the array to fill (at least argsNumber elements)
+ * @param redirectFile set to the name of the file to redirect to or NULL
+ * @return the number of stages or -1 if the pipeline is malformed
+ */
+int splitStages(char *args[], int argsNumber, struct pipelineStage stages[],
+                char **redirectFile) {
+    int argIdx, stagesNumber = 0, stageStart = 0, stageEnd;
+
+    *redirectFile = NULL;
+    if (argsNumber >= 2 && strcmp(args[argsNumber - 2], ">") == 0) {
+        *redirectFile = args[argsNumber - 1];
+        argsNumber -= 2;
+    }
+
+    for (argIdx = 0; argIdx <= argsNumber; argIdx++) {
+        if (argIdx < argsNumber && strcmp(args[argIdx], ">") == 0) {
+            return -1;  // Redirection in the middle of the pipeline
+        }
+        if (argIdx < argsNumber && strcmp(args[argIdx], "|") != 0) {
+            continue;
+        }
+
+        stageEnd = argIdx;
+        if (stageEnd == stageStart) {
+            return -1;  // Empty stage
+        }
+        stages[stagesNumber].isExternal = strcmp(args[stageStart], "spawn") == 0;
+        // The "spawn" of the external commands isn't part of their arguments
+        stages[stagesNumber].args = args + stageStart + stages[stagesNumber].isExternal;
+        stages[stagesNumber].argsNumber =
+            stageEnd - stageStart - stages[stagesNumber].isExternal;
+        if (stages[stagesNumber].argsNumber == 0) {
+            return -1;  // spawn without a command
+        }
+        stages[stagesNumber].capture = NULL;
+        stages[stagesNumber].pid = 0;
+        stages[stagesNumber].feedFd = -1;
+        stagesNumber++;
+        stageStart = argIdx + 1;
+    }
+
+    return stagesNumber;
+}
+
+/**
+ * Function that launches the external command of a stage connected to its
+ * neighbours: its stdin is the pipe of the previous external command, a pipe
+ * fed later with the output of the previous builtin or the shell's stdin for
+ * the first stage. Its stdout is a pipe to the next external command, the
+ * file of the redirection or the shell's stdout for the last stage. An
+ * external command followed by a builtin writes to /dev/null.
+ *
+ * @param stages the stages of the pipeline
+ * @param stageIdx the index of the stage to launch
+ * @param stagesNumber the number of stages
+ * @param inputFd read end of the pipe of the previous external command (-1 if
+ * none), replaced with the read end of this command's pipe
+ * @param redirectFd the file of the redirection or -1 if none
+ * @return 0 if the command was launched, non-zero otherwise
+ */
+int launchStage(struct pipelineStage stages[], int stageIdx, int stagesNumber,
+                int *inputFd, int redirectFd) {
+    struct pipelineStage *stage = &stages[stageIdx];
+    int pipeFds[2], outputFd = -1, nextInputFd = -1;
+
+    if (stageIdx > 0 && !stages[stageIdx - 1].isExternal) {
+        if (pipe2(pipeFds, O_CLOEXEC)) {
+            return 1;
+        }
+        *inputFd = pipeFds[0];
+        stage->feedFd = pipeFds[1];
+    }
+
+    if (stageIdx == stagesNumber - 1) {
+        outputFd = redirectFd;
+    } else if (stages[stageIdx + 1].isExternal) {
+        if (pipe2(pipeFds, O_CLOEXEC)) {
+            return 1;
+        }
+        outputFd = pipeFds[1];
+        nextInputFd = pipeFds[0];
+    } else {
+        outputFd = openNull();
+    }
+
+    stage->pid = spawnProcess(stage->args, stage->argsNumber, *inputFd, outputFd);
+
+    // The ends given to the command are closed so that its neighbours see the
+    // end of the pipes once it exits
+    if (*inputFd >= 0) {
+        close(*inputFd);
+    }
+    if (outputFd >= 0 && outputFd != redirectFd) {
+        close(outputFd);
+    }
+    *inputFd = nextInputFd;
+
+    return stage->pid < 0;
+}
+
+/**
+ * Function that runs the builtin of a stage
+ *
+ * @param stage the stage to run
+ * @param isCaptured whether to capture its output for the next stage or the
+ * redirection instead of writing it to the output of the shell
+ * @return void
+ */
+void runBuiltinStage(struct pipelineStage *stage, int isCaptured) {
+    struct outputBuffer *previousOutput;
+
+    if (!isCaptured) {
+        interpreter(stage->args, stage->argsNumber);
+        return;
+    }
+
+    stage->capture = outputCreateCapture();
+    previousOutput = outputSwitchTo(stage->capture);
+    interpreter(stage->args, stage->argsNumber);
+    outputSwitchTo(previousOutput);
+}
+
+/**
+ * Function that writes a captured output into the pipe of an external
+ * command. The pages of the buffer are spliced into the pipe without copying
+ * when the kernel allows it (the buffer must then stay untouched until the
+ * command exited). The command may exit without reading everything in which
+ * case the SIGPIPE raised is discarded instead of killing the shell.
+ *
+ * @param fd the write end of the pipe
+ * @param buffer the output to write
+ * @return void
+ */
+void feedPipe(int fd, struct outputBuffer *buffer) {
+    struct timespec noWait = {0, 0};
+    sigset_t pipeSignal, previousMask;
+    struct iovec vector;
+    ssize_t written;
+
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, &previousMask);
+
+    vector.iov_base = buffer->data;
+    vector.iov_len = buffer->length;
+    while (vector.iov_len > 0) {
+        written = vmsplice(fd, &vector, 1, 0);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0 && errno != EPIPE) {
+            // vmsplice isn't supported for this pipe, copy instead
+            writeAll(fd, vector.iov_base, vector.iov_len);
+            break;
+        }
+        if (written < 0) {
+            break;
+        }
+        vector.iov_base = (char *)vector.iov_base + written;
+        vector.iov_len -= written;
+    }
+
+    // Discard the SIGPIPE that may be pending before unblocking it
+    while (sigtimedwait(&pipeSignal, NULL, &noWait) == SIGPIPE);
+    pthread_sigmask(SIG_SETMASK, &previousMask, NULL);
+}
+
+/**
+ * Function that writes a whole buffer into a file descriptor, retrying after
+ * partial writes
+ *
+ * @param fd the file descriptor to write into
+ * @param data the bytes to write
+ * @param length the number of bytes to write
+ * @return 0 on success, non-zero if the write failed
+ */
+int writeAll(int fd, const char *data, size_t length) {
+    ssize_t written;
+
+    while (length > 0) {
+        written = write(fd, data, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0) {
+            return 1;
+        }
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+/**
+ * Function that opens /dev/null for writing
+ * @param void
+ * @return the file descriptor or -1 if it couldn't be opened
+ */
+int openNull() {
+    return open("/dev/null", O_WRONLY | O_CLOEXEC);
+}
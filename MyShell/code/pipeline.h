@@ -0,0 +1,12 @@
+#include <sys/types.h>
+
+// A pipeline is a command whose tokens contain "|" or "> FILE", for instance
+//   my_ls | spawn grep txt > found.txt
+// Every stage is either a builtin or an external command (spawn CMD ARGS).
+// The output of the builtins is captured in memory (no temporary file) and
+// the external commands are connected to each other by pipes.
+// Note that the builtins don't read their input: what is piped into a
+// builtin is discarded like in "CMD | echo X" in a regular shell.
+
+int isPipeline(char *args[], int argsNumber);
+int runPipeline(char *args[], int argsNumber);
@@ -0,0 +1,90 @@
+#include <stdlib.h>
+
+#include "output.h"
+#include "pool.h"
+
+/*** FUNCTIONS FOR THE POOLS ***/
+
+/**
+ * Function that initializes an empty pool
+ *
+ * @param pool the pool to initialize
+ * @param name the name of the objects (used in the statistics)
+ * @param objectSize the size of the objects
+ * @return void
+ */
+void poolInit(struct pool *pool, const char *name, size_t objectSize) {
+    pool->name = name;
+    // The free list is linked through the objects so they must hold a pointer
+    pool->objectSize = objectSize < sizeof(void *) ? sizeof(void *) : objectSize;
+    pool->objectSize = (pool->objectSize + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    pool->freeObjects = NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->allocations = 0;
+    pool->slabs = 0;
+    pool->inUse = 0;
+    pool->peakInUse = 0;
+}
+
+/**
+ * Function that hands out an object of a pool. A new slab is allocated when
+ * none of the objects is free.
+ *
+ * @param pool the pool
+ * @return the object (uninitialized)
+ */
+void *poolAlloc(struct pool *pool) {
+    char *slab;
+    void *object;
+    int objectIdx;
+
+    pthread_mutex_lock(&pool->lock);
+    if (!pool->freeObjects) {
+        // The slab is never given back, its objects go back to the free list
+        slab = (char *)malloc(POOL_SLAB_OBJECTS * pool->objectSize);
+        for (objectIdx = POOL_SLAB_OBJECTS - 1; objectIdx >= 0; objectIdx--) {
+            *(void **)(slab + objectIdx * pool->objectSize) = pool->freeObjects;
+            pool->freeObjects = slab + objectIdx * pool->objectSize;
+        }
+        pool->slabs++;
+    }
+    object = pool->freeObjects;
+    pool->freeObjects = *(void **)object;
+    pool->allocations++;
+    pool->inUse++;
+    if (pool->inUse > pool->peakInUse) {
+        pool->peakInUse = pool->inUse;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return object;
+}
+
+/**
+ * Function that gives an object back to its pool
+ *
+ * @param pool the pool
+ * @param object the object handed out by poolAlloc
+ * @return void
+ */
+void poolFree(struct pool *pool, void *object) {
+    pthread_mutex_lock(&pool->lock);
+    *(void **)object = pool->freeObjects;
+    pool->freeObjects = object;
+    pool->inUse--;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Function that prints the allocation counters of a pool
+ *
+ * @param pool the pool
+ * @return void
+ */
+void poolPrintStats(struct pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    shellPrintf("%s: %lu allocations, %lu malloc calls, %lu in use (peak %lu)\n",
+                pool->name, pool->allocations, pool->slabs, pool->inUse,
+                pool->peakInUse);
+    pthread_mutex_unlock(&pool->lock);
+}
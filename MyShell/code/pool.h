@@ -0,0 +1,27 @@
+#include <pthread.h>
+#include <stddef.h>
+
+// Number of objects of a pool allocated at once
+#ifndef POOL_SLAB_OBJECTS
+#define POOL_SLAB_OBJECTS 64
+#endif
+
+// Pool of objects of the same size carved out of slabs. Released objects are
+// kept in a free list and handed out again so that the objects created and
+// destroyed all the time (PCBs, scripts) only call malloc once per slab.
+struct pool {
+    const char *name;
+    size_t objectSize;
+    void *freeObjects;  // Free list linked through the objects themselves
+    pthread_mutex_t lock;
+    // Allocation counters (guarded by the lock)
+    unsigned long allocations;
+    unsigned long slabs;  // Number of calls to malloc
+    unsigned long inUse;
+    unsigned long peakInUse;
+};
+
+void poolInit(struct pool *pool, const char *name, size_t objectSize);
+void *poolAlloc(struct pool *pool);
+void poolFree(struct pool *pool, void *object);
+void poolPrintStats(struct pool *pool);
@@ -1,65 +1,165 @@
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "coroutine.h"
+#include "output.h"
+#include "pool.h"
 #include "scheduler.h"
+#include "scriptscache.h"
 #include "scriptsmemory.h"
 #include "shell.h"
 #include "shellmemory.h"
+#include "spawner.h"
+#include "trace.h"
 
 struct PCBQueue {
     struct PCB *head;
     struct PCB *tail;
-} readyQueue;
+    pthread_mutex_t lock;
+    int isJobQueue;  // Whether it holds the processes of a job (worker threads)
+    // Load control (make loadcontrol=1): processes taken out of the queue
+    // while it thrashes (in the order of their suspension) and time slices of
+    // the current window
+    struct PCB *suspendedHead;
+    struct PCB *suspendedTail;
+    int windowSlices;
+    int windowRefaults;
+    int isThrashing;
+};
+
+// Metrics of the processes of a simulated schedule (see simulateSchedules),
+// times are in instructions
+struct simulationMetrics {
+    unsigned long processes;
+    unsigned long timeslices;
+    unsigned long totalTurnaround;
+    unsigned long totalWait;
+    unsigned long maxWait;
+};
+
+// Processes run by the main thread. Every background job has a queue of its
+// own that the worker threads schedule with the policy of the job, so the jobs
+// running at the same time don't schedule (or age) each other's processes.
+// Every thread schedules the processes of its queue.
+struct PCBQueue mainQueue;
+__thread struct PCBQueue *readyQueue;
 
 pthread_t workers[WORKERS_NUMBER];
 int isRunningWorkers;
-int isThereWorkToDo;
-int isTimeToExit;
+int isTimeToExit;  // Guarded by jobsLock
 int startExitProcedure;
-int finishedWork;
-
-pthread_cond_t isThereWorkToDoCond;
-pthread_cond_t finishedWorkCond;
-
-pthread_mutex_t readyQueueLock;
-
-pthread_mutex_t isThereWorkToDoLock;
-pthread_mutex_t finishedWorkLock;
-
-policy_t policyGlobal;
+// Worker threads waiting for a job with processes ready (accessed atomically)
+int idleWorkersNumber;
+
+// PCBs are created and terminated for every process so they come from a pool
+struct pool pcbPool;
+
+// Jobs that weren't waited for yet (in the order of their creation)
+struct job *jobsHead;
+struct job *jobsTail;
+int lastJobId;
+
+// Job of the process executing on the running thread (if any)
+__thread struct job *runningJob = NULL;
+
+// Output of the command that started the schedule on the running thread (e.g.
+// the capture of a builtin in a pipeline), used by the processes that don't
+// have their own buffer
+__thread struct outputBuffer *scheduleOutput = NULL;
+
+// Process executing on the running thread, policy of the schedule running it
+// and number of nested schedules (exec executed by a process), used to
+// checkpoint the state of the scheduler
+__thread struct PCB *runningPCB = NULL;
+__thread policy_t runningPolicy = INVALID_POLICY;
+__thread int scheduleDepth = 0;
+
+// Script of the last process dispatched by the thread (only compared, it may
+// have been freed since)
+__thread struct scriptFrames *previousScript = NULL;
+
+// Processes waiting on the thread for the schedule started by their exec to
+// end, the most recent first and linked through next (make coroutines=1)
+__thread struct PCB *waitingPCBs = NULL;
+
+// Metrics of the simulation running on the thread (NULL if none) and its clock,
+// the number of instructions executed since the simulated schedule started
+__thread struct simulationMetrics *simulation = NULL;
+__thread unsigned long simulationClock;
+
+// Processes suspended and readmitted by the load control (accessed atomically)
+unsigned long suspensionsNumber;
+unsigned long readmissionsNumber;
+
+// Mutex lock and condition used whenever the jobs are accessed or a job is
+// done (as well as when a worker thread asks the main thread to exit)
+pthread_mutex_t jobsLock;
+pthread_cond_t jobsCond;
 
 /*** FUNCTION SIGNATURES ***/
 
 void insertPCBFromTailSJF(struct PCB *pcb);
 void detachPCBFromQueue(struct PCB *p1);
 struct PCB *popHeadFromPCBQueue();
+struct PCB *popNextPCB(policy_t policy);
 void placePCBAtEndOfDLL(struct PCB *p1);
+void placePCBFromTailSJF(struct PCB *pcb);
+void signalWorkAvailable();
+void beginTimeslice(struct PCB *pcb);
+void endTimeslice(struct PCB *pcb);
+struct job *submitJob(policy_t policy);
+struct job *findReadyJob();
+void endJobProcess(struct job *job);
+void waitForJob(struct job *job);
+void reapJob(struct job *job);
+int initialPagesNumber(struct scriptFrames *scriptInfo);
+int executeInstruction(struct PCB *pcb, int virtualAddress);
+void countTimeslice();
+int suspendIfThrashing(struct PCB *pcb);
+void readmitSuspendedPCB();
+void runSchedule();
+timesliceEnd_t runTimeslice(struct PCB *pcb, policy_t policy);
+timesliceEnd_t dispatchPCB(struct PCB *pcb, policy_t policy);
+void finishTimeslice(struct PCB *pcb, policy_t policy, timesliceEnd_t timesliceEnd);
+void runProcessCoroutine(void *pcb);
+int snapshotRunningIndex(struct processSnapshot snapshot[], int readyNumber);
+void ageReadyQueue();
+int isOutscored(struct PCB *pcb);
 
 /**
- * This function intializes the ready queue and associated required resources.
+ * This function intializes the ready queues and associated required resources.
  * @param void
  * @return void
  */
 void scheduler_init() {
-    // Initialize readyQueue
-    readyQueue.head = NULL;
-    readyQueue.tail = NULL;
+    // Initialize the ready queues, the main thread schedules the main one
+    mainQueue.head = NULL;
+    mainQueue.tail = NULL;
+    mainQueue.suspendedHead = NULL;
+    mainQueue.suspendedTail = NULL;
+    mainQueue.windowSlices = mainQueue.windowRefaults = mainQueue.isThrashing = 0;
+    mainQueue.isJobQueue = 0;
+    readyQueue = &mainQueue;
 
     // Initialize global variables
     isRunningWorkers = 0;
-    policyGlobal = INVALID_POLICY;
     isTimeToExit = 0;
-    isThereWorkToDo = 0;
     startExitProcedure = 0;
-    finishedWork = 0;
+    idleWorkersNumber = 0;
+    jobsHead = NULL;
+    jobsTail = NULL;
+    lastJobId = 0;
+    suspensionsNumber = 0;
+    readmissionsNumber = 0;
 
     // Initialize concurrency variables
-    pthread_mutex_init(&readyQueueLock, NULL);
-    pthread_mutex_init(&isThereWorkToDoLock, NULL);
-    pthread_cond_init(&isThereWorkToDoCond, NULL);
-    pthread_mutex_init(&finishedWorkLock, NULL);
-    pthread_cond_init(&finishedWorkCond, NULL);
+    pthread_mutex_init(&mainQueue.lock, NULL);
+    pthread_mutex_init(&jobsLock, NULL);
+    pthread_cond_init(&jobsCond, NULL);
+    poolInit(&pcbPool, "PCBs", sizeof(struct PCB));
 }
 
 /**
@@ -71,8 +171,35 @@ void scheduler_init() {
  * @return void This function does not return a value.
  */
 void terminateProcess(struct PCB *pcb) {
-    pcb->scriptInfo->PCBsInUse--;
-    free(pcb);
+    unsigned long wait;
+
+    traceEmit(TRACE_TERMINATE, pcb->pid, 0, 0, pcb);
+    // Every simulated process arrives at 0 and runs for one unit of time per
+    // instruction
+    if (simulation) {
+        wait = simulationClock - pcb->scriptInfo->lengthCode;
+        simulation->processes++;
+        simulation->totalTurnaround += simulationClock;
+        simulation->totalWait += wait;
+        if (wait > simulation->maxWait) {
+            simulation->maxWait = wait;
+        }
+    }
+    // The script cache decides whether to keep the information of the script
+    // if no frames or PCBs are using it anymore
+    scriptsCacheRelease(pcb->scriptInfo);
+    if (pcb->output) {
+        outputProcessEnd(pcb->output);
+    }
+    if (pcb->job) {
+        endJobProcess(pcb->job);
+    }
+#ifdef COROUTINE_SCHEDULING
+    if (pcb->coroutine) {
+        coroutineDestroy(pcb->coroutine);
+    }
+#endif
+    poolFree(&pcbPool, pcb);
 }
 
 /**
@@ -82,90 +209,100 @@ void terminateProcess(struct PCB *pcb) {
  * @return Returns a non-null integer for an error and 0 otherwise
  */
 int mem_load_script(char script[], policy_t policy) {
-    char line[MAX_USER_INPUT];
-    int scriptLength = 0, line_idx, mem_idx, pageIdx;
-    FILE *p;
+    int pageIdx, pagesToLoad;
+    struct scriptFrames *scriptInfo;
 
     // A null script signals that the stdin (background execution)
     // is to be loaded
     if (!script) {
-        p = stdin;
+        // The stdin is streamed so only its first page is read for now
+        scriptInfo = createStreamScript();
+        pagesToLoad = 1;
     } else {
-        p = fopen(script, "rt");  // the program is in a file
+        // Scripts that were run before don't need to be read again
+        // even if none of their pages are still in memory
+        scriptInfo = scriptsCacheLookup(script);
+        if (!scriptInfo) {
+            scriptInfo = scriptsCacheLoad(script);
+        }
     }
 
     // Make sure the given File is valid
-    if (p == NULL) {
+    if (scriptInfo == NULL) {
         return -1;
     }
-
-    // Count the number of lines in the script
-    while (1) {
-        fgets(line, MAX_USER_INPUT - 1, p);
-        scriptLength++;
-
-        if (feof(p)) {
-            break;
-        }
-    }
-    fclose(p);
-
-    // Initialize the page table and related information
-    struct scriptFrames *scriptInfo = (struct scriptFrames *)malloc(sizeof(struct scriptFrames));
-    scriptInfo->scriptName = strdup(script);
-    scriptInfo->lengthCode = scriptLength;
-    scriptInfo->PCBsInUse = 0;
-    scriptInfo->FramesInUse = 0;
-    for (pageIdx = 0; pageIdx < PAGE_TABLE_SIZE; pageIdx++) {
-        scriptInfo->pageTable[pageIdx] = -1;
+    if (script) {
+        pagesToLoad = initialPagesNumber(scriptInfo);
     }
 
     // Assign the first few pages of the script to frames
-    for (pageIdx = 0; pageIdx < PAGES_LOADED_NUMBER && pageIdx < scriptLength/PAGE_SIZE+1; pageIdx++) {
-        pageAssignment(pageIdx, scriptInfo, 1);
+    for (pageIdx = 0; pageIdx < pagesToLoad; pageIdx++) {
+        if (scriptInfo->pageTable[pageIdx] < 0) {
+            pageAssignment(pageIdx, scriptInfo, 1);
+        }
     }
 
     createPCB(policy, scriptInfo);
+    // The PCB now holds its own reference to the script
+    scriptsCacheRelease(scriptInfo);
 
     return 0;
 }
 
 /**
- * Creates a new PCB for a process and inserts it into the ready queue.
+ * Creates a new PCB for a process and inserts it into the ready queue of the
+ * running thread. The caller must hold a reference to the script.
  *
  * @param policy The scheduling policy to be used.
  * @param scriptInfo The struct containing the page table associated with a
  * script
- * @return void
+ * @return The new PCB
  */
-void createPCB(policy_t policy, struct scriptFrames *scriptInfo) {
+struct PCB *createPCB(policy_t policy, struct scriptFrames *scriptInfo) {
     struct PCB *newPCB;
-    int pageIdx;
 
     // Initialize new PCB for new process being created
-    newPCB = (struct PCB *)malloc(sizeof(struct PCB));
+    newPCB = (struct PCB *)poolAlloc(&pcbPool);
     newPCB->pid = rand();
-    newPCB->lengthScore = scriptInfo->lengthCode;
+    // The length of a stream is unknown so the lines read so far are used
+    newPCB->lengthScore = scriptInfo->isStream
+                              ? scriptInfo->streamPagesRead * PAGE_SIZE
+                              : scriptInfo->lengthCode;
     newPCB->virtualAddress = 0;
+    newPCB->bypassed = 0;
+    newPCB->faultedPage = -1;
+    newPCB->timesliceLeft = 0;
+    newPCB->coroutine = NULL;
     newPCB->scriptInfo = scriptInfo;
-    newPCB->scriptInfo->PCBsInUse++;
+    __atomic_add_fetch(&scriptInfo->references, 1, __ATOMIC_RELAXED);
+    // Processes created by the worker threads (e.g. by a script executing
+    // exec) write in their own buffer since they will run on a worker
+    // (simulated processes never write)
+    newPCB->output = isMainThread(pthread_self()) || simulation ? NULL : outputCreateBuffer();
+    // Processes created by a process of a job belong to the same job
+    newPCB->job = runningJob;
+    if (newPCB->job) {
+        pthread_mutex_lock(&jobsLock);
+        newPCB->job->processesRemaining++;
+        pthread_mutex_unlock(&jobsLock);
+    }
     // Initialize readyQueue related fields
     newPCB->next = NULL;
     newPCB->prev = NULL;
 
     // Insert into the PCB readyQueue differently depending on policy
-    pthread_mutex_lock(&readyQueueLock);
+    traceLock(&readyQueue->lock, "readyQueue");
     // The INVALID_POLICY is used to load the main shell program
     // (when # is used) at the start of the ready queue
     if (policy == INVALID_POLICY) {
-        if (readyQueue.head) {
-            readyQueue.head->prev = newPCB;
-            newPCB->next = readyQueue.head;
+        if (readyQueue->head) {
+            readyQueue->head->prev = newPCB;
+            newPCB->next = readyQueue->head;
         }
-        readyQueue.head = newPCB;
-        if (!readyQueue.tail) {
-            readyQueue.tail = readyQueue.head;
-            readyQueue.tail->next = NULL;
+        readyQueue->head = newPCB;
+        if (!readyQueue->tail) {
+            readyQueue->tail = readyQueue->head;
+            readyQueue->tail->next = NULL;
         }
         // For the SJF and AGING policy, the PCB is inserted
         // by comparing the "lengthScore" so that the PCB
@@ -175,156 +312,163 @@ void createPCB(policy_t policy, struct scriptFrames *scriptInfo) {
         // In all the other cases (RR, FCFS), the PCB is inserted
         // at the end of the queue
     } else {
-        if (readyQueue.tail) {
-            readyQueue.tail->next = newPCB;
-            newPCB->prev = readyQueue.tail;
+        if (readyQueue->tail) {
+            readyQueue->tail->next = newPCB;
+            newPCB->prev = readyQueue->tail;
         }
-        readyQueue.tail = newPCB;
-        if (!readyQueue.head) {
-            readyQueue.head = readyQueue.tail;
-            readyQueue.head->prev = NULL;
+        readyQueue->tail = newPCB;
+        if (!readyQueue->head) {
+            readyQueue->head = readyQueue->tail;
+            readyQueue->head->prev = NULL;
         }
     }
-    pthread_mutex_unlock(&readyQueueLock);
+    pthread_mutex_unlock(&readyQueue->lock);
+    signalWorkAvailable();
+
+    return newPCB;
 }
 
 /*** FUNCTIONS FOR EXECUTING THE SCRIPTS ***/
 
 /**
- * This function iterates through the ready queue of Process Control Blocks
- * (PCBs) and executes each PCB one after the other starting at the head (i.e.,
- * head, head->next, ..., tail).
- * This function is used for FCFS, and SJF
+ * This function runs the processes of the ready queue until it is empty. A
+ * time slice ends with the process terminating or going back in the queue
+ * depending on the policy of the schedule (FCFS and SJF only switch processes
+ * on a page fault).
+ * With the coroutine scheduling, the processes that executed exec on the
+ * thread carry on once the queue is empty (the most recent first).
  *
- * @param policy The scheduling policy to determine how to insert preempted PCBs
- * back in the queue
+ * @param void
  * @return void
  */
-void executeReadyQueuePCBs(policy_t policy) {
-    int line_idx;
-    struct PCB *currentPCB;
-    char *instr;
+void runSchedule() {
+    struct PCB *pcb;
+    policy_t policy;
+    timesliceEnd_t timesliceEnd;
+#ifdef COROUTINE_SCHEDULING
+    struct PCB *waitingHead = waitingPCBs;
+#endif
 
-next_timeslice_execute: // Label to jump to when a page fault occurs
-    while ((currentPCB = popHeadFromPCBQueue())) {
-        // Execute all lines of code
-        for (line_idx = currentPCB->virtualAddress;
-             line_idx < currentPCB->scriptInfo->lengthCode;
-             line_idx++, currentPCB->virtualAddress++) {
-            // Attempt to fetch next instruction
-            if (instr = fetchInstructionVirtual(line_idx, currentPCB->scriptInfo)) {
-                convertInputToOneLiners(instr);
-            } else {  // Fix page fault and preempt the process
-                pageAssignment(line_idx / PAGE_SIZE, currentPCB->scriptInfo, 0);
-
-                // Reinsert preempted page faulted PCBs depending on policy
-                if (policy == FCFS) {
-                    placePCBAtEndOfDLL(currentPCB);
-                } else {
-                    insertPCBFromTailSJF(currentPCB);
-                }
-                goto next_timeslice_execute; // Jump to next process
-            }
+    while (1) {
+        // The policy changes when a process starts a schedule and when the
+        // schedule ends
+        policy = runningPolicy;
+        pcb = policy == AGING ? popHeadFromPCBQueue() : popNextPCB(policy);
+        if (pcb) {
+            beginTimeslice(pcb);
+            timesliceEnd = dispatchPCB(pcb, policy);
+#ifdef COROUTINE_SCHEDULING
+        } else if (waitingPCBs != waitingHead) {
+            // The process restores the state of its own schedule (see
+            // selectSchedule) and finishes its time slice
+            pcb = waitingPCBs;
+            waitingPCBs = pcb->next;
+            coroutineResume(pcb->coroutine);
+            timesliceEnd = pcb->timesliceEnd;
+            policy = runningPolicy;
+#endif
+        } else {
+            break;
         }
-        terminateProcess(currentPCB);
+        finishTimeslice(pcb, policy, timesliceEnd);
     }
 }
 
 /**
- * Executes the Round Robin (RR) scheduling policy. This function implements the
- * Round Robin (RR) scheduling algorithm for a set of processes based on the
- * specified line number.
+ * This function executes the instructions of a process until its time slice
+ * ends: when the process terminates for FCFS and SJF, after 2 and 30
+ * instructions for RR and RR30 and for AGING, after the instruction that
+ * leaves the process with a higher score than the head of the aged queue. A
+ * page fault ends the time slice right away. A process restored from a
+ * checkpoint first finishes the time slice it was in.
  *
- * @param lineNumber The number of line to execute before switching processes.
- * @return void
+ * @param pcb the process
+ * @param policy the policy of the schedule running the process
+ * @return how the time slice ended
  */
-void runRR(int lineNumber) {
-    struct PCB *currentPCB;
-    int line_idx, programCounterTmp;
-    char *instr;
-
-next_timeslice_RR: // Label to jump to when a page fault occurs
-    while ((currentPCB = popHeadFromPCBQueue())) {
-        // Execute lineNumber lines of code
-        programCounterTmp = currentPCB->virtualAddress;
-        for (line_idx = currentPCB->virtualAddress;
-             line_idx < currentPCB->scriptInfo->lengthCode &&
-             line_idx < programCounterTmp + lineNumber;
-             line_idx++, currentPCB->virtualAddress++) {
-            // Attempt to fetch next instruction
-            if (instr = fetchInstructionVirtual(line_idx, currentPCB->scriptInfo)) {
-                convertInputToOneLiners(instr);
-            } else {  // Fix page fault and preempt the process
-                pageAssignment(line_idx / PAGE_SIZE, currentPCB->scriptInfo, 0);
-                placePCBAtEndOfDLL(currentPCB);
-                goto next_timeslice_RR; // Jump to next process
+timesliceEnd_t runTimeslice(struct PCB *pcb, policy_t policy) {
+    // The end of the time slice is kept in the PCB for the checkpoints
+    pcb->quantumEnd = pcb->virtualAddress +
+                      (pcb->timesliceLeft ? pcb->timesliceLeft : (policy == RR30 ? 30 : 2));
+    pcb->timesliceLeft = 0;
+
+    if (policy == AGING) {
+        while (1) {
+            if (!executeInstruction(pcb, pcb->virtualAddress)) {
+                return TIMESLICE_FAULTED;
+            }
+            pcb->virtualAddress++;
+            ageReadyQueue();
+            if (pcb->virtualAddress == pcb->scriptInfo->lengthCode) {
+                return TIMESLICE_TERMINATED;
+            }
+            if (isOutscored(pcb)) {
+                return TIMESLICE_PREEMPTED;
             }
         }
-        // Check if process has finished running
-        if (currentPCB->virtualAddress == currentPCB->scriptInfo->lengthCode) {
-            terminateProcess(currentPCB);
-        } else {
-            placePCBAtEndOfDLL(currentPCB);
+    }
+
+    for (; pcb->virtualAddress < pcb->scriptInfo->lengthCode; pcb->virtualAddress++) {
+        if ((policy == RR || policy == RR30) && pcb->virtualAddress >= pcb->quantumEnd) {
+            return TIMESLICE_PREEMPTED;
+        }
+        if (!executeInstruction(pcb, pcb->virtualAddress)) {
+            return TIMESLICE_FAULTED;
         }
     }
+    return TIMESLICE_TERMINATED;
 }
 
 /**
- *Executes the Aging scheduling policy.This function implements the Aging
- *scheduling algorithm for the process in the readyQueue
- * @param void
- * @return void
+ * This function runs a time slice of a process, on the stack of the process
+ * with the coroutine scheduling (except for simulated processes, they never
+ * execute exec)
+ *
+ * @param pcb the process (dispatched)
+ * @param policy the policy of the schedule running the process
+ * @return how the time slice ended
  */
-void runAging() {
-    struct PCB *currentPCB, *tmp, *smallest, *currentHead;
-    int line_idx, programCounterTmp, needToSwitch = 0;
-    char *instr;
-
-    currentPCB = popHeadFromPCBQueue();
-    while (currentPCB) {
-        // Time slice
-        // Attempt to fetch next instruction
-        if (instr = fetchInstructionVirtual(currentPCB->virtualAddress, currentPCB->scriptInfo)) {
-            convertInputToOneLiners(instr);
-        } else {  // Fix page fault and preempt the process
-            pageAssignment(currentPCB->virtualAddress / PAGE_SIZE,
-                           currentPCB->scriptInfo, 0);
-            insertPCBFromTailSJF(currentPCB);
-            currentPCB = popHeadFromPCBQueue();
-            continue;
-        }
-        currentPCB->virtualAddress++;
+timesliceEnd_t dispatchPCB(struct PCB *pcb, policy_t policy) {
+#ifdef COROUTINE_SCHEDULING
+    // The time slice runs on the thread's stack if the process couldn't get
+    // its own
+    if (!simulation &&
+        (pcb->coroutine || (pcb->coroutine = coroutineCreate(runProcessCoroutine, pcb)))) {
+        coroutineResume(pcb->coroutine);
+        return pcb->timesliceEnd;
+    }
+#endif
+    return runTimeslice(pcb, policy);
+}
 
-        // Aging all processes
-        pthread_mutex_lock(&readyQueueLock);
-        tmp = readyQueue.head;
-        while (tmp) {
-            // Make sure that the length score is not null
-            if (tmp->lengthScore) {
-                tmp->lengthScore--;
-            }
-            tmp = tmp->next;
-        }
-        pthread_mutex_unlock(&readyQueueLock);
-
-        // Check if process has stopped running
-        if (currentPCB->virtualAddress == currentPCB->scriptInfo->lengthCode) {
-            terminateProcess(currentPCB);
-            currentPCB = popHeadFromPCBQueue();
-        } else {  // Preempt the head if it has a bigger score than other
-                  // processes
-            pthread_mutex_lock(&readyQueueLock);
-            if (readyQueue.head &&
-                readyQueue.head->lengthScore < currentPCB->lengthScore) {
-                insertPCBFromTailSJF(currentPCB);
-                needToSwitch = 1;
-            }
-            pthread_mutex_unlock(&readyQueueLock);
-            if (needToSwitch) {
-                currentPCB = popHeadFromPCBQueue();
-                needToSwitch = 0;
-            }
-        }
+/**
+ * This function terminates a process or puts it back in the ready queue at the
+ * end of its time slice unless it waits (after a page fault, FCFS and RR put
+ * the process at the end of the queue while SJF and AGING put it back
+ * according to its score)
+ *
+ * @param pcb the process
+ * @param policy the policy of the schedule running the process
+ * @param timesliceEnd how the time slice ended
+ * @return void
+ */
+void finishTimeslice(struct PCB *pcb, policy_t policy, timesliceEnd_t timesliceEnd) {
+    // A waiting process is resumed by the schedule (see runSchedule)
+    if (timesliceEnd == TIMESLICE_WAITING) {
+        return;
+    }
+    if (timesliceEnd == TIMESLICE_TERMINATED) {
+        terminateProcess(pcb);
+        return;
+    }
+    endTimeslice(pcb);
+    if (timesliceEnd == TIMESLICE_FAULTED && suspendIfThrashing(pcb)) {
+        return;
+    }
+    if (policy == SJF || policy == AGING) {
+        placePCBFromTailSJF(pcb);
+    } else {
+        placePCBAtEndOfDLL(pcb);
     }
 }
 
@@ -337,67 +481,83 @@ void runAging() {
  * @return void
  */
 void selectSchedule(policy_t policy) {
-    switch (policy) {
-        // Since the readyQueue for SJF was sorted in schedulerRun beforehand
-        // when inserting, it becomes the same as FCFS
-        case FCFS:
-        case SJF:
-            executeReadyQueuePCBs(policy);
-            break;
-        case RR:
-            runRR(2);
-            break;
-        case RR30:
-            runRR(30);
-            break;
-        case AGING:
-            runAging();
-            break;
+    struct outputBuffer *previousOutput, *previousScheduleOutput = scheduleOutput;
+    struct job *previousJob = runningJob;
+    struct PCB *previousPCB = runningPCB;
+    policy_t previousPolicy = runningPolicy;
+
+    // A process executing exec runs the new processes before carrying on
+    // so its output buffer must be restored afterwards
+    previousOutput = outputSwitchTo(NULL);
+    scheduleOutput = previousOutput;
+    runningPolicy = policy;
+    scheduleDepth++;
+
+#ifdef COROUTINE_SCHEDULING
+    // Rather than running the new processes on top of its stack, the process
+    // waits for the thread to run them
+    if (coroutineRunning() && !simulation) {
+        runningPCB->timesliceEnd = TIMESLICE_WAITING;
+        runningPCB->next = waitingPCBs;
+        waitingPCBs = runningPCB;
+        coroutineYield();
+    } else {
+        runSchedule();
     }
+#else
+    runSchedule();
+#endif
+
+    outputSwitchTo(previousOutput);
+    scheduleOutput = previousScheduleOutput;
+    runningJob = previousJob;
+    runningPCB = previousPCB;
+    runningPolicy = previousPolicy;
+    scheduleDepth--;
 }
 
 /**
  * The main function for the worker thread. This function runs in a loop,
- * waiting for work to be available via condition variables. When work is
- * signaled, it selects the scheduling policy to manage process execution. The
- * loop continues until a termination signal is received.
+ * waiting for a job with processes ready to run. Whenever there is one, it
+ * schedules the queue of the job with the policy of the job until the queue
+ * is empty (other workers may be scheduling the same job). The loop continues
+ * until a termination signal is received and there are no processes left.
  * @param args A pointer to the arguments passed to the worker thread.
  * @return void
  */
 void *workerThread(void *args) {
-    int startWorkerExitProcedure = 0;
-    policy_t workerPolicy;
+    struct job *job;
 
+    (void)args;
+    pthread_mutex_lock(&jobsLock);
     while (1) {
-        // Wait for workToDo or termination signal
-        pthread_mutex_lock(&isThereWorkToDoLock);
-        while (!isTimeToExit && !isThereWorkToDo) {
-            pthread_cond_wait(&isThereWorkToDoCond, &isThereWorkToDoLock);
+        // Wait for work to do or termination signal. The threads queueing
+        // processes only signal if a worker is idle (see signalWorkAvailable)
+        __atomic_add_fetch(&idleWorkersNumber, 1, __ATOMIC_SEQ_CST);
+        while (!(job = findReadyJob()) && !isTimeToExit) {
+            pthread_cond_wait(&jobsCond, &jobsLock);
         }
+        __atomic_sub_fetch(&idleWorkersNumber, 1, __ATOMIC_SEQ_CST);
 
-        // Work to do case
-        if (isThereWorkToDo) {
-            isThereWorkToDo--;
-            workerPolicy = policyGlobal;
-        }
-        // Termination case
-        if (isTimeToExit) {
-            startWorkerExitProcedure = 1;
-        }
-        pthread_mutex_unlock(&isThereWorkToDoLock);
-
-        // Exit procedure and thread termination
-        // in the case where the main thread signaled for termination
-        if (startWorkerExitProcedure) {
+        // Exit procedure and thread termination in the case where the main
+        // thread signaled for termination and all the work is done
+        if (!job) {
+            pthread_mutex_unlock(&jobsLock);
             pthread_exit(NULL);
         }
-        selectSchedule(workerPolicy);
-
-        // Signal the main thread that worker finished working
-        pthread_mutex_lock(&finishedWorkLock);
-        finishedWork++;
-        pthread_cond_signal(&finishedWorkCond);
-        pthread_mutex_unlock(&finishedWorkLock);
+        // The job can't be done (and freed) while its queue is scheduled
+        job->schedulersNumber++;
+        pthread_mutex_unlock(&jobsLock);
+
+        readyQueue = job->readyQueue;
+        selectSchedule(job->policy);
+
+        pthread_mutex_lock(&jobsLock);
+        job->schedulersNumber--;
+        if (!job->processesRemaining && !job->schedulersNumber) {
+            job->isDone = 1;
+            pthread_cond_broadcast(&jobsCond);
+        }
     }
 }
 
@@ -407,6 +567,9 @@ void *workerThread(void *args) {
  * according to the provided policy. It manages the cases where the exec
  * is run in the background (#) and the use of concurrent threads (MT),
  * adjusting the scheduling behavior accordingly.
+ * With MT, the processes become a job run by the worker threads and the
+ * function returns right away unless the main shell was loaded in the job
+ * (#) in which case the stdin belongs to the job until it is done.
  *
  * @param policy A value of type 'policy_t' representing the scheduling policy
  * to be applied.
@@ -418,8 +581,7 @@ void *workerThread(void *args) {
  */
 void schedulerRun(policy_t policy, int isRunningBackground,
                   int isRunningConcurrently) {
-    struct PCB *currentPCB, *smallest, *currentHead;
-    int line_idx, programCounterTmp, startMainExitProcedure = 0;
+    struct job *job;
 
     // For the concurrency case, start the threads if they weren't
     // already running
@@ -432,47 +594,443 @@ void schedulerRun(policy_t policy, int isRunningBackground,
 
     // Concurrency enabled case
     if (isRunningConcurrently) {
-        // Signal the threads to start working
-        // according to the policyGlobal
-        pthread_mutex_lock(&isThereWorkToDoLock);
-        policyGlobal = policy;
-        isThereWorkToDo = 2;
-        pthread_cond_broadcast(&isThereWorkToDoCond);
-        pthread_mutex_unlock(&isThereWorkToDoLock);
+        // Processes created by a worker thread already are in the workers
+        // queue and belong to the job of the process that created them
+        if (!isMainThread(pthread_self())) {
+            return;
+        }
+
+        job = submitJob(policy);
+        if (!job) {
+            return;
+        }
+        if (isRunningBackground) {
+            waitForJob(job);
+            exitIfRequested();
+        } else if (isatty(fileno(stdin))) {
+            shellPrintf("[%d]\n", job->id);
+        }
+    } else {
+        selectSchedule(policy);
+    }
+}
+
+/**
+ * Runs a dry run of every policy on copies of the given scripts and prints the
+ * metrics of each schedule. The processes are scheduled by the policy code on
+ * a ready queue of their own, but their instructions are no-ops taking one unit
+ * of time (see executeInstruction): nothing is executed nor paged in. Every
+ * process arrives at 0, its wait is its turnaround minus its length.
+ *
+ * @param scripts The scripts to simulate (the caller holds a reference).
+ * @param scriptsNumber The number of scripts.
+ * @param copies The number of processes created for every script.
+ * @return void
+ */
+void simulateSchedules(struct scriptFrames *scripts[], int scriptsNumber, int copies) {
+    static const char *policyNames[] = {"FCFS", "SJF", "RR", "RR30", "AGING"};
+    struct PCBQueue simulationQueue, *previousQueue = readyQueue;
+    struct job *previousJob = runningJob;
+    struct simulationMetrics metrics;
+    struct timespec start, end;
+    int policy, copyIdx, scriptIdx;
+    double elapsed;
+
+    shellPrintf("%-6s %10s %10s %15s %12s %12s %14s\n", "POLICY", "PROCESSES", "SLICES",
+                "AVG TURNAROUND", "AVG WAIT", "MAX WAIT", "SLICES/S");
+    for (policy = FCFS; policy < INVALID_POLICY; policy++) {
+        memset(&simulationQueue, 0, sizeof(struct PCBQueue));
+        pthread_mutex_init(&simulationQueue.lock, NULL);
+        memset(&metrics, 0, sizeof(struct simulationMetrics));
+        // The simulated processes belong to no job and don't mix with the
+        // processes of the schedule running the command (if any)
+        readyQueue = &simulationQueue;
+        runningJob = NULL;
+        simulation = &metrics;
+        simulationClock = 0;
+        for (copyIdx = 0; copyIdx < copies; copyIdx++) {
+            for (scriptIdx = 0; scriptIdx < scriptsNumber; scriptIdx++) {
+                createPCB(policy, scripts[scriptIdx]);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        selectSchedule(policy);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        simulation = NULL;
+        runningJob = previousJob;
+        readyQueue = previousQueue;
+        pthread_mutex_destroy(&simulationQueue.lock);
+
+        elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        shellPrintf("%-6s %10lu %10lu %15.1f %12.1f %12lu %14.0f\n", policyNames[policy],
+                    metrics.processes, metrics.timeslices,
+                    (double)metrics.totalTurnaround / metrics.processes,
+                    (double)metrics.totalWait / metrics.processes, metrics.maxWait,
+                    elapsed > 0 ? metrics.timeslices / elapsed : 0.0);
+    }
+}
+
+/**
+ * Prints the counters of the coroutine scheduling and of the load control
+ * (make coroutines=1 and loadcontrol=1).
+ * @param void
+ * @return void
+ */
+void schedulerPrintStats() {
+#ifdef COROUTINE_SCHEDULING
+    coroutinePrintStats();
+#endif
+#ifdef LOAD_CONTROL
+    shellPrintf("Load control: %lu suspensions, %lu readmissions\n",
+                __atomic_load_n(&suspensionsNumber, __ATOMIC_RELAXED),
+                __atomic_load_n(&readmissionsNumber, __ATOMIC_RELAXED));
+#endif
+}
+
+/*** FUNCTIONS FOR THE JOBS ***/
+
+/**
+ * Lists the jobs that weren't waited for. The jobs that are done stay listed
+ * until they are waited for.
+ * @param void
+ * @return void
+ */
+void listJobs() {
+    struct job *job;
 
-        // Wait for the worker threads to finish
-        pthread_mutex_lock(&finishedWorkLock);
-        while (!startExitProcedure && finishedWork < 2) {
-            pthread_cond_wait(&finishedWorkCond, &finishedWorkLock);
+    pthread_mutex_lock(&jobsLock);
+    for (job = jobsHead; job; job = job->next) {
+        if (job->isDone) {
+            shellPrintf("[%d] Done\n", job->id);
+        } else {
+            shellPrintf("[%d] Running (%d processes left)\n", job->id,
+                        job->processesRemaining);
         }
+    }
+    pthread_mutex_unlock(&jobsLock);
+}
 
-        // Reset finishedWork variable if applicable
-        // for the next time the workers are running
-        if (finishedWork >= 2) {
-            finishedWork = 0;
+/**
+ * Waits for a job to be done and forgets it
+ *
+ * @param jobId The id of the job to wait for.
+ * @return Returns 0 once the job is done or non-zero if there is no such job
+ */
+int waitJob(int jobId) {
+    struct job *job;
+
+    pthread_mutex_lock(&jobsLock);
+    for (job = jobsHead; job && job->id != jobId; job = job->next);
+    pthread_mutex_unlock(&jobsLock);
+    if (!job) {
+        return 1;
+    }
+
+    waitForJob(job);
+    exitIfRequested();
+    pthread_mutex_lock(&jobsLock);
+    reapJob(job);
+    pthread_mutex_unlock(&jobsLock);
+
+    return 0;
+}
+
+/**
+ * Waits for all the jobs to be done and forgets them
+ * @param void
+ * @return void
+ */
+void waitAllJobs() {
+    int jobId;
+
+    while (1) {
+        pthread_mutex_lock(&jobsLock);
+        jobId = jobsHead ? jobsHead->id : 0;
+        pthread_mutex_unlock(&jobsLock);
+        if (!jobId) {
+            return;
         }
+        waitJob(jobId);
+    }
+}
+
+/**
+ * Exits the shell if a worker thread executed the quit command. All the
+ * processes left are run to completion before exiting.
+ * @param void
+ * @return void
+ */
+void exitIfRequested() {
+    int isExiting;
+
+    pthread_mutex_lock(&jobsLock);
+    isExiting = startExitProcedure;
+    pthread_mutex_unlock(&jobsLock);
+
+    if (isExiting) {
+        joinAllThreads();
+        reapChildren(1);
+        outputFlushAll();
+        mem_sync_file();
+        exit(0);
+    }
+}
+
+/*** FUNCTIONS FOR THE CHECKPOINTS ***/
 
-        // Check if a 'quit' command was called from a
-        // worker thread
-        if (startExitProcedure) {
-            startMainExitProcedure = 1;
+/**
+ * Saves the state of the processes of the running schedule in the order in
+ * which they will execute: the ready queue and then the suspended processes.
+ * The process executing the checkpoint resumes at its next line, in the place
+ * the end of its instruction puts it: first, unless its RR time slice is over
+ * or, for AGING, the queue aged after its instruction outscores it. Only the
+ * main thread outside of a nested exec can be checkpointed, and neither
+ * background jobs nor processes reading the stdin (#) can be resumed by
+ * another shell.
+ *
+ * @param processes Set to an allocated array of the processes (to be freed).
+ * @param processesNumber Set to the number of processes.
+ * @param policy Set to the policy of the running schedule (INVALID_POLICY if
+ * no schedule is running).
+ * @return Returns 0 on success or non-zero if the state can't be checkpointed
+ */
+int schedulerSnapshot(struct processSnapshot **processes, int *processesNumber,
+                      policy_t *policy) {
+    struct processSnapshot *snapshot;
+    struct PCB *pcb, *queued[2];
+    struct job *job;
+    int processIdx = 0, listIdx, readyNumber = 0, runningIdx, isJobRunning = 0;
+
+    if (!isMainThread(pthread_self()) || scheduleDepth > 1) {
+        return 1;
+    }
+    pthread_mutex_lock(&jobsLock);
+    for (job = jobsHead; job; job = job->next) {
+        isJobRunning |= !job->isDone;
+    }
+    pthread_mutex_unlock(&jobsLock);
+    if (isJobRunning) {
+        return 1;
+    }
+
+    // The running process isn't in the ready queue while it executes
+    // The suspended processes are resumed last
+    traceLock(&mainQueue.lock, "readyQueue");
+    queued[0] = mainQueue.head;
+    queued[1] = mainQueue.suspendedHead;
+    for (listIdx = 0; listIdx < 2; listIdx++) {
+        for (pcb = queued[listIdx]; pcb; pcb = pcb->next) {
+            processIdx++;
+        }
+    }
+    snapshot = (struct processSnapshot *)malloc((processIdx + 1) * sizeof(struct processSnapshot));
+    processIdx = 0;
+    for (listIdx = 0; listIdx < 2; listIdx++) {
+        for (pcb = queued[listIdx]; pcb; pcb = pcb->next) {
+            snapshot[processIdx].pid = pcb->pid;
+            snapshot[processIdx].lengthScore = pcb->lengthScore;
+            snapshot[processIdx].virtualAddress = pcb->virtualAddress;
+            snapshot[processIdx].timesliceLeft = 0;
+            snapshot[processIdx].scriptInfo = pcb->scriptInfo;
+            // The ready queue ages once the instruction executing the
+            // checkpoint is done (AGING)
+            if (listIdx == 0 && scheduleDepth && runningPolicy == AGING &&
+                snapshot[processIdx].lengthScore) {
+                snapshot[processIdx].lengthScore--;
+            }
+            processIdx++;
+        }
+        if (listIdx == 0) {
+            readyNumber = processIdx;
         }
-        pthread_mutex_unlock(&finishedWorkLock);
+    }
+    pthread_mutex_unlock(&mainQueue.lock);
+
+    if (scheduleDepth && runningPCB->virtualAddress + 1 < runningPCB->scriptInfo->lengthCode) {
+        runningIdx = snapshotRunningIndex(snapshot, readyNumber);
+        memmove(&snapshot[runningIdx + 1], &snapshot[runningIdx],
+                (processIdx - runningIdx) * sizeof(struct processSnapshot));
+        snapshot[runningIdx].pid = runningPCB->pid;
+        snapshot[runningIdx].lengthScore = runningPCB->lengthScore;
+        snapshot[runningIdx].virtualAddress = runningPCB->virtualAddress + 1;
+        snapshot[runningIdx].timesliceLeft =
+            runningIdx == 0 && (runningPolicy == RR || runningPolicy == RR30)
+                ? runningPCB->quantumEnd - snapshot[runningIdx].virtualAddress
+                : 0;
+        snapshot[runningIdx].scriptInfo = runningPCB->scriptInfo;
+        processIdx++;
+    }
 
-        if (startMainExitProcedure) {
-            joinAllThreads();
-            exit(0);
+    for (*processesNumber = 0; *processesNumber < processIdx; (*processesNumber)++) {
+        if (snapshot[*processesNumber].scriptInfo->isStream) {
+            free(snapshot);
+            return 1;
         }
-    } else {
-        selectSchedule(policy);
+    }
+    *processes = snapshot;
+    *policy = scheduleDepth ? runningPolicy : INVALID_POLICY;
+
+    return 0;
+}
+
+/**
+ * Recreates the processes saved by schedulerSnapshot at the end of the ready
+ * queue of the main thread, in the same order. The process that executed the
+ * checkpoint finishes the time slice it was in.
+ *
+ * @param processes The processes to recreate (their scripts must be loaded).
+ * @param processesNumber The number of processes.
+ * @return void
+ */
+void schedulerRestore(struct processSnapshot processes[], int processesNumber) {
+    struct PCB *pcb;
+    int processIdx;
+
+    for (processIdx = 0; processIdx < processesNumber; processIdx++) {
+        // Appending keeps the saved order whatever the policy
+        pcb = createPCB(FCFS, processes[processIdx].scriptInfo);
+        pcb->pid = processes[processIdx].pid;
+        pcb->lengthScore = processes[processIdx].lengthScore;
+        pcb->virtualAddress = processes[processIdx].virtualAddress;
+        pcb->timesliceLeft = processes[processIdx].timesliceLeft;
     }
 }
 
 /*** HELPER FUNCTIONS */
 
+/**
+ * Function that runs the time slices of a process on its own stack, the
+ * coroutine yields at the end of every time slice until the process terminates
+ *
+ * @param pcb the process
+ * @return void
+ */
+void runProcessCoroutine(void *pcb) {
+    struct PCB *process = (struct PCB *)pcb;
+
+    // The policy is read again since the coroutine may be resumed by another
+    // thread
+    while ((process->timesliceEnd = runTimeslice(process, runningPolicy)) !=
+           TIMESLICE_TERMINATED) {
+        coroutineYield();
+    }
+}
+
+/**
+ * Function that finds where the process executing a checkpoint goes among the
+ * processes saved from the ready queue: first if its time slice carries on,
+ * after the ready queue if its RR time slice is over and by score like
+ * placePCBFromTailSJF if the aged queue outscores it (AGING)
+ *
+ * @param snapshot the processes saved from the ready queue, in order
+ * @param readyNumber the number of processes saved from the ready queue
+ * @return the index of the process executing the checkpoint
+ */
+int snapshotRunningIndex(struct processSnapshot snapshot[], int readyNumber) {
+    int runningIdx = 0;
+
+    if ((runningPolicy == RR || runningPolicy == RR30) &&
+        runningPCB->virtualAddress + 1 >= runningPCB->quantumEnd) {
+        runningIdx = readyNumber;
+    } else if (runningPolicy == AGING && readyNumber &&
+               snapshot[0].lengthScore < runningPCB->lengthScore) {
+        runningIdx = readyNumber;
+        while (runningIdx > 0 && snapshot[runningIdx - 1].lengthScore > runningPCB->lengthScore) {
+            runningIdx--;
+        }
+    }
+
+    return runningIdx;
+}
+
+/**
+ * Function that ages the processes of the ready queue (AGING), their length
+ * score goes down by one without going below 0
+ *
+ * @param void
+ * @return void
+ */
+void ageReadyQueue() {
+    struct PCB *pcb;
+
+    traceLock(&readyQueue->lock, "readyQueue");
+    for (pcb = readyQueue->head; pcb; pcb = pcb->next) {
+        if (pcb->lengthScore) {
+            pcb->lengthScore--;
+        }
+    }
+    pthread_mutex_unlock(&readyQueue->lock);
+}
+
+/**
+ * Function that checks whether the head of the ready queue has a lower score
+ * than a process, which is then preempted (AGING)
+ *
+ * @param pcb the running process
+ * @return 1 if the head has a lower score, 0 otherwise
+ */
+int isOutscored(struct PCB *pcb) {
+    int isHeadLower;
+
+    traceLock(&readyQueue->lock, "readyQueue");
+    isHeadLower = readyQueue->head && readyQueue->head->lengthScore < pcb->lengthScore;
+    pthread_mutex_unlock(&readyQueue->lock);
+
+    return isHeadLower;
+}
+
+/**
+ * Function that decides how many pages of a script are loaded before its
+ * process starts. By default the first PAGES_LOADED_NUMBER pages are loaded.
+ * With ADAPTIVE_PAGE_LOAD, the number depends on the length of the script, the
+ * cold frames (see countColdFrames) and the processes already sharing the
+ * script. A script is never given fewer pages than by default unless it is
+ * shorter.
+ *
+ * @param scriptInfo the script of the new process (referenced by the caller)
+ * @return the number of pages to load
+ */
+int initialPagesNumber(struct scriptFrames *scriptInfo) {
+    int pagesNumber;
+#ifdef ADAPTIVE_PAGE_LOAD
+    int sharingProcesses, coldPagesShare;
+
+    // A script doesn't need a frame for the page after its last line
+    pagesNumber = (scriptInfo->lengthCode + PAGE_SIZE - 1) / PAGE_SIZE;
+    // The references left once the frames and the caller are removed are the
+    // processes running the script
+    sharingProcesses = __atomic_load_n(&scriptInfo->references, __ATOMIC_RELAXED) -
+                       __atomic_load_n(&scriptInfo->FramesInUse, __ATOMIC_RELAXED) - 1;
+    if (sharingProcesses < 0) {
+        sharingProcesses = 0;
+    }
+    // Pages beyond the first PAGES_LOADED_NUMBER are only loaded in cold frames
+    coldPagesShare = countColdFrames() * (sharingProcesses + 1) / ADMISSION_FRAMES_SHARE;
+    if (coldPagesShare < PAGES_LOADED_NUMBER) {
+        coldPagesShare = PAGES_LOADED_NUMBER;
+    }
+    if (pagesNumber > coldPagesShare) {
+        pagesNumber = coldPagesShare;
+    }
+#else
+    pagesNumber = PAGES_LOADED_NUMBER;
+    if (pagesNumber > scriptInfo->lengthCode / PAGE_SIZE + 1) {
+        pagesNumber = scriptInfo->lengthCode / PAGE_SIZE + 1;
+    }
+#endif
+    if (pagesNumber > PAGE_TABLE_SIZE) {
+        pagesNumber = PAGE_TABLE_SIZE;
+    }
+
+    return pagesNumber;
+}
+
 /**
  * Waits for all running worker threads to finish execution. This function sets
- * a termination flag and signals the worker threads to exit. It then calls
+ * a termination flag and signals the worker threads to exit once they ran all
+ * the processes left. It then calls
  * 'pthread_join' for each thread, ensuring the main thread waits for their
  * completion before proceeding.
  * @param void
@@ -480,11 +1038,12 @@ void schedulerRun(policy_t policy, int isRunningBackground,
  */
 void joinAllThreads() {
     if (isRunningWorkers) {
-        // Signal worker threads to terminate
-        pthread_mutex_lock(&isThereWorkToDoLock);
+        // Signal worker threads to terminate once the queues of the jobs are
+        // empty
+        pthread_mutex_lock(&jobsLock);
         isTimeToExit = 1;
-        pthread_cond_broadcast(&isThereWorkToDoCond);
-        pthread_mutex_unlock(&isThereWorkToDoLock);
+        pthread_cond_broadcast(&jobsCond);
+        pthread_mutex_unlock(&jobsLock);
 
         // Join all threads
         for (int i = 0; i < WORKERS_NUMBER; i++) {
@@ -522,18 +1081,18 @@ void insertPCBFromTailSJF(struct PCB *pcb) {
     int wasInserted = 0;
 
     // Case where the readyQueue is empty
-    if (readyQueue.tail == NULL) {
-        readyQueue.tail = pcb;
-        readyQueue.tail->next = NULL;
-        readyQueue.tail->prev = NULL;
-        readyQueue.head = readyQueue.tail;
+    if (readyQueue->tail == NULL) {
+        readyQueue->tail = pcb;
+        readyQueue->tail->next = NULL;
+        readyQueue->tail->prev = NULL;
+        readyQueue->head = readyQueue->tail;
         wasInserted = 1;
     }
 
     if (!wasInserted) {
         // Otherwise, we iterate/propagate backwards until we find a pcb
         // with a lengthScore higher than the pcb to insert
-        currentPCB = readyQueue.tail;
+        currentPCB = readyQueue->tail;
         while (currentPCB) {
             if (pcb->lengthScore >= currentPCB->lengthScore) {
                 pcb->prev = currentPCB;
@@ -543,8 +1102,8 @@ void insertPCBFromTailSJF(struct PCB *pcb) {
                 }
                 currentPCB->next = pcb;
 
-                if (currentPCB == readyQueue.tail) {
-                    readyQueue.tail = pcb;
+                if (currentPCB == readyQueue->tail) {
+                    readyQueue->tail = pcb;
                 }
                 wasInserted = 1;
                 break;
@@ -556,10 +1115,10 @@ void insertPCBFromTailSJF(struct PCB *pcb) {
     // If the pcb wasn't inserted, that means that it has the smallest
     // lengthscore and should be the new head
     if (!wasInserted) {
-        pcb->next = readyQueue.head;
+        pcb->next = readyQueue->head;
         pcb->prev = NULL;
-        readyQueue.head->prev = pcb;
-        readyQueue.head = pcb;
+        readyQueue->head->prev = pcb;
+        readyQueue->head = pcb;
     }
 }
 
@@ -572,21 +1131,21 @@ void insertPCBFromTailSJF(struct PCB *pcb) {
  */
 void detachPCBFromQueue(struct PCB *pcb) {
     // Case where pcb is at the head
-    if (readyQueue.head == pcb) {
-        readyQueue.head = readyQueue.head->next;
+    if (readyQueue->head == pcb) {
+        readyQueue->head = readyQueue->head->next;
         // Check if there are any PCBs left in the queue
-        if (readyQueue.head) {
-            readyQueue.head->prev = NULL;
+        if (readyQueue->head) {
+            readyQueue->head->prev = NULL;
         } else {
             // If not then update the tail
-            readyQueue.tail = NULL;
+            readyQueue->tail = NULL;
         }
         // Case where pcb is at the tail
-    } else if (readyQueue.tail == pcb) {
-        readyQueue.tail = readyQueue.tail->prev;
+    } else if (readyQueue->tail == pcb) {
+        readyQueue->tail = readyQueue->tail->prev;
 
-        if (readyQueue.tail) {
-            readyQueue.tail->next = NULL;
+        if (readyQueue->tail) {
+            readyQueue->tail->next = NULL;
         }
         // Generic case where pcb is in the middle of the queue
     } else {
@@ -601,7 +1160,7 @@ void detachPCBFromQueue(struct PCB *pcb) {
 
 /**
  * This function retrieves and removes the first PCB from the PCB queue.
- * If the queue is empty, it returns NULL.
+ * If the queue is empty, a suspended process is readmitted first (if any).
  * 
  * @param void
  * @return A pointer to the PCB that was removed from the head of the queue,
@@ -610,18 +1169,83 @@ void detachPCBFromQueue(struct PCB *pcb) {
 struct PCB *popHeadFromPCBQueue() {
     struct PCB *rv;
 
-    pthread_mutex_lock(&readyQueueLock);
-    if (readyQueue.head) {
-        rv = readyQueue.head;
-        detachPCBFromQueue(readyQueue.head);
+    traceLock(&readyQueue->lock, "readyQueue");
+    // The schedule only ends once the suspended processes are done too
+    if (!readyQueue->head && readyQueue->suspendedHead) {
+        readmitSuspendedPCB();
+    }
+    if (readyQueue->head) {
+        rv = readyQueue->head;
+        detachPCBFromQueue(readyQueue->head);
     } else {
         rv = NULL;
     }
-    pthread_mutex_unlock(&readyQueueLock);
+    pthread_mutex_unlock(&readyQueue->lock);
 
     return rv;
 }
 
+/**
+ * Function that removes the next process to run from the ready queue. Without
+ * LOCALITY_SCHEDULING, it is the head of the queue. Otherwise, a process
+ * close to the head can go first if it is likely not to page fault (see
+ * LOCALITY_WINDOW).
+ *
+ * @param policy the policy the queue is ordered by (FCFS, SJF or RR)
+ * @return the next process or NULL if the queue is empty
+ */
+struct PCB *popNextPCB(policy_t policy) {
+#ifdef LOCALITY_SCHEDULING
+    struct PCB *head, *pcb, *chosen = NULL;
+    int scanned;
+
+    traceLock(&readyQueue->lock, "readyQueue");
+    if (!readyQueue->head && readyQueue->suspendedHead) {
+        readmitSuspendedPCB();
+    }
+    head = readyQueue->head;
+    // The head is only passed over if it would page fault (nothing does in a
+    // simulation)
+    if (head && !simulation && head->bypassed < LOCALITY_MAX_BYPASS &&
+        virtualToPhysicalAddress(head->virtualAddress, head->scriptInfo) < 0) {
+        for (pcb = head->next, scanned = 1; pcb && scanned < LOCALITY_WINDOW;
+             pcb = pcb->next, scanned++) {
+            // Shorter processes always go first with SJF
+            if (policy == SJF && pcb->lengthScore != head->lengthScore) {
+                break;
+            }
+            if (virtualToPhysicalAddress(pcb->virtualAddress, pcb->scriptInfo) < 0) {
+                continue;
+            }
+            // The pages of the script that just ran are the most recently used
+            if (pcb->scriptInfo == previousScript) {
+                chosen = pcb;
+                break;
+            }
+            if (!chosen) {
+                chosen = pcb;
+            }
+        }
+    }
+    if (!chosen) {
+        chosen = head;
+    }
+    if (chosen) {
+        for (pcb = head; pcb != chosen; pcb = pcb->next) {
+            pcb->bypassed++;
+        }
+        chosen->bypassed = 0;
+        detachPCBFromQueue(chosen);
+    }
+    pthread_mutex_unlock(&readyQueue->lock);
+
+    return chosen;
+#else
+    (void)policy;
+    return popHeadFromPCBQueue();
+#endif
+}
+
 /**
  * This function takes a pointer to a PCB structure and appends it to the end
  * (tail) of the readyQueue doubly linked list.
@@ -631,19 +1255,372 @@ struct PCB *popHeadFromPCBQueue() {
  * @return void
  */
 void placePCBAtEndOfDLL(struct PCB *pcb) {
-    pthread_mutex_lock(&readyQueueLock);
+    traceLock(&readyQueue->lock, "readyQueue");
     // Check for case where list is empty
-    if (!readyQueue.head) {
-        readyQueue.head = pcb;
-        readyQueue.tail = pcb;
+    if (!readyQueue->head) {
+        readyQueue->head = pcb;
+        readyQueue->tail = pcb;
         pcb->next = NULL;
         pcb->prev = NULL;
         // Update the tail only otherwise
     } else {
-        readyQueue.tail->next = pcb;
-        pcb->prev = readyQueue.tail;
+        readyQueue->tail->next = pcb;
+        pcb->prev = readyQueue->tail;
         pcb->next = NULL;
-        readyQueue.tail = pcb;
+        readyQueue->tail = pcb;
+    }
+    pthread_mutex_unlock(&readyQueue->lock);
+    signalWorkAvailable();
+}
+
+/**
+ * This function inserts a PCB in the readyQueue with respect to its length
+ * score (see insertPCBFromTailSJF).
+ *
+ * @param pcb A pointer to the PCB structure representing the process to be
+ * added to the queue.
+ * @return void
+ */
+void placePCBFromTailSJF(struct PCB *pcb) {
+    traceLock(&readyQueue->lock, "readyQueue");
+    insertPCBFromTailSJF(pcb);
+    pthread_mutex_unlock(&readyQueue->lock);
+    signalWorkAvailable();
+}
+
+/**
+ * This function wakes the idle worker threads up after a process was queued in
+ * the queue of a job, so that they can run it.
+ *
+ * @param void
+ * @return void
+ */
+void signalWorkAvailable() {
+    // An idle worker counts itself before looking at the queues so it either
+    // sees the process or gets signaled
+    if (!readyQueue->isJobQueue || !__atomic_load_n(&idleWorkersNumber, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    pthread_mutex_lock(&jobsLock);
+    pthread_cond_broadcast(&jobsCond);
+    pthread_mutex_unlock(&jobsLock);
+}
+
+/**
+ * This function executes the instruction of a process at a virtual address.
+ * If its page isn't resident, the page is assigned a frame instead. In a
+ * simulation (see simulateSchedules), every instruction is a no-op taking one
+ * unit of time and never page faults.
+ *
+ * @param pcb A pointer to the PCB of the process.
+ * @param virtualAddress The address of the instruction.
+ * @return 1 if the instruction was executed, 0 if it page faulted
+ */
+int executeInstruction(struct PCB *pcb, int virtualAddress) {
+    char *instr;
+
+    if (simulation) {
+        simulationClock++;
+        return 1;
+    }
+    instr = fetchInstructionVirtual(virtualAddress, pcb->scriptInfo);
+    if (!instr) {
+        pageAssignment(virtualAddress / PAGE_SIZE, pcb->scriptInfo, 0);
+        return 0;
+    }
+    convertInputToOneLiners(instr);
+    releaseInstructionVirtual(virtualAddress, pcb->scriptInfo);
+    return 1;
+}
+
+/**
+ * This function prepares the running thread to execute a time slice of a
+ * process, i.e. its output is redirected to the buffer of the process if any
+ * (the output of the schedule otherwise) and the processes it creates belong
+ * to its job.
+ *
+ * @param pcb A pointer to the PCB about to be executed.
+ * @return void
+ */
+void beginTimeslice(struct PCB *pcb) {
+    traceEmit(TRACE_DISPATCH, pcb->pid, pcb->virtualAddress, 0, pcb);
+    outputSwitchTo(pcb->output ? pcb->output : scheduleOutput);
+    runningJob = pcb->job;
+    runningPCB = pcb;
+    previousScript = pcb->scriptInfo;
+    if (simulation) {
+        simulation->timeslices++;
+    }
+#ifdef LOAD_CONTROL
+    countTimeslice();
+#endif
+}
+
+/**
+ * This function is called whenever a process is preempted so that its buffered
+ * output can be written.
+ *
+ * @param pcb A pointer to the PCB that was preempted.
+ * @return void
+ */
+void endTimeslice(struct PCB *pcb) {
+    traceEmit(TRACE_PREEMPT, pcb->pid, pcb->virtualAddress, 0, pcb);
+    if (pcb->output) {
+        outputSliceEnd(pcb->output);
+    }
+}
+
+/**
+ * This function counts a time slice starting in the ready queue of the running
+ * thread. Once THRASH_WINDOW time slices were counted, the share of them that
+ * ended with a refault decides whether the queue thrashes (see
+ * THRASH_REFAULT_PERCENT) or whether a suspended process can be readmitted
+ * (see RELIEF_REFAULT_PERCENT).
+ *
+ * @param void
+ * @return void
+ */
+void countTimeslice() {
+    traceLock(&readyQueue->lock, "readyQueue");
+    if (++readyQueue->windowSlices == THRASH_WINDOW) {
+        if (readyQueue->windowRefaults * 100 >= THRASH_REFAULT_PERCENT * THRASH_WINDOW) {
+            readyQueue->isThrashing = 1;
+        } else if (readyQueue->windowRefaults * 100 < RELIEF_REFAULT_PERCENT * THRASH_WINDOW) {
+            readyQueue->isThrashing = 0;
+            if (readyQueue->suspendedHead) {
+                readmitSuspendedPCB();
+            }
+        }
+        readyQueue->windowSlices = 0;
+        readyQueue->windowRefaults = 0;
+    }
+    pthread_mutex_unlock(&readyQueue->lock);
+}
+
+/**
+ * This function counts the page fault that ended the time slice of a process
+ * (if it is a refault) and suspends the process if its ready queue thrashes,
+ * unless fewer than LOAD_CONTROL_MIN_ACTIVE processes would be left to run.
+ * Without LOAD_CONTROL, processes are never suspended. The frames of the
+ * script of a suspended process are the first ones replaced if no other
+ * process runs it.
+ *
+ * @param pcb A pointer to the PCB that page faulted (not in the ready queue).
+ * @return 1 if the process was suspended, 0 if it must be placed back in the
+ * ready queue
+ */
+int suspendIfThrashing(struct PCB *pcb) {
+#ifdef LOAD_CONTROL
+    struct PCB *readyPCB;
+    int pageNumber, readyProcesses = 0;
+
+    pageNumber = pcb->virtualAddress / PAGE_SIZE;
+    traceLock(&readyQueue->lock, "readyQueue");
+    if (pcb->faultedPage == pageNumber) {
+        readyQueue->windowRefaults++;
+    }
+    pcb->faultedPage = pageNumber;
+    for (readyPCB = readyQueue->head; readyPCB && readyProcesses < LOAD_CONTROL_MIN_ACTIVE;
+         readyPCB = readyPCB->next) {
+        readyProcesses++;
+    }
+    if (!readyQueue->isThrashing || readyProcesses < LOAD_CONTROL_MIN_ACTIVE) {
+        pthread_mutex_unlock(&readyQueue->lock);
+        return 0;
+    }
+    pcb->next = NULL;
+    pcb->prev = readyQueue->suspendedTail;
+    if (readyQueue->suspendedTail) {
+        readyQueue->suspendedTail->next = pcb;
+    } else {
+        readyQueue->suspendedHead = pcb;
+    }
+    readyQueue->suspendedTail = pcb;
+    pthread_mutex_unlock(&readyQueue->lock);
+
+    traceEmit(TRACE_SUSPEND, pcb->pid, pcb->virtualAddress, 0, pcb);
+    __atomic_add_fetch(&suspensionsNumber, 1, __ATOMIC_RELAXED);
+    // The references left once the frames are removed are the processes
+    if (__atomic_load_n(&pcb->scriptInfo->references, __ATOMIC_RELAXED) -
+            __atomic_load_n(&pcb->scriptInfo->FramesInUse, __ATOMIC_RELAXED) == 1) {
+        releaseScriptFrames(pcb->scriptInfo);
+    }
+
+    return 1;
+#else
+    (void)pcb;
+    return 0;
+#endif
+}
+
+/**
+ * This function moves the process suspended first back to the ready queue of
+ * the running thread, with respect to the policy of the running schedule. The
+ * caller holds the lock of the queue.
+ *
+ * @param void
+ * @return void
+ */
+void readmitSuspendedPCB() {
+    struct PCB *pcb;
+
+    pcb = readyQueue->suspendedHead;
+    readyQueue->suspendedHead = pcb->next;
+    if (readyQueue->suspendedHead) {
+        readyQueue->suspendedHead->prev = NULL;
+    } else {
+        readyQueue->suspendedTail = NULL;
+    }
+    pcb->next = NULL;
+    pcb->prev = NULL;
+
+    if (runningPolicy == SJF || runningPolicy == AGING) {
+        insertPCBFromTailSJF(pcb);
+    } else if (readyQueue->tail) {
+        readyQueue->tail->next = pcb;
+        pcb->prev = readyQueue->tail;
+        readyQueue->tail = pcb;
+    } else {
+        readyQueue->head = pcb;
+        readyQueue->tail = pcb;
+    }
+    traceEmit(TRACE_READMIT, pcb->pid, pcb->virtualAddress, 0, pcb);
+    __atomic_add_fetch(&readmissionsNumber, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * This function turns the processes loaded in the ready queue of the main
+ * thread into a job and hands them over to the worker threads. Every process
+ * is given its own output buffer in the order of the queue so that their output
+ * is ordered whatever worker runs them.
+ *
+ * @param policy The scheduling policy of the job.
+ * @return The new job or NULL if there were no processes to run
+ */
+struct job *submitJob(policy_t policy) {
+    struct job *job;
+    struct PCB *pcb;
+
+    if (!mainQueue.head) {
+        return NULL;
+    }
+
+    job = (struct job *)malloc(sizeof(struct job));
+    job->policy = policy;
+    job->processesRemaining = 0;
+    job->schedulersNumber = 0;
+    job->isDone = 0;
+    job->next = NULL;
+    for (pcb = mainQueue.head; pcb; pcb = pcb->next) {
+        pcb->job = job;
+        if (!pcb->output) {
+            pcb->output = outputCreateBuffer();
+        }
+        job->processesRemaining++;
+    }
+
+    // The processes move to the queue of the job in the same order
+    job->readyQueue = (struct PCBQueue *)calloc(1, sizeof(struct PCBQueue));
+    pthread_mutex_init(&job->readyQueue->lock, NULL);
+    job->readyQueue->isJobQueue = 1;
+    traceLock(&mainQueue.lock, "readyQueue");
+    job->readyQueue->head = mainQueue.head;
+    job->readyQueue->tail = mainQueue.tail;
+    mainQueue.head = NULL;
+    mainQueue.tail = NULL;
+    pthread_mutex_unlock(&mainQueue.lock);
+
+    // The workers find the job once it is known
+    pthread_mutex_lock(&jobsLock);
+    job->id = ++lastJobId;
+    if (jobsTail) {
+        jobsTail->next = job;
+    } else {
+        jobsHead = job;
+    }
+    jobsTail = job;
+    pthread_cond_broadcast(&jobsCond);
+    pthread_mutex_unlock(&jobsLock);
+
+    return job;
+}
+
+/**
+ * This function finds the oldest job with processes ready to run (or
+ * suspended). Must be called with the jobsLock held.
+ *
+ * @param void
+ * @return The job or NULL if no job has processes waiting
+ */
+struct job *findReadyJob() {
+    struct job *job;
+    int isReady;
+
+    for (job = jobsHead; job; job = job->next) {
+        if (job->isDone) {
+            continue;
+        }
+        traceLock(&job->readyQueue->lock, "readyQueue");
+        isReady = job->readyQueue->head || job->readyQueue->suspendedHead;
+        pthread_mutex_unlock(&job->readyQueue->lock);
+        if (isReady) {
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * This function is called whenever a process of a job terminates. The threads
+ * waiting for the job are woken up once all its processes terminated.
+ *
+ * @param job A pointer to the job of the process.
+ * @return void
+ */
+void endJobProcess(struct job *job) {
+    pthread_mutex_lock(&jobsLock);
+    job->processesRemaining--;
+    if (!job->processesRemaining && !job->schedulersNumber) {
+        job->isDone = 1;
+        pthread_cond_broadcast(&jobsCond);
+    }
+    pthread_mutex_unlock(&jobsLock);
+}
+
+/**
+ * This function blocks until a job is done or until a worker thread asks the
+ * main thread to exit.
+ *
+ * @param job A pointer to the job to wait for.
+ * @return void
+ */
+void waitForJob(struct job *job) {
+    pthread_mutex_lock(&jobsLock);
+    while (!job->isDone && !startExitProcedure) {
+        pthread_cond_wait(&jobsCond, &jobsLock);
+    }
+    pthread_mutex_unlock(&jobsLock);
+}
+
+/**
+ * This function removes a job that is done from the list of jobs and frees it.
+ * Must be called with the jobsLock held.
+ *
+ * @param job A pointer to the job to forget.
+ * @return void
+ */
+void reapJob(struct job *job) {
+    struct job **link, *previousJob = NULL;
+
+    for (link = &jobsHead; *link != job; link = &(*link)->next) {
+        previousJob = *link;
+    }
+    *link = job->next;
+    if (jobsTail == job) {
+        jobsTail = previousJob;
     }
-    pthread_mutex_unlock(&readyQueueLock);
+    pthread_mutex_destroy(&job->readyQueue->lock);
+    free(job->readyQueue);
+    free(job);
 }
@@ -4,6 +4,41 @@
 #define WORKERS_NUMBER 2
 #define PAGES_LOADED_NUMBER 2
 
+// With the adaptive page load (make adaptiveload=1), the pages loaded when a
+// script starts beyond PAGES_LOADED_NUMBER are taken from the cold frames: a
+// script gets at most a 1/ADMISSION_FRAMES_SHARE share of them, multiplied by
+// the number of processes sharing it
+#define ADMISSION_FRAMES_SHARE 4
+
+// With the locality aware scheduling (make locality=1), FCFS, RR and SJF pick
+// the next process among the first LOCALITY_WINDOW processes of the ready
+// queue (for SJF, among the ones as short as the head): the processes running
+// the script that just ran and then the processes whose next instruction is
+// resident come first. A process is passed over at most LOCALITY_MAX_BYPASS
+// times in a row.
+#define LOCALITY_WINDOW 8
+#define LOCALITY_MAX_BYPASS 4
+
+// With the load control (make loadcontrol=1), a ready queue thrashes once
+// THRASH_REFAULT_PERCENT of its last THRASH_WINDOW time slices ended with a
+// refault: a process faulting again on the page loaded by its previous fault
+// (the page was replaced before the process could get through it). The
+// processes faulting while the queue thrashes are suspended as long as
+// LOAD_CONTROL_MIN_ACTIVE processes stay ready. A suspended process is
+// readmitted after every window with fewer than RELIEF_REFAULT_PERCENT
+// refaults.
+#define THRASH_WINDOW 32
+#define THRASH_REFAULT_PERCENT 25
+#define RELIEF_REFAULT_PERCENT 5
+#define LOAD_CONTROL_MIN_ACTIVE 2
+
+// With the coroutine scheduling (make coroutines=1), the time slices of a
+// process run on its own stack (see coroutine.c) so switching processes only
+// saves and restores a few registers. A process executing exec gives the
+// control back to the schedule of its thread, which carries on with the new
+// processes and resumes the process once its queue is empty: the nesting of
+// exec isn't bounded by the stack of the thread anymore.
+
 typedef enum policy_t {
     FCFS = 0,
     SJF,
@@ -13,23 +48,75 @@ typedef enum policy_t {
     INVALID_POLICY
 } policy_t;
 
+// How the time slice of a process ended
+typedef enum timesliceEnd_t {
+    TIMESLICE_TERMINATED,
+    TIMESLICE_PREEMPTED,
+    TIMESLICE_FAULTED,
+    TIMESLICE_WAITING  // The process waits for the processes of its exec
+} timesliceEnd_t;
+
+struct PCBQueue;
+
+// Processes started by an exec ... MT command run in the background on the
+// worker threads while the shell keeps reading commands
+struct job {
+    int id;
+    policy_t policy;
+    struct PCBQueue *readyQueue;  // Processes of the job (ready or suspended)
+    int processesRemaining;       // Guarded by jobsLock
+    int schedulersNumber;  // Workers scheduling its queue (guarded by jobsLock)
+    int isDone;
+    struct job *next;
+};
+
 struct PCB {
     int pid;
     int lengthScore;
     int virtualAddress;
     struct scriptFrames *scriptInfo;
+    struct outputBuffer *output;  // NULL if the process writes to stdout
+    struct job *job;              // NULL if the process runs on the main thread
+    int bypassed;  // Times passed over since it last ran (locality scheduling)
+    int faultedPage;  // Page of its last page fault or -1 (load control)
+    int quantumEnd;   // Address at which its time slice ends (RR, RR30)
+    // Instructions left in the time slice it was in when checkpointed (RR,
+    // RR30), 0 for a full time slice
+    int timesliceLeft;
+    // Stack of its time slices once dispatched and how the last one ended
+    // (coroutine scheduling)
+    struct coroutine *coroutine;
+    timesliceEnd_t timesliceEnd;
     struct PCB *next;
     struct PCB *prev;
 };
 
-extern int startExitProcedure;
-extern pthread_mutex_t finishedWorkLock;
-extern pthread_cond_t finishedWorkCond;
+// State of a process saved in a checkpoint (see checkpoint.c)
+struct processSnapshot {
+    int pid;
+    int lengthScore;
+    int virtualAddress;
+    int timesliceLeft;
+    struct scriptFrames *scriptInfo;
+};
 
+extern struct pool pcbPool;
+extern int startExitProcedure;
+extern pthread_mutex_t jobsLock;
+extern pthread_cond_t jobsCond;
 
 void scheduler_init();
 int mem_load_script(char script[], policy_t policy);
 void schedulerRun(policy_t policy, int isRunningBackground, int isRunningInBackground);
 void joinAllThreads();
 int isMainThread(pthread_t runningPthread);
-void createPCB(policy_t policy, struct scriptFrames *scriptInfo);
+struct PCB *createPCB(policy_t policy, struct scriptFrames *scriptInfo);
+void listJobs();
+int waitJob(int jobId);
+void waitAllJobs();
+void exitIfRequested();
+int schedulerSnapshot(struct processSnapshot **processes, int *processesNumber,
+                      policy_t *policy);
+void schedulerRestore(struct processSnapshot processes[], int processesNumber);
+void simulateSchedules(struct scriptFrames *scripts[], int scriptsNumber, int copies);
+void schedulerPrintStats();
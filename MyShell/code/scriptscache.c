@@ -0,0 +1,483 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "scriptscache.h"
+#include "scriptsmemory.h"
+#include "shell.h"
+#include "trace.h"
+#include "victimcache.h"
+
+// Hash index of the scripts known to the shell keyed by their path name.
+// An entry is only valid as long as the file it was built from (same device,
+// inode, size and modification time) is still the one behind the path.
+struct scriptFrames *scriptsCache[SCRIPT_CACHE_BUCKETS];
+
+// Mutex lock used whenever the scripts cache is accessed
+pthread_mutex_t scriptsCacheLock;
+
+// inotify instance used to invalidate entries as soon as their file changes
+// (-1 if inotify is not available in which case only stat is relied upon)
+int scriptsCacheInotifyFd;
+
+// Pool of the scriptFrames structs (of files and streams)
+struct pool scriptsPool;
+
+// Logical clock used to find the least recently used idle script
+unsigned long scriptsCacheClock;
+
+/*** FUNCTION SIGNATURES ***/
+
+unsigned int hashScriptName(char script[]);
+void drainScriptsCacheEvents();
+void invalidateScript(struct scriptFrames *scriptInfo);
+void trimScriptsCache();
+void freeScript(struct scriptFrames *scriptInfo);
+struct scriptFrames *findCachedScript(char script[], struct stat *fileStat);
+int reopenScript(struct scriptFrames *scriptInfo);
+
+/*** FUNCTIONS FOR THE SCRIPTS CACHE ***/
+
+/**
+ * This function intializes the scripts cache as well as the inotify instance
+ * used to watch the cached files.
+ * @param void
+ * @return void
+ */
+void scripts_cache_init() {
+    int bucketIdx;
+
+    for (bucketIdx = 0; bucketIdx < SCRIPT_CACHE_BUCKETS; bucketIdx++) {
+        scriptsCache[bucketIdx] = NULL;
+    }
+    scriptsCacheClock = 0;
+    scriptsCacheInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    pthread_mutex_init(&scriptsCacheLock, NULL);
+    poolInit(&scriptsPool, "Scripts", sizeof(struct scriptFrames));
+}
+
+/**
+ * Function that returns the cached script struct associated with a path name
+ * if the file behind the path didn't change since it was cached.
+ *
+ * @param script path name of the script to look up
+ *
+ * @return the scriptFrames struct of the script (the caller owns a reference
+ * to it that must be given back with scriptsCacheRelease) or NULL if it isn't
+ * cached (or if the cached copy is stale)
+ */
+struct scriptFrames *scriptsCacheLookup(char script[]) {
+    struct stat fileStat;
+    struct scriptFrames *scriptInfo, *rv = NULL;
+
+    // The stat is needed because the same path may point to another file
+    // after a my_cd or a rename
+    if (stat(script, &fileStat) != 0) {
+        return NULL;
+    }
+
+    traceLock(&scriptsCacheLock, "scriptsCache");
+    drainScriptsCacheEvents();
+    scriptInfo = findCachedScript(script, &fileStat);
+    // An idle script has no open file, it is reopened before being used again
+    if (scriptInfo && !scriptInfo->scriptFile && reopenScript(scriptInfo)) {
+        invalidateScript(scriptInfo);
+        scriptInfo = NULL;
+    }
+    if (scriptInfo) {
+        scriptInfo->lastUsed = ++scriptsCacheClock;
+        // Idle scripts only get a reference under the lock so that they can't
+        // be freed by another thread in the meantime
+        __atomic_add_fetch(&scriptInfo->references, 1, __ATOMIC_RELAXED);
+        rv = scriptInfo;
+    }
+    pthread_mutex_unlock(&scriptsCacheLock);
+
+    return rv;
+}
+
+/**
+ * Function that reads a script file once to count its lines and to build the
+ * index of the byte offset of every page, then adds it to the cache. If
+ * another thread cached the same file in the meantime, its script is used
+ * instead.
+ * Note that the file stays open while the script is used so that page faults
+ * only need to seek to the page instead of reopening and rereading the file
+ * from the beginning (it is closed once the script is idle).
+ *
+ * @param script path name of the script to load
+ *
+ * @return the new scriptFrames struct (the caller owns a reference to it) or
+ * NULL if the file can't be opened
+ */
+struct scriptFrames *scriptsCacheLoad(char script[]) {
+    char line[MAX_USER_INPUT];
+    int scriptLength = 0, pageIdx, offsetsCapacity = 16;
+    unsigned int bucketIdx;
+    struct stat fileStat;
+    struct scriptFrames *scriptInfo, *cachedScript;
+    FILE *p;
+
+    p = fopen(script, "rt");
+    // Make sure the given File is valid
+    if (p == NULL) {
+        return NULL;
+    }
+    fstat(fileno(p), &fileStat);
+
+    scriptInfo = (struct scriptFrames *)poolAlloc(&scriptsPool);
+    scriptInfo->pageOffsets = (long *)malloc(offsetsCapacity * sizeof(long));
+    scriptInfo->pageHashes = NULL;
+    scriptInfo->victimPages = 0;
+    scriptInfo->framesQuota = FRAME_NUMBER;
+    scriptInfo->workingSetRevolution = -1;
+    scriptInfo->traceId = 0;
+#ifdef PAGE_DEDUP
+    scriptInfo->pageHashes = (unsigned long *)malloc(offsetsCapacity * sizeof(unsigned long));
+#endif
+
+    // Count the number of lines in the script and remember where pages start
+    // (the page after the last line too when the last page is full: it is
+    // loaded with the first pages of the script and reads as an empty line)
+    while (1) {
+        if (scriptLength % PAGE_SIZE == 0) {
+            if (scriptLength / PAGE_SIZE == offsetsCapacity) {
+                offsetsCapacity *= 2;
+                scriptInfo->pageOffsets = (long *)realloc(
+                    scriptInfo->pageOffsets, offsetsCapacity * sizeof(long));
+                if (scriptInfo->pageHashes) {
+                    scriptInfo->pageHashes = (unsigned long *)realloc(
+                        scriptInfo->pageHashes, offsetsCapacity * sizeof(unsigned long));
+                }
+            }
+            scriptInfo->pageOffsets[scriptLength / PAGE_SIZE] = ftell(p);
+            if (scriptInfo->pageHashes) {
+                scriptInfo->pageHashes[scriptLength / PAGE_SIZE] = PAGE_HASH_SEED;
+            }
+        }
+        if (feof(p)) {
+            if (scriptLength % PAGE_SIZE == 0 && scriptInfo->pageHashes) {
+                scriptInfo->pageHashes[scriptLength / PAGE_SIZE] =
+                    hashPageLine(PAGE_HASH_SEED, "", 0);
+            }
+            break;
+        }
+        // The lines are hashed as a page fault would read them (an empty line
+        // at the end of the file)
+        line[0] = '\0';
+        fgets(line, MAX_USER_INPUT - 1, p);
+        if (scriptInfo->pageHashes) {
+            scriptInfo->pageHashes[scriptLength / PAGE_SIZE] = hashPageLine(
+                scriptInfo->pageHashes[scriptLength / PAGE_SIZE], line, strlen(line));
+        }
+        scriptLength++;
+    }
+
+    // Initialize the page table and related information
+    scriptInfo->scriptName = strdup(script);
+    scriptInfo->lengthCode = scriptLength;
+    scriptInfo->references = 1;
+    scriptInfo->FramesInUse = 0;
+    for (pageIdx = 0; pageIdx < PAGE_TABLE_SIZE; pageIdx++) {
+        scriptInfo->pageTable[pageIdx] = PAGE_NOT_RESIDENT;
+    }
+    scriptInfo->scriptFile = p;
+    scriptInfo->device = fileStat.st_dev;
+    scriptInfo->inode = fileStat.st_ino;
+    scriptInfo->size = fileStat.st_size;
+    scriptInfo->modificationTime = fileStat.st_mtim;
+    scriptInfo->isStream = 0;
+    scriptInfo->streamSpills = NULL;
+    scriptInfo->watchDescriptor = -1;
+    if (scriptsCacheInotifyFd >= 0) {
+        scriptInfo->watchDescriptor = inotify_add_watch(
+            scriptsCacheInotifyFd, script,
+            IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF);
+    }
+
+    traceLock(&scriptsCacheLock, "scriptsCache");
+    // Two threads missing on the same file both load it, the first one to get
+    // here caches it and the other one uses its script
+    cachedScript = findCachedScript(script, &fileStat);
+    if (cachedScript && (cachedScript->scriptFile || !reopenScript(cachedScript))) {
+        cachedScript->lastUsed = ++scriptsCacheClock;
+        __atomic_add_fetch(&cachedScript->references, 1, __ATOMIC_RELAXED);
+        freeScript(scriptInfo);
+        pthread_mutex_unlock(&scriptsCacheLock);
+        return cachedScript;
+    }
+    if (cachedScript) {
+        invalidateScript(cachedScript);
+    }
+
+    // Insert at the head of its bucket
+    bucketIdx = hashScriptName(script);
+    scriptInfo->isCached = 1;
+    scriptInfo->lastUsed = ++scriptsCacheClock;
+    scriptInfo->nextInBucket = scriptsCache[bucketIdx];
+    scriptsCache[bucketIdx] = scriptInfo;
+    pthread_mutex_unlock(&scriptsCacheLock);
+
+    return scriptInfo;
+}
+
+/**
+ * Function that gives back a reference to a script (held by a PCB, a frame or
+ * the caller of a lookup). Once the last reference is given back, scripts that
+ * are still valid stay in the cache (up to SCRIPT_CACHE_SIZE idle scripts)
+ * while stale ones are freed right away.
+ * Note that a script only ever becomes idle with the scriptsCacheLock held so
+ * that lookups and trims agree on which scripts are idle.
+ *
+ * @param scriptInfo the struct of the script to release
+ *
+ * @return void
+ */
+void scriptsCacheRelease(struct scriptFrames *scriptInfo) {
+    int references;
+
+    // Fast path where the script is still used by others afterwards
+    references = __atomic_load_n(&scriptInfo->references, __ATOMIC_RELAXED);
+    while (references > 1) {
+        if (__atomic_compare_exchange_n(&scriptInfo->references, &references,
+                                        references - 1, 1, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+
+    traceLock(&scriptsCacheLock, "scriptsCache");
+    if (__atomic_sub_fetch(&scriptInfo->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (!scriptInfo->isCached) {
+            freeScript(scriptInfo);
+        } else {
+            // The file descriptors of the idle scripts aren't kept
+            if (scriptInfo->scriptFile) {
+                fclose(scriptInfo->scriptFile);
+                scriptInfo->scriptFile = NULL;
+            }
+            trimScriptsCache();
+        }
+    }
+    pthread_mutex_unlock(&scriptsCacheLock);
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * Function that hashes a path name into a bucket index (FNV-1a)
+ *
+ * @param script path name to hash
+ *
+ * @return the bucket index of the path name
+ */
+unsigned int hashScriptName(char script[]) {
+    unsigned int hash = 2166136261u;
+    int i;
+
+    for (i = 0; script[i] != '\0'; i++) {
+        hash ^= (unsigned char)script[i];
+        hash *= 16777619u;
+    }
+
+    return hash % SCRIPT_CACHE_BUCKETS;
+}
+
+/**
+ * Function that reads all the pending inotify events and invalidates the
+ * scripts whose file changed. Must be called with the scriptsCacheLock held.
+ * @param void
+ * @return void
+ */
+void drainScriptsCacheEvents() {
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *event;
+    struct scriptFrames *scriptInfo, *nextScript;
+    ssize_t length;
+    char *eventPtr;
+    int bucketIdx;
+
+    if (scriptsCacheInotifyFd < 0) {
+        return;
+    }
+
+    while ((length = read(scriptsCacheInotifyFd, events, sizeof(events))) > 0) {
+        for (eventPtr = events; eventPtr < events + length;
+             eventPtr += sizeof(struct inotify_event) + event->len) {
+            event = (struct inotify_event *)eventPtr;
+            // The same file (hence watch) may be cached under several paths
+            for (bucketIdx = 0; bucketIdx < SCRIPT_CACHE_BUCKETS; bucketIdx++) {
+                scriptInfo = scriptsCache[bucketIdx];
+                while (scriptInfo) {
+                    nextScript = scriptInfo->nextInBucket;
+                    if (scriptInfo->watchDescriptor == event->wd) {
+                        invalidateScript(scriptInfo);
+                    }
+                    scriptInfo = nextScript;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Function that removes a script from the cache. The script is freed if it
+ * isn't used anymore, otherwise it is freed by scriptsCacheRelease once the
+ * last reference to it is given back. Must be called with the scriptsCacheLock
+ * held.
+ *
+ * @param scriptInfo the struct of the script to invalidate
+ *
+ * @return void
+ */
+void invalidateScript(struct scriptFrames *scriptInfo) {
+    struct scriptFrames **link;
+
+    link = &scriptsCache[hashScriptName(scriptInfo->scriptName)];
+    while (*link != scriptInfo) {
+        link = &(*link)->nextInBucket;
+    }
+    *link = scriptInfo->nextInBucket;
+    scriptInfo->nextInBucket = NULL;
+    scriptInfo->isCached = 0;
+
+    if (!__atomic_load_n(&scriptInfo->references, __ATOMIC_ACQUIRE)) {
+        freeScript(scriptInfo);
+    }
+}
+
+/**
+ * Function that frees the least recently used idle scripts until there are at
+ * most SCRIPT_CACHE_SIZE of them. Must be called with the scriptsCacheLock
+ * held.
+ * @param void
+ * @return void
+ */
+void trimScriptsCache() {
+    struct scriptFrames *scriptInfo, *oldest;
+    int bucketIdx, idleScripts;
+
+    while (1) {
+        idleScripts = 0;
+        oldest = NULL;
+        for (bucketIdx = 0; bucketIdx < SCRIPT_CACHE_BUCKETS; bucketIdx++) {
+            for (scriptInfo = scriptsCache[bucketIdx]; scriptInfo;
+                 scriptInfo = scriptInfo->nextInBucket) {
+                if (!__atomic_load_n(&scriptInfo->references, __ATOMIC_ACQUIRE)) {
+                    idleScripts++;
+                    if (!oldest || scriptInfo->lastUsed < oldest->lastUsed) {
+                        oldest = scriptInfo;
+                    }
+                }
+            }
+        }
+        if (idleScripts <= SCRIPT_CACHE_SIZE) {
+            break;
+        }
+        invalidateScript(oldest);
+    }
+}
+
+/**
+ * Function that frees all the memory and resources associated with a script
+ *
+ * @param scriptInfo the struct of the script to free
+ *
+ * @return void
+ */
+void freeScript(struct scriptFrames *scriptInfo) {
+    struct scriptFrames *otherScript;
+    int bucketIdx, isWatchShared = 0;
+
+    // inotify hands out the same watch for every path of the same file so the
+    // watch must outlive this script if another cached script uses it
+    for (bucketIdx = 0; bucketIdx < SCRIPT_CACHE_BUCKETS; bucketIdx++) {
+        for (otherScript = scriptsCache[bucketIdx]; otherScript;
+             otherScript = otherScript->nextInBucket) {
+            if (otherScript->watchDescriptor == scriptInfo->watchDescriptor) {
+                isWatchShared = 1;
+            }
+        }
+    }
+    if (scriptInfo->watchDescriptor >= 0 && !isWatchShared) {
+        inotify_rm_watch(scriptsCacheInotifyFd, scriptInfo->watchDescriptor);
+    }
+    // Streams have no file (their lines are read from the input of the shell)
+    // and idle scripts closed theirs
+    if (scriptInfo->scriptFile) {
+        fclose(scriptInfo->scriptFile);
+    }
+    victimCacheDrop(scriptInfo);
+    releaseStreamSpills(scriptInfo);
+    free(scriptInfo->pageOffsets);
+    free(scriptInfo->pageHashes);
+    free(scriptInfo->scriptName);
+    poolFree(&scriptsPool, scriptInfo);
+}
+
+/**
+ * Function that finds the cached script of a path name built from the file
+ * behind it, a script built from an older version of the file is invalidated.
+ * Must be called with the scriptsCacheLock held.
+ *
+ * @param script path name of the script
+ * @param fileStat the stat of the file behind the path
+ *
+ * @return the scriptFrames struct of the script or NULL if it isn't cached
+ */
+struct scriptFrames *findCachedScript(char script[], struct stat *fileStat) {
+    struct scriptFrames *scriptInfo;
+
+    for (scriptInfo = scriptsCache[hashScriptName(script)]; scriptInfo;
+         scriptInfo = scriptInfo->nextInBucket) {
+        if (strcmp(scriptInfo->scriptName, script) == 0 &&
+            scriptInfo->device == fileStat->st_dev &&
+            scriptInfo->inode == fileStat->st_ino) {
+            // Same file but it was modified since it was cached
+            if (scriptInfo->size != fileStat->st_size ||
+                scriptInfo->modificationTime.tv_sec != fileStat->st_mtim.tv_sec ||
+                scriptInfo->modificationTime.tv_nsec != fileStat->st_mtim.tv_nsec) {
+                invalidateScript(scriptInfo);
+                return NULL;
+            }
+            return scriptInfo;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Function that opens the file of an idle script again, it must still be the
+ * file the script was built from. Must be called with the scriptsCacheLock
+ * held.
+ *
+ * @param scriptInfo the struct of the script (idle)
+ *
+ * @return 0 on success, non-zero if the file can't be opened or changed
+ */
+int reopenScript(struct scriptFrames *scriptInfo) {
+    struct stat fileStat;
+    FILE *p;
+
+    p = fopen(scriptInfo->scriptName, "rt");
+    if (p == NULL) {
+        return 1;
+    }
+    fstat(fileno(p), &fileStat);
+    if (scriptInfo->device != fileStat.st_dev || scriptInfo->inode != fileStat.st_ino ||
+        scriptInfo->size != fileStat.st_size ||
+        scriptInfo->modificationTime.tv_sec != fileStat.st_mtim.tv_sec ||
+        scriptInfo->modificationTime.tv_nsec != fileStat.st_mtim.tv_nsec) {
+        fclose(p);
+        return 1;
+    }
+    scriptInfo->scriptFile = p;
+
+    return 0;
+}
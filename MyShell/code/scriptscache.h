@@ -0,0 +1,19 @@
+#include <sys/types.h>
+#include <time.h>
+
+// Number of idle scripts (no PCB and no frame) whose metadata and line index
+// are kept around after being evicted from the frame store
+#ifndef SCRIPT_CACHE_SIZE
+#define SCRIPT_CACHE_SIZE 32
+#endif
+
+#define SCRIPT_CACHE_BUCKETS 64
+
+struct scriptFrames;
+
+extern struct pool scriptsPool;
+
+void scripts_cache_init();
+struct scriptFrames *scriptsCacheLookup(char script[]);
+struct scriptFrames *scriptsCacheLoad(char script[]);
+void scriptsCacheRelease(struct scriptFrames *scriptInfo);
@@ -1,25 +1,134 @@
 #include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "input.h"
+#include "output.h"
+#include "pool.h"
+#include "trace.h"
 #include "shellmemory.h"
+#include "scriptscache.h"
 #include "scriptsmemory.h"
 #include "shell.h"
+#include "victimcache.h"
 
-struct frameMetaData {
-    struct scriptFrames *associatedScript;
-    int associatedPageNumber;
-    int LRU_idx;
-};
+// The frame store is shared by the main thread and the worker threads.
+// Resident pages are read without locking: a reader pins the frame and the
+// page can't be evicted until it is unpinned. Only the thread replacing the
+// content of a frame holds its lock.
+// The metadata of the frames is split in arrays so that the fields read by
+// every fetch and by the scans for the LRU frame are densely packed, apart
+// from the fields only used when a page is replaced.
+
+// Hot fields (accessed atomically)
+long framesLastUsed[FRAME_NUMBER];  // LRU timestamp
+int framesPins[FRAME_NUMBER];       // Number of instructions of the frame executing
+// Whether the lines of the page are read on first use (restored frames)
+int framesLoadPending[FRAME_NUMBER];
+// Increased whenever the page of the frame is evicted or released. A cached
+// translation to the frame is valid as long as its generation didn't change.
+unsigned int framesGeneration[FRAME_NUMBER];
+
+// Cold fields
+struct scriptFrames *framesScript[FRAME_NUMBER];
+int framesPage[FRAME_NUMBER];
+pthread_mutex_t framesLock[FRAME_NUMBER];
 
+// Lines of the frames. The text of a page is stored contiguously in the space
+// of its frame in a single cache line aligned slab (FRAME_TEXT_SIZE bytes per
+// frame), a frame only gets its own buffer if a page doesn't fit.
 char *shellmemoryCode[FRAME_STORE_SIZE];
+char *framesTextSlab;
+char *framesText[FRAME_NUMBER];
+size_t framesTextCapacity[FRAME_NUMBER];
+
+// Content deduplication (make dedup=1). Pages of files are hashed when the
+// script is loaded (see scriptsCacheLoad) and a page whose content is already
+// in a frame is mapped to that frame instead of taking a new one. The first
+// page loaded in a frame is its owner (framesScript and framesPage), the other
+// pages mapped to it are its sharers. The sharers are guarded by the lock of
+// the frame and the index of the hashes by dedupLock.
+struct frameMapping {
+    struct scriptFrames *scriptInfo;
+    int pageNumber;
+    struct frameMapping *next;
+};
+struct frameMapping *framesSharers[FRAME_NUMBER];
+unsigned long framesHash[FRAME_NUMBER];
+int framesIsIndexed[FRAME_NUMBER];
+int framesNextInBucket[FRAME_NUMBER];  // Next frame with the same bucket or -1
+int dedupBuckets[FRAME_NUMBER];        // First frame of every bucket or -1
+pthread_mutex_t dedupLock;
+
+// Pool of the sharers of the frames
+struct pool sharersPool;
 
-struct frameMetaData framesMetadata[FRAME_NUMBER];
+// Frame quotas (make quotas=1). A script that holds as many frames as its
+// quota replaces its own pages. A WSClock hand going around the frames counts
+// the frames of every working set it passes over and the quotas are
+// recomputed from them after every revolution. The scripts seen during the
+// revolution are referenced until then.
+pthread_mutex_t quotaLock;
+int quotaHand;  // Next frame inspected by the hand
+long quotaRevolution;
+struct scriptFrames *quotaScripts[FRAME_NUMBER];
+int quotaScriptsNumber;
+unsigned long localReplacements;
+
+// Translation lookaside buffer of the running thread: recent translations of
+// pages to frames (direct mapped on the script and the page number). The
+// entries are never invalidated, the generation of the frame tells whether
+// they are stale.
+struct tlbEntry {
+    struct scriptFrames *scriptInfo;
+    int pageNumber;
+    int frameNumber;
+    unsigned int generation;
+};
+__thread struct tlbEntry threadTLB[TLB_ENTRIES];
+
+// Statistics of the TLBs and of the LRU stamps. The threads count in their own
+// counters, added to the totals every TLB_STATS_FLUSH lookups.
+__thread unsigned long threadTLBHits, threadTLBMisses, threadStampsSkipped;
+unsigned long tlbHits, tlbMisses, stampsSkipped;
+
+// Guards the lines kept aside for the evicted stream pages (a stream page can
+// be evicted by another thread while the stream faults on another page)
+pthread_mutex_t streamSpillsLock;
+
+// Logical clocks of the LRU policy. Used frames are stamped with an increasing
+// time while demoted frames are stamped with a decreasing time (below any use)
+long framesClock;
+long framesDemotionClock;
 
 /*** FUNCTION SIGNATURES ***/
 
-int virtualToPhysicalAddress(int instructionVirtualAddress, struct scriptFrames *scriptInfo);
+int *pageTableEntry(int pageNumber, struct scriptFrames *scriptInfo);
 void updateLRURanking(int frameMostRecentlyUsed);
+void demoteLRURanking(int frameLeastRecentlyUsed);
+int claimPage(int pageNumber, struct scriptFrames *scriptInfo);
+void releaseConsumedStreamPage(int pageNumber, struct scriptFrames *scriptInfo);
+void loadFilePage(int pageNumber, int frameNumber, struct scriptFrames *scriptInfo);
+void loadStreamPage(int pageNumber, int frameNumber, struct scriptFrames *scriptInfo);
+void loadPendingPage(int frameNumber);
+void storePageText(int frameNumber, char *lines[], size_t lengths[], int linesNumber);
+void clearPageText(int frameNumber);
+int readFilePage(int pageNumber, struct scriptFrames *scriptInfo,
+                 char line[PAGE_SIZE][MAX_USER_INPUT], char *lines[], size_t lengths[]);
+int mapSharedPage(int pageNumber, struct scriptFrames *scriptInfo);
+void indexFrame(int frameNumber, unsigned long hash);
+void unindexFrame(int frameNumber);
+int tlbSlot(int pageNumber, struct scriptFrames *scriptInfo);
+void countTLBLookup(int isHit);
+void advanceQuotaHand();
+int findLocalLRUFrame(struct scriptFrames *scriptInfo);
+void countWorkingSetFrame(struct scriptFrames *scriptInfo);
+void rebalanceQuotas();
+int compareWorkingSets(const void *script1, const void *script2);
+void declareVictimePage(struct traceRecord *record);
+int evictPage(int frameNumber);
 
 /*** FUNCTIONS FOR SCRIPT MEMORY ***/
 
@@ -38,16 +147,42 @@ void scripts_memory_init() {
 
     // Initialize frames metadata
     // Note that the associated pageNumber doesn't need to be initialized
-    // because it's value is only relevant if the associatedScript field
+    // because it's value is only relevant if the associated script
     // is non NULL
+    framesTextSlab = (char *)aligned_alloc(64, FRAME_NUMBER * FRAME_TEXT_SIZE);
     for (frameIdx = 0; frameIdx < FRAME_NUMBER; frameIdx++) {
-        framesMetadata[frameIdx].associatedScript = NULL;
-        framesMetadata[frameIdx].LRU_idx = FRAME_NUMBER - frameIdx - 1;
+        framesScript[frameIdx] = NULL;
+        framesText[frameIdx] = framesTextSlab + frameIdx * FRAME_TEXT_SIZE;
+        framesTextCapacity[frameIdx] = FRAME_TEXT_SIZE;
+        // The first frame is the least recently used one
+        framesLastUsed[frameIdx] = frameIdx;
+        framesPins[frameIdx] = 0;
+        framesLoadPending[frameIdx] = 0;
+        framesGeneration[frameIdx] = 0;
+        pthread_mutex_init(&framesLock[frameIdx], NULL);
+        framesSharers[frameIdx] = NULL;
+        framesIsIndexed[frameIdx] = 0;
+        dedupBuckets[frameIdx] = -1;
     }
+    pthread_mutex_init(&dedupLock, NULL);
+    poolInit(&sharersPool, "Shared pages", sizeof(struct frameMapping));
+    pthread_mutex_init(&quotaLock, NULL);
+    pthread_mutex_init(&streamSpillsLock, NULL);
+    quotaHand = 0;
+    quotaRevolution = 0;
+    quotaScriptsNumber = 0;
+    localReplacements = 0;
+    framesClock = FRAME_NUMBER;
+    framesDemotionClock = 0;
+
+    // Evicted pages are declared in stdout
+    traceSubscribe(TRACE_EVICT, declareVictimePage);
 }
 
 /**
- * Function that returns the instruction associated with a virtual address
+ * Function that returns the instruction associated with a virtual address.
+ * The frame of the instruction is pinned so that it can't be evicted while the
+ * instruction executes: releaseInstructionVirtual must be called once done.
  *
  * @param instructionVirtualAddress the user address at which to fetch the
  * instructions
@@ -58,195 +193,824 @@ void scripts_memory_init() {
  * otherwise
  */
 char *fetchInstructionVirtual(int instructionVirtualAddress, struct scriptFrames *scriptInfo) {
-    int physicalAddress;
-    char *rv;
+    int *entry, frameNumber, pageNumber;
+    struct tlbEntry *translation;
 
-    physicalAddress = virtualToPhysicalAddress(instructionVirtualAddress, scriptInfo);
-    if (physicalAddress >= 0) {
-        rv = shellmemoryCode[physicalAddress];
-        updateLRURanking(physicalAddress / PAGE_SIZE);
-    } else {
-        rv = NULL;
+    // A translation cached by the thread saves the page table walk as long as
+    // the frame kept its page (an eviction increases the generation before
+    // checking the pins)
+    pageNumber = instructionVirtualAddress / PAGE_SIZE;
+    translation = &threadTLB[tlbSlot(pageNumber, scriptInfo)];
+    if (translation->scriptInfo == scriptInfo && translation->pageNumber == pageNumber) {
+        frameNumber = translation->frameNumber;
+        __atomic_add_fetch(&framesPins[frameNumber], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&framesGeneration[frameNumber], __ATOMIC_SEQ_CST) ==
+            translation->generation) {
+            countTLBLookup(1);
+            goto pinned;
+        }
+        __atomic_sub_fetch(&framesPins[frameNumber], 1, __ATOMIC_RELEASE);
     }
+    countTLBLookup(0);
 
-    return rv;
+    entry = pageTableEntry(pageNumber, scriptInfo);
+    while (1) {
+        frameNumber = __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+        // The page isn't resident (or is being loaded or evicted)
+        if (frameNumber < 0) {
+            return NULL;
+        }
+        __atomic_add_fetch(&framesPins[frameNumber], 1, __ATOMIC_SEQ_CST);
+        // The page may have been evicted before the frame got pinned
+        if (__atomic_load_n(entry, __ATOMIC_SEQ_CST) == frameNumber) {
+            break;
+        }
+        __atomic_sub_fetch(&framesPins[frameNumber], 1, __ATOMIC_RELEASE);
+    }
+    translation->scriptInfo = scriptInfo;
+    translation->pageNumber = pageNumber;
+    translation->frameNumber = frameNumber;
+    translation->generation = __atomic_load_n(&framesGeneration[frameNumber], __ATOMIC_SEQ_CST);
+
+pinned:
+    traceReference(&scriptInfo->traceId, pageNumber);
+    if (__atomic_load_n(&framesLoadPending[frameNumber], __ATOMIC_ACQUIRE)) {
+        loadPendingPage(frameNumber);
+    }
+    updateLRURanking(frameNumber);
+
+    return shellmemoryCode[frameNumber * PAGE_SIZE + instructionVirtualAddress % PAGE_SIZE];
 }
 
 /**
- * Function that updates the memory slot associated with a virtual address
- * Note that this function assumes that the given instructionVirtualAddress is
- * always valid (i.e. the behaviour for an invalid virtual address is
- * undetermined). This is because the function is only used by the OS
- * internally.
+ * Function that unpins the frame of an instruction returned by
+ * fetchInstructionVirtual once it finished executing
  *
- * @param instructionVirtualAddress the user address at which to update the
- * instruction stored
+ * @param instructionVirtualAddress the user address of the instruction
  * @param scriptInfo the struct containing the page table needed to decode the
  * virtual address
- * @param newInstruction the new instruction to assign to the virtual address
- * 
+ *
  * @return void
  */
-void updateInstructionVirtual(int instructionVirtualAddress,
-                              struct scriptFrames *scriptInfo,
-                              char newInstruction[]) {
-    int physicalAddress;
-    // Fetch translation of virtual address
-    physicalAddress = virtualToPhysicalAddress(instructionVirtualAddress, scriptInfo);
-    // Update the memory
-    shellmemoryCode[physicalAddress] = newInstruction;
+void releaseInstructionVirtual(int instructionVirtualAddress, struct scriptFrames *scriptInfo) {
+    int frameNumber, pageNumber;
+    struct tlbEntry *translation;
+
+    // The page can't have moved since its frame is pinned. Its translation is
+    // still cached unless the instruction fetched others (e.g. exec).
+    pageNumber = instructionVirtualAddress / PAGE_SIZE;
+    translation = &threadTLB[tlbSlot(pageNumber, scriptInfo)];
+    if (translation->scriptInfo == scriptInfo && translation->pageNumber == pageNumber) {
+        frameNumber = translation->frameNumber;
+    } else {
+        frameNumber = virtualToPhysicalAddress(instructionVirtualAddress, scriptInfo) / PAGE_SIZE;
+    }
+    __atomic_sub_fetch(&framesPins[frameNumber], 1, __ATOMIC_RELEASE);
 }
 
 /**
- * Function that returns the LRU (Least Recently Used) frame to be replaced
+ * Function that returns the LRU (Least Recently Used) frame to be replaced.
+ * Pinned frames and frames being replaced by another thread are skipped.
  * @param void
- * @return the LRU frame index
+ * @return the LRU frame index (locked by the calling thread)
  */
 int findLRUFrame() {
+    int frameIdx, LRUFrame;
+    long oldest, lastUsed;
+
+    while (1) {
+        LRUFrame = -1;
+        // Loop over all the frames to find the one with the oldest timestamp
+        for (frameIdx = 0; frameIdx < FRAME_NUMBER; frameIdx++) {
+            if (__atomic_load_n(&framesPins[frameIdx], __ATOMIC_RELAXED)) {
+                continue;
+            }
+            lastUsed = __atomic_load_n(&framesLastUsed[frameIdx], __ATOMIC_RELAXED);
+            if (LRUFrame < 0 || lastUsed < oldest) {
+                LRUFrame = frameIdx;
+                oldest = lastUsed;
+            }
+        }
+        if (LRUFrame >= 0 && pthread_mutex_trylock(&framesLock[LRUFrame]) == 0) {
+            return LRUFrame;
+        }
+        // Every candidate is busy, let the other threads make progress
+        sched_yield();
+    }
+}
+
+/**
+ * Function that returns the frame to be replaced by a page fault with the frame
+ * quotas. A script holding as many frames as its quota (at least
+ * QUOTA_MIN_FRAMES per process running it) replaces its own LRU page, the
+ * other scripts replace the LRU frame. The WSClock hand advances
+ * by QUOTA_HAND_STEPS frames on every fault.
+ *
+ * @param scriptInfo the struct of the script of the faulting page
+ *
+ * @return the frame index (locked by the calling thread)
+ */
+int findQuotaFrame(struct scriptFrames *scriptInfo) {
+    int frameNumber, framesInUse, quota;
+
+    pthread_mutex_lock(&quotaLock);
+    advanceQuotaHand();
+    // Every process running the script needs frames of its own, the references
+    // left once the frames and the hand are removed are the processes
+    framesInUse = __atomic_load_n(&scriptInfo->FramesInUse, __ATOMIC_RELAXED);
+    quota = (__atomic_load_n(&scriptInfo->references, __ATOMIC_RELAXED) - framesInUse -
+             (scriptInfo->workingSetRevolution == quotaRevolution)) *
+            QUOTA_MIN_FRAMES;
+    if (quota < scriptInfo->framesQuota) {
+        quota = scriptInfo->framesQuota;
+    }
+    if (framesInUse >= quota) {
+        frameNumber = findLocalLRUFrame(scriptInfo);
+        if (frameNumber >= 0) {
+            localReplacements++;
+            pthread_mutex_unlock(&quotaLock);
+            return frameNumber;
+        }
+    }
+    pthread_mutex_unlock(&quotaLock);
+
+    return findLRUFrame();
+}
+
+/**
+ * Function that counts the frames a new page can take without evicting a page
+ * in use: the empty and demoted frames and the frames that weren't used during
+ * the last FRAME_STORE_SIZE LRU timestamps. The count is approximate
+ * since other threads may be using the frames.
+ * @param void
+ * @return the number of cold frames
+ */
+int countColdFrames() {
+    int frameIdx, coldFrames = 0;
+    long clock, lastUsed;
+
+    clock = __atomic_load_n(&framesClock, __ATOMIC_RELAXED);
+    for (frameIdx = 0; frameIdx < FRAME_NUMBER; frameIdx++) {
+        lastUsed = __atomic_load_n(&framesLastUsed[frameIdx], __ATOMIC_RELAXED);
+        if (!__atomic_load_n(&framesScript[frameIdx], __ATOMIC_RELAXED) || lastUsed <= 0 ||
+            clock - lastUsed > FRAME_STORE_SIZE) {
+            coldFrames++;
+        }
+    }
+
+    return coldFrames;
+}
+
+/**
+ * Function that makes the unpinned frames of a script the first ones to be
+ * replaced (e.g. when its process is suspended). The pages stay resident so
+ * that the script can still use them if nothing replaced them in the meantime.
+ *
+ * @param scriptInfo the struct of the script
+ *
+ * @return void
+ */
+void releaseScriptFrames(struct scriptFrames *scriptInfo) {
     int frameIdx;
 
-    // Loop over all the frames to find the LRU which
-    // will always have a rank equal to FRAME_NUMBER - 1
-    // in this implementation of LRU policy
     for (frameIdx = 0; frameIdx < FRAME_NUMBER; frameIdx++) {
-        if (framesMetadata[frameIdx].LRU_idx == FRAME_NUMBER - 1) {
-            return frameIdx;
+        if (__atomic_load_n(&framesScript[frameIdx], __ATOMIC_RELAXED) != scriptInfo ||
+            __atomic_load_n(&framesPins[frameIdx], __ATOMIC_RELAXED)) {
+            continue;
         }
+        demoteLRURanking(frameIdx);
     }
 }
 
 /**
- * Function that declares the victime page in stdout and simultaneously frees
- * the lines occupied
+ * Function that declares the victime page in stdout. It is notified of every
+ * eviction event before the lines of the victim page are freed.
+ *
+ * @param record the eviction event (the victim page number, its frame and
+ * the struct containing the page table of the victim page)
  *
- * @param victimPage the page number of the victim page 
- * @param scriptInfo the struct containing the page table of the victim page
- * 
  * @return void
  */
-void declareVictimePage(int victimePage, struct scriptFrames *scriptInfo) {
+void declareVictimePage(struct traceRecord *record) {
     int pageOffset;
-    int virtualAddress;
     char *instruction;
 
-    printf("Page fault! Victim page contents:\n\n");
-    // Loop through the lines in frame to declare and free them
+    shellPrintf("Page fault! Victim page contents:\n\n");
+    // Loop through the lines in frame to declare them
     for (pageOffset = 0; pageOffset < PAGE_SIZE; pageOffset++) {
-        virtualAddress = victimePage * PAGE_SIZE + pageOffset;
-        instruction = fetchInstructionVirtual(virtualAddress, scriptInfo);
+        instruction = shellmemoryCode[record->arg1 * PAGE_SIZE + pageOffset];
         // There might not be an instruction as the frame is three instructions
         // wide but there might be only 1 or 2 instructions stored
         if (instruction) {
-            printf("%s", instruction);
-            free(instruction);
-            // Set the line to NULL to avoid double freeing the same pointer
-            updateInstructionVirtual(virtualAddress, scriptInfo, NULL);
+            shellPrintf("%s", instruction);
+        }
+    }
+    shellPrintf("\nEnd of victim page contents.\n");
+}
+
+/**
+ * Function that evicts the page stored in a frame, declaring it and freeing the
+ * lines it occupies. The frame must be locked by the calling thread.
+ *
+ * @param frameNumber the frame of the victim page
+ *
+ * @return 0 if the page was evicted, non-zero if the frame is pinned
+ */
+int evictPage(int frameNumber) {
+    int pageOffset, victimPage, *entry;
+    char *instruction;
+    struct scriptFrames *scriptInfo;
+    struct frameMapping *sharer;
+    struct streamSpill *spill;
+
+    scriptInfo = framesScript[frameNumber];
+    victimPage = framesPage[frameNumber];
+    entry = pageTableEntry(victimPage, scriptInfo);
+
+    // New readers can't pin the frame once its pages are marked as evicted but
+    // readers that pinned it before must be waited for
+    __atomic_store_n(entry, PAGE_EVICTING, __ATOMIC_SEQ_CST);
+    for (sharer = framesSharers[frameNumber]; sharer; sharer = sharer->next) {
+        __atomic_store_n(pageTableEntry(sharer->pageNumber, sharer->scriptInfo),
+                         PAGE_EVICTING, __ATOMIC_SEQ_CST);
+    }
+    // The translations cached by the threads become stale (even if the page
+    // stays because it is pinned)
+    __atomic_add_fetch(&framesGeneration[frameNumber], 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&framesPins[frameNumber], __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(entry, frameNumber, __ATOMIC_RELEASE);
+        for (sharer = framesSharers[frameNumber]; sharer; sharer = sharer->next) {
+            __atomic_store_n(pageTableEntry(sharer->pageNumber, sharer->scriptInfo),
+                             frameNumber, __ATOMIC_RELEASE);
+        }
+        return 1;
+    }
+    unindexFrame(frameNumber);
+
+    // A restored page that was never used is read to be declared
+    if (framesLoadPending[frameNumber]) {
+        loadFilePage(victimPage, frameNumber, scriptInfo);
+        __atomic_store_n(&framesLoadPending[frameNumber], 0, __ATOMIC_RELEASE);
+    }
+
+    // Declare the victim
+    traceEmit(TRACE_EVICT, 0, victimPage, frameNumber, scriptInfo);
+
+    // Lines of a stream can't be read again so they are kept aside until the
+    // stream page faults back in
+    if (scriptInfo->isStream) {
+        spill = (struct streamSpill *)malloc(sizeof(struct streamSpill));
+        spill->pageNumber = victimPage;
+        for (spill->linesNumber = 0;
+             spill->linesNumber < PAGE_SIZE &&
+             shellmemoryCode[frameNumber * PAGE_SIZE + spill->linesNumber];
+             spill->linesNumber++) {
+            spill->lines[spill->linesNumber] =
+                strdup(shellmemoryCode[frameNumber * PAGE_SIZE + spill->linesNumber]);
+        }
+        pthread_mutex_lock(&streamSpillsLock);
+        spill->next = scriptInfo->streamSpills;
+        scriptInfo->streamSpills = spill;
+        pthread_mutex_unlock(&streamSpillsLock);
+    }
+    // Lines of a file are kept in the victim cache so that a page fault on
+    // them doesn't read the file again
+    if (!scriptInfo->isStream && shellmemoryCode[frameNumber * PAGE_SIZE]) {
+        for (pageOffset = 0;
+             pageOffset < PAGE_SIZE && shellmemoryCode[frameNumber * PAGE_SIZE + pageOffset];
+             pageOffset++) {
+            instruction = shellmemoryCode[frameNumber * PAGE_SIZE + pageOffset];
         }
+        victimCachePut(scriptInfo, victimPage, shellmemoryCode[frameNumber * PAGE_SIZE],
+                       instruction + strlen(instruction) + 1 -
+                           shellmemoryCode[frameNumber * PAGE_SIZE],
+                       pageOffset);
+    }
+    clearPageText(frameNumber);
+
+    // The pages sharing the frame are evicted along with it
+    while ((sharer = framesSharers[frameNumber])) {
+        framesSharers[frameNumber] = sharer->next;
+        __atomic_store_n(pageTableEntry(sharer->pageNumber, sharer->scriptInfo),
+                         PAGE_NOT_RESIDENT, __ATOMIC_RELEASE);
+        __atomic_sub_fetch(&sharer->scriptInfo->FramesInUse, 1, __ATOMIC_RELAXED);
+        scriptsCacheRelease(sharer->scriptInfo);
+        poolFree(&sharersPool, sharer);
     }
-    printf("\nEnd of victim page contents.\n");
+
+    // Invalidate page in page table
+    __atomic_store_n(entry, PAGE_NOT_RESIDENT, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&scriptInfo->FramesInUse, 1, __ATOMIC_RELAXED);
+    framesScript[frameNumber] = NULL;
+    // The script cache decides whether to keep the information of the script
+    // if no frames or PCBs are using it anymore
+    scriptsCacheRelease(scriptInfo);
+
+    return 0;
 }
 
 /**
- * Function that assigns a page to a frame with respect to the LRU policy
+ * Function that assigns a page to a frame with respect to the LRU policy.
+ * Only the frame being replaced is locked so several threads can fault at
+ * the same time. If another thread is already loading the page, the function
+ * returns once it is loaded.
  *
  * @param pageNumber new page to be stored in memory
  * @param scriptInfo struct containing page table fo the page to be stored
  * @param setup boolean that is True if the script is being allocated its first
  * 2 frames or False if it is a page fault
- * 
+ *
  * @return void
  */
 void pageAssignment(int pageNumber, struct scriptFrames *scriptInfo, int setup) {
-    FILE *p;
-    int LRUFrame, pageIdx, pageOffsetIdx;
-    char line[MAX_USER_INPUT];
-
-    // First find the frame to use (LRU)
-    LRUFrame = findLRUFrame();
-    // The LRU becomes the most recently used because it will contain a new page
-    updateLRURanking(LRUFrame);
-
-    // If frame to use had a page then declare victim page and clean up
-    if (framesMetadata[LRUFrame].associatedScript) {
-        // Declare the victim and free the memory allocated lines
-        declareVictimePage(framesMetadata[LRUFrame].associatedPageNumber,
-                           framesMetadata[LRUFrame].associatedScript);
-
-        // Invalidate page in page table
-        framesMetadata[LRUFrame].associatedScript->pageTable[framesMetadata[LRUFrame].associatedPageNumber] = -1;
-
-        framesMetadata[LRUFrame].associatedScript->FramesInUse--;
-        // Special case where no frames or PCBs are using the script file
-        // anymore free the memory allocated for the scriptInformation
-        if (!framesMetadata[LRUFrame].associatedScript->PCBsInUse &&
-            !framesMetadata[LRUFrame].associatedScript->FramesInUse) {
-            free(framesMetadata[LRUFrame].associatedScript->scriptName);
-            free(framesMetadata[LRUFrame].associatedScript);
-            framesMetadata[LRUFrame].associatedScript = NULL;
-        }
-    } else if (!setup) {
-        // Special case where there is a page fault but no pages are being
-        // evicted
-        printf("Page fault!\n");
+    int LRUFrame;
+
+    // The previous page of a stream was entirely executed and can never be
+    // used again so its frame is given back before choosing a frame
+    if (scriptInfo->isStream && pageNumber > 0) {
+        releaseConsumedStreamPage(pageNumber - 1, scriptInfo);
     }
 
-    // Renew metaData to the frame
-    framesMetadata[LRUFrame].associatedScript = scriptInfo;
-    framesMetadata[LRUFrame].associatedScript->FramesInUse++;
-    framesMetadata[LRUFrame].associatedPageNumber = pageNumber;
+    if (!claimPage(pageNumber, scriptInfo)) {
+        return;
+    }
 
-    // Validate pageTable of newly allocated page
-    framesMetadata[LRUFrame].associatedScript->pageTable[pageNumber] = LRUFrame;
+    traceEmit(TRACE_PAGE_FAULT, 0, pageNumber, setup, scriptInfo);
+
+    // A page identical to a resident one doesn't need a frame of its own
+    if (scriptInfo->pageHashes && mapSharedPage(pageNumber, scriptInfo)) {
+        return;
+    }
 
-    p = fopen(scriptInfo->scriptName, "rt");
+    while (1) {
+        // First find the frame to use (LRU)
+#ifdef FRAME_QUOTAS
+        LRUFrame = findQuotaFrame(scriptInfo);
+#else
+        LRUFrame = findLRUFrame();
+#endif
+        // The LRU becomes the most recently used because it will contain a new
+        // page (or because it is in use if its page can't be evicted)
+        updateLRURanking(LRUFrame);
 
-    // Offset to current page
-    for (pageIdx = 0; pageIdx < pageNumber; pageIdx++) {
-        for (pageOffsetIdx = 0; pageOffsetIdx < PAGE_SIZE; pageOffsetIdx++) {
-            fgets(line, MAX_USER_INPUT - 1, p);
+        // If frame to use had a page then declare victim page and clean up
+        if (!framesScript[LRUFrame]) {
+            if (!setup) {
+                // Special case where there is a page fault but no pages are
+                // being evicted
+                shellPrintf("Page fault!\n");
+            }
+            break;
+        } else if (!evictPage(LRUFrame)) {
+            break;
         }
+        // The page was pinned after the frame was chosen
+        pthread_mutex_unlock(&framesLock[LRUFrame]);
     }
 
+    // Renew metaData to the frame
+    framesScript[LRUFrame] = scriptInfo;
+    framesPage[LRUFrame] = pageNumber;
+    __atomic_add_fetch(&scriptInfo->FramesInUse, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&scriptInfo->references, 1, __ATOMIC_RELAXED);
+
     // Write into memory the new page
-    for (pageOffsetIdx = 0; pageOffsetIdx < PAGE_SIZE; pageOffsetIdx++) {
-        fgets(line, MAX_USER_INPUT - 1, p);
-        updateInstructionVirtual(pageNumber * 3 + pageOffsetIdx, scriptInfo, strdup(line));
-        memset(line, 0, sizeof(line));
-        if (feof(p)) {
-            break;
-        }
+    if (scriptInfo->isStream) {
+        loadStreamPage(pageNumber, LRUFrame, scriptInfo);
+    } else {
+        loadFilePage(pageNumber, LRUFrame, scriptInfo);
+    }
+
+    if (scriptInfo->pageHashes) {
+        indexFrame(LRUFrame, scriptInfo->pageHashes[pageNumber]);
     }
-    fclose(p);
+
+    // Validate pageTable of newly allocated page
+    __atomic_store_n(pageTableEntry(pageNumber, scriptInfo), LRUFrame, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&framesLock[LRUFrame]);
+    traceEmit(TRACE_PAGE_IN, 0, pageNumber, LRUFrame, scriptInfo);
 }
 
 /**
  * Function that returns an associated page table struct
  * if the associated script has at least one frame in memory
  * This function is important for code sharing between process executing the
- * same script
+ * same script. The caller owns a reference to the returned script that must be
+ * given back with scriptsCacheRelease.
  *
  * @param script path name of the script to find the page table of in memory
  *
  * @return scriptFrames page table struct of the script in question or NULL if the script is not in memory
  */
 struct scriptFrames *findExistingScript(char script[]) {
+    struct scriptFrames *rv;
+
+    // The script cache knows about every script even when it has no frames
+    rv = scriptsCacheLookup(script);
+    if (rv && !__atomic_load_n(&rv->FramesInUse, __ATOMIC_RELAXED)) {
+        scriptsCacheRelease(rv);
+        rv = NULL;
+    }
+
+    return rv;
+}
+
+/**
+ * Function that creates the page table struct of a script read from the
+ * stdin for background execution (the lines following the exec command).
+ * Unlike files, the length of a stream is unknown until its end is reached and
+ * its pages are read one after the other as the process executing it page
+ * faults. The caller owns a reference to the returned script.
+ *
+ * @param void
+ *
+ * @return scriptFrames page table struct of the stream
+ */
+struct scriptFrames *createStreamScript() {
+    struct scriptFrames *scriptInfo;
+    int pageIdx;
+
+    scriptInfo = (struct scriptFrames *)poolAlloc(&scriptsPool);
+    scriptInfo->scriptName = strdup("stdin");
+    scriptInfo->lengthCode = STREAM_UNKNOWN_LENGTH;
+    scriptInfo->references = 1;
+    scriptInfo->FramesInUse = 0;
+    for (pageIdx = 0; pageIdx < PAGE_TABLE_SIZE; pageIdx++) {
+        scriptInfo->pageTable[pageIdx] = PAGE_NOT_RESIDENT;
+    }
+    scriptInfo->scriptFile = NULL;
+    scriptInfo->pageOffsets = NULL;
+    scriptInfo->pageHashes = NULL;
+    scriptInfo->victimPages = 0;
+    scriptInfo->framesQuota = FRAME_NUMBER;
+    scriptInfo->workingSetRevolution = -1;
+    scriptInfo->traceId = 0;
+    scriptInfo->watchDescriptor = -1;
+    scriptInfo->isCached = 0;
+    scriptInfo->nextInBucket = NULL;
+    scriptInfo->isStream = 1;
+    scriptInfo->streamPagesRead = 0;
+    scriptInfo->streamSpills = NULL;
+
+    return scriptInfo;
+}
+
+/**
+ * Function that frees the lines kept aside for the evicted pages of a stream
+ * that were never faulted back in
+ *
+ * @param scriptInfo the struct of the stream (no longer used)
+ *
+ * @return void
+ */
+void releaseStreamSpills(struct scriptFrames *scriptInfo) {
+    struct streamSpill *spill;
+    int pageOffsetIdx;
+
+    while ((spill = scriptInfo->streamSpills)) {
+        scriptInfo->streamSpills = spill->next;
+        for (pageOffsetIdx = 0; pageOffsetIdx < spill->linesNumber; pageOffsetIdx++) {
+            free(spill->lines[pageOffsetIdx]);
+        }
+        free(spill);
+    }
+}
+
+/*** FUNCTIONS FOR THE CHECKPOINTS ***/
+
+/**
+ * Function that saves which page every frame holds and the LRU timestamps.
+ * The frames must not be changing (no job running).
+ *
+ * @param frames array of FRAME_NUMBER elements to fill (NULL script for an
+ * empty frame)
+ * @param clock set to the logical clock of the used frames
+ * @param demotionClock set to the logical clock of the demoted frames
+ *
+ * @return void
+ */
+void scriptsMemorySnapshot(struct frameSnapshot frames[], long *clock, long *demotionClock) {
+    int frameIdx;
+
+    for (frameIdx = 0; frameIdx < FRAME_NUMBER; frameIdx++) {
+        frames[frameIdx].scriptInfo = framesScript[frameIdx];
+        frames[frameIdx].pageNumber = framesPage[frameIdx];
+        frames[frameIdx].lastUsed = __atomic_load_n(&framesLastUsed[frameIdx], __ATOMIC_RELAXED);
+    }
+    *clock = __atomic_load_n(&framesClock, __ATOMIC_RELAXED);
+    *demotionClock = __atomic_load_n(&framesDemotionClock, __ATOMIC_RELAXED);
+}
+
+/**
+ * Function that puts back the pages saved by scriptsMemorySnapshot in their
+ * frames without reading them: the lines of a page are read the first time it
+ * is used (or evicted). Must be called before any script is loaded.
+ *
+ * @param frames array of FRAME_NUMBER elements (the scripts must be loaded)
+ * @param clock the logical clock of the used frames
+ * @param demotionClock the logical clock of the demoted frames
+ *
+ * @return void
+ */
+void scriptsMemoryRestore(struct frameSnapshot frames[], long clock, long demotionClock) {
+    struct scriptFrames *scriptInfo;
     int frameIdx;
-    struct scriptFrames *rv = NULL;
 
-    // Check in every frame if the associatedScript information
-    // matches with the script parameter
     for (frameIdx = 0; frameIdx < FRAME_NUMBER; frameIdx++) {
-        if (framesMetadata[frameIdx].associatedScript &&
-            strcmp(framesMetadata[frameIdx].associatedScript->scriptName, script) == 0) {
-            rv = framesMetadata[frameIdx].associatedScript;
+        scriptInfo = frames[frameIdx].scriptInfo;
+        framesLastUsed[frameIdx] = frames[frameIdx].lastUsed;
+        if (!scriptInfo) {
+            continue;
+        }
+        framesScript[frameIdx] = scriptInfo;
+        framesPage[frameIdx] = frames[frameIdx].pageNumber;
+        framesLoadPending[frameIdx] = 1;
+        scriptInfo->FramesInUse++;
+        scriptInfo->references++;
+        scriptInfo->pageTable[frames[frameIdx].pageNumber] = frameIdx;
+        if (scriptInfo->pageHashes) {
+            indexFrame(frameIdx, scriptInfo->pageHashes[frames[frameIdx].pageNumber]);
+        }
+    }
+    framesClock = clock;
+    framesDemotionClock = demotionClock;
+}
+
+/*** HELPER FUNCTIONS */
+
+/**
+ * Function that reads the lines of a restored page the first time its frame
+ * is used. The frame is pinned by the calling thread.
+ *
+ * @param frameNumber the frame of the page
+ *
+ * @return void
+ */
+void loadPendingPage(int frameNumber) {
+    pthread_mutex_lock(&framesLock[frameNumber]);
+    // Another thread may have read it while waiting for the frame
+    if (framesLoadPending[frameNumber]) {
+        loadFilePage(framesPage[frameNumber], frameNumber,
+                     framesScript[frameNumber]);
+        __atomic_store_n(&framesLoadPending[frameNumber], 0, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&framesLock[frameNumber]);
+}
+
+/**
+ * Function that returns the page table entry of a page. Streams only ever
+ * have their current page in memory so their page table is used circularly.
+ *
+ * @param pageNumber the page number of the entry
+ * @param scriptInfo the struct containing the page table
+ *
+ * @return a pointer to the page table entry
+ */
+int *pageTableEntry(int pageNumber, struct scriptFrames *scriptInfo) {
+    if (scriptInfo->isStream) {
+        return &scriptInfo->pageTable[pageNumber % PAGE_TABLE_SIZE];
+    }
+    return &scriptInfo->pageTable[pageNumber];
+}
+
+/**
+ * Function that marks a page as being loaded by the calling thread. If another
+ * thread is loading or evicting the page, it waits for it to be done.
+ *
+ * @param pageNumber the page to load
+ * @param scriptInfo the struct containing the page table
+ *
+ * @return 1 if the calling thread must load the page, 0 if it is resident
+ */
+int claimPage(int pageNumber, struct scriptFrames *scriptInfo) {
+    int *entry, frameNumber;
+
+    entry = pageTableEntry(pageNumber, scriptInfo);
+    while (1) {
+        frameNumber = PAGE_NOT_RESIDENT;
+        if (__atomic_compare_exchange_n(entry, &frameNumber, PAGE_LOADING, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return 1;
+        }
+        if (frameNumber >= 0) {
+            return 0;
+        }
+        sched_yield();
+    }
+}
+
+/**
+ * Function that silently gives back the frame of a stream page that was
+ * entirely executed. The frame becomes the least recently used one.
+ *
+ * @param pageNumber the consumed page of the stream
+ * @param scriptInfo the struct containing the page table of the stream
+ *
+ * @return void
+ */
+void releaseConsumedStreamPage(int pageNumber, struct scriptFrames *scriptInfo) {
+    int frameNumber, *entry;
+
+    entry = pageTableEntry(pageNumber, scriptInfo);
+    frameNumber = __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+    if (frameNumber < 0) {
+        return;
+    }
+
+    // Another thread may have evicted the page while waiting for the frame
+    pthread_mutex_lock(&framesLock[frameNumber]);
+    if (__atomic_load_n(entry, __ATOMIC_ACQUIRE) != frameNumber) {
+        pthread_mutex_unlock(&framesLock[frameNumber]);
+        return;
+    }
+
+    __atomic_store_n(entry, PAGE_NOT_RESIDENT, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&framesGeneration[frameNumber], 1, __ATOMIC_SEQ_CST);
+    clearPageText(frameNumber);
+    framesScript[frameNumber] = NULL;
+    __atomic_sub_fetch(&scriptInfo->FramesInUse, 1, __ATOMIC_RELAXED);
+    demoteLRURanking(frameNumber);
+    pthread_mutex_unlock(&framesLock[frameNumber]);
+
+    // The stream is still referenced by the PCB executing it
+    scriptsCacheRelease(scriptInfo);
+}
+
+/**
+ * Function that fills a frame with a page of a script file
+ *
+ * @param pageNumber the page to read
+ * @param frameNumber the frame to fill
+ * @param scriptInfo the struct containing the page table of the script
+ *
+ * @return void
+ */
+void loadFilePage(int pageNumber, int frameNumber, struct scriptFrames *scriptInfo) {
+    char line[PAGE_SIZE][MAX_USER_INPUT], *lines[PAGE_SIZE];
+    size_t lengths[PAGE_SIZE];
+    int linesNumber;
+
+    // The page may have been evicted recently
+    linesNumber = victimCacheTake(scriptInfo, pageNumber, line[0], sizeof(line), lines, lengths);
+    if (linesNumber < 0) {
+        linesNumber = readFilePage(pageNumber, scriptInfo, line, lines, lengths);
+    }
+    storePageText(frameNumber, lines, lengths, linesNumber);
+}
+
+/**
+ * Function that reads the lines of a page of a script file
+ *
+ * @param pageNumber the page to read
+ * @param scriptInfo the struct of the script
+ * @param line buffers receiving the lines
+ * @param lines set to the lines read
+ * @param lengths set to the length of every line read
+ *
+ * @return the number of lines read
+ */
+int readFilePage(int pageNumber, struct scriptFrames *scriptInfo,
+                 char line[PAGE_SIZE][MAX_USER_INPUT], char *lines[], size_t lengths[]) {
+    FILE *p;
+    int pageOffsetIdx;
+
+    // Jump directly to the page using the line index of the script
+    p = scriptInfo->scriptFile;
+    flockfile(p);
+    fseek(p, scriptInfo->pageOffsets[pageNumber], SEEK_SET);
+
+    for (pageOffsetIdx = 0; pageOffsetIdx < PAGE_SIZE; pageOffsetIdx++) {
+        line[pageOffsetIdx][0] = '\0';
+        fgets(line[pageOffsetIdx], MAX_USER_INPUT - 1, p);
+        lines[pageOffsetIdx] = line[pageOffsetIdx];
+        lengths[pageOffsetIdx] = strlen(line[pageOffsetIdx]);
+        if (feof(p)) {
+            pageOffsetIdx++;
             break;
         }
     }
+    funlockfile(p);
 
-    return rv;
+    return pageOffsetIdx;
 }
 
-/*** HELPER FUNCTIONS */
+/**
+ * Function that fills the frame assigned to a stream page either with the
+ * lines that were kept aside when it was evicted or with the next lines of the
+ * stream. The length of the stream becomes known once its end is read.
+ *
+ * @param pageNumber the stream page to fill
+ * @param frameNumber the frame to fill
+ * @param scriptInfo the struct containing the page table of the stream
+ *
+ * @return void
+ */
+void loadStreamPage(int pageNumber, int frameNumber, struct scriptFrames *scriptInfo) {
+    struct inputLine line[PAGE_SIZE];
+    char *lines[PAGE_SIZE];
+    size_t lengths[PAGE_SIZE];
+    struct streamSpill **link, *spill = NULL;
+    int pageOffsetIdx, linesNumber;
+
+    // Case where the page was read before and evicted (several pages may have
+    // been evicted before any of them faulted back in)
+    pthread_mutex_lock(&streamSpillsLock);
+    for (link = &scriptInfo->streamSpills; *link; link = &(*link)->next) {
+        if ((*link)->pageNumber == pageNumber) {
+            spill = *link;
+            *link = spill->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&streamSpillsLock);
+    if (spill) {
+        for (linesNumber = 0; linesNumber < spill->linesNumber; linesNumber++) {
+            lines[linesNumber] = spill->lines[linesNumber];
+            lengths[linesNumber] = strlen(lines[linesNumber]);
+        }
+        storePageText(frameNumber, lines, lengths, linesNumber);
+        for (pageOffsetIdx = 0; pageOffsetIdx < linesNumber; pageOffsetIdx++) {
+            free(spill->lines[pageOffsetIdx]);
+        }
+        free(spill);
+        return;
+    }
+
+    // The lines are copied straight from the input into the frame
+    for (linesNumber = 0; linesNumber < PAGE_SIZE;) {
+        inputNextLine(&line[linesNumber]);
+        lines[linesNumber] = line[linesNumber].data;
+        lengths[linesNumber] = line[linesNumber].length;
+        linesNumber++;
+        if (inputAtEnd()) {
+            scriptInfo->lengthCode = pageNumber * PAGE_SIZE + linesNumber;
+            break;
+        }
+    }
+    storePageText(frameNumber, lines, lengths, linesNumber);
+    for (pageOffsetIdx = 0; pageOffsetIdx < linesNumber; pageOffsetIdx++) {
+        inputReleaseLine(&line[pageOffsetIdx]);
+    }
+    scriptInfo->streamPagesRead++;
+}
+
+/**
+ * Function that stores the lines of a page in the text space of its frame,
+ * one after the other. The space of the frame grows if they don't fit.
+ *
+ * @param frameNumber the frame of the page
+ * @param lines the lines of the page (not null terminated)
+ * @param lengths the length of every line
+ * @param linesNumber the number of lines (the other lines of the frame are
+ * NULL)
+ *
+ * @return void
+ */
+void storePageText(int frameNumber, char *lines[], size_t lengths[], int linesNumber) {
+    size_t textSize = 0;
+    char *text;
+    int pageOffsetIdx;
+
+    for (pageOffsetIdx = 0; pageOffsetIdx < linesNumber; pageOffsetIdx++) {
+        textSize += lengths[pageOffsetIdx] + 1;
+    }
+    if (textSize > framesTextCapacity[frameNumber]) {
+        if (framesText[frameNumber] < framesTextSlab ||
+            framesText[frameNumber] >= framesTextSlab + FRAME_NUMBER * FRAME_TEXT_SIZE) {
+            free(framesText[frameNumber]);
+        }
+        framesTextCapacity[frameNumber] = (textSize + 63) & ~(size_t)63;
+        framesText[frameNumber] = (char *)aligned_alloc(64, framesTextCapacity[frameNumber]);
+    }
+
+    text = framesText[frameNumber];
+    for (pageOffsetIdx = 0; pageOffsetIdx < PAGE_SIZE; pageOffsetIdx++) {
+        if (pageOffsetIdx >= linesNumber) {
+            shellmemoryCode[frameNumber * PAGE_SIZE + pageOffsetIdx] = NULL;
+            continue;
+        }
+        memcpy(text, lines[pageOffsetIdx], lengths[pageOffsetIdx]);
+        text[lengths[pageOffsetIdx]] = '\0';
+        shellmemoryCode[frameNumber * PAGE_SIZE + pageOffsetIdx] = text;
+        text += lengths[pageOffsetIdx] + 1;
+    }
+}
+
+/**
+ * Function that empties the lines of a frame (its text space is reused by the
+ * next page)
+ *
+ * @param frameNumber the frame to empty
+ *
+ * @return void
+ */
+void clearPageText(int frameNumber) {
+    int pageOffsetIdx;
+
+    for (pageOffsetIdx = 0; pageOffsetIdx < PAGE_SIZE; pageOffsetIdx++) {
+        shellmemoryCode[frameNumber * PAGE_SIZE + pageOffsetIdx] = NULL;
+    }
+}
 
 /**
  * Function that translates virtual addresses to physical addresses given a page
@@ -260,12 +1024,12 @@ struct scriptFrames *findExistingScript(char script[]) {
  * virtual address is invalid
  */
 int virtualToPhysicalAddress(int instructionVirtualAddress, struct scriptFrames *scriptInfo) {
-    int pageNumber, frameNumber, physicalAddress, rv = -1;
+    int pageNumber, frameNumber, rv = -1;
 
     // First determine the page number 'bits'
     pageNumber = instructionVirtualAddress / PAGE_SIZE;
-    frameNumber = scriptInfo->pageTable[pageNumber];
-    // The framenumber is invalid if '-1' is stored in the page table
+    frameNumber = __atomic_load_n(pageTableEntry(pageNumber, scriptInfo), __ATOMIC_ACQUIRE);
+    // The framenumber is invalid if a negative value is stored in the page table
     if (frameNumber >= 0) {
         rv = frameNumber * 3 + (instructionVirtualAddress % PAGE_SIZE);
     }
@@ -273,29 +1037,372 @@ int virtualToPhysicalAddress(int instructionVirtualAddress, struct scriptFrames
     return rv;
 }
 
+/**
+ * Function that updates the LRU ranking by designating a new least recently
+ * used frame
+ *
+ * @param frameLeastRecentlyUsed the new frame with the oldest timestamp
+ *
+ * @return void
+ */
+void demoteLRURanking(int frameLeastRecentlyUsed) {
+    __atomic_store_n(&framesLastUsed[frameLeastRecentlyUsed],
+                     __atomic_sub_fetch(&framesDemotionClock, 1, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+}
+
 /**
  * Function that updates the LRU ranking by designating a new most recently
- * accessed frame
+ * accessed frame. Timestamps replace the ranks so that a use doesn't have to
+ * age every other frame (and can be recorded without locking). A frame that
+ * already has the newest timestamp keeps it since the ranking wouldn't change
+ * (e.g. the instructions of a page executing one after the other).
+ *
+ * @param frameMostRecentlyUsed the new frame with the newest timestamp
  *
- * @param frameMostRecentlyUsed the new frame with LRU rank '0' to be updated in the ranking
- * 
  * @return void
  */
 void updateLRURanking(int frameMostRecentlyUsed) {
-    int frameIdx, oldRank;
+    if (__atomic_load_n(&framesLastUsed[frameMostRecentlyUsed], __ATOMIC_RELAXED) ==
+        __atomic_load_n(&framesClock, __ATOMIC_RELAXED)) {
+        threadStampsSkipped++;
+        return;
+    }
+    __atomic_store_n(&framesLastUsed[frameMostRecentlyUsed],
+                     __atomic_add_fetch(&framesClock, 1, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+}
+
+/**
+ * Function that hashes the text of a page (FNV-1a). The lines are hashed one
+ * after the other, each followed by a null character.
+ *
+ * @param hash the hash of the previous lines of the page (or PAGE_HASH_SEED)
+ * @param line the next line of the page
+ * @param length the length of the line
+ *
+ * @return the hash of the page up to the line
+ */
+unsigned long hashPageLine(unsigned long hash, const char *line, size_t length) {
+    size_t charIdx;
+
+    for (charIdx = 0; charIdx < length; charIdx++) {
+        hash = (hash ^ (unsigned char)line[charIdx]) * 0x100000001b3UL;
+    }
+    return hash * 0x100000001b3UL;
+}
+
+/**
+ * Function that maps a page to a resident frame with the same content. The
+ * page is claimed by the calling thread (see claimPage).
+ *
+ * @param pageNumber the page to map
+ * @param scriptInfo the struct containing the page table of the page
+ *
+ * @return 1 if the page was mapped, 0 if it needs a frame of its own
+ */
+int mapSharedPage(int pageNumber, struct scriptFrames *scriptInfo) {
+    char line[PAGE_SIZE][MAX_USER_INPUT], *lines[PAGE_SIZE], *instruction;
+    size_t lengths[PAGE_SIZE];
+    unsigned long hash;
+    int frameNumber, linesNumber, pageOffsetIdx;
+    struct frameMapping *sharer;
+
+    hash = scriptInfo->pageHashes[pageNumber];
+    pthread_mutex_lock(&dedupLock);
+    for (frameNumber = dedupBuckets[hash % FRAME_NUMBER]; frameNumber >= 0;
+         frameNumber = framesNextInBucket[frameNumber]) {
+        if (framesHash[frameNumber] == hash) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dedupLock);
+    if (frameNumber < 0) {
+        return 0;
+    }
+
+    // The frame may be replaced while the page is read (in which case the page
+    // simply gets a frame of its own)
+    linesNumber = readFilePage(pageNumber, scriptInfo, line, lines, lengths);
+    if (pthread_mutex_trylock(&framesLock[frameNumber])) {
+        return 0;
+    }
+    if (!framesScript[frameNumber] || !framesIsIndexed[frameNumber] ||
+        framesHash[frameNumber] != hash || framesLoadPending[frameNumber]) {
+        pthread_mutex_unlock(&framesLock[frameNumber]);
+        return 0;
+    }
+    // Identical hashes don't guarantee identical lines
+    for (pageOffsetIdx = 0; pageOffsetIdx < PAGE_SIZE; pageOffsetIdx++) {
+        instruction = shellmemoryCode[frameNumber * PAGE_SIZE + pageOffsetIdx];
+        if (pageOffsetIdx >= linesNumber ? instruction != NULL
+                                         : !instruction || strcmp(instruction, lines[pageOffsetIdx])) {
+            pthread_mutex_unlock(&framesLock[frameNumber]);
+            return 0;
+        }
+    }
+
+    sharer = (struct frameMapping *)poolAlloc(&sharersPool);
+    sharer->scriptInfo = scriptInfo;
+    sharer->pageNumber = pageNumber;
+    sharer->next = framesSharers[frameNumber];
+    framesSharers[frameNumber] = sharer;
+    __atomic_add_fetch(&scriptInfo->FramesInUse, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&scriptInfo->references, 1, __ATOMIC_RELAXED);
+    updateLRURanking(frameNumber);
+
+    __atomic_store_n(pageTableEntry(pageNumber, scriptInfo), frameNumber, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&framesLock[frameNumber]);
+    traceEmit(TRACE_PAGE_IN, 0, pageNumber, frameNumber, scriptInfo);
+
+    return 1;
+}
+
+/**
+ * Function that adds a frame to the index of the page hashes. The frame is
+ * locked by the calling thread.
+ *
+ * @param frameNumber the frame to index
+ * @param hash the hash of its page
+ *
+ * @return void
+ */
+void indexFrame(int frameNumber, unsigned long hash) {
+    pthread_mutex_lock(&dedupLock);
+    framesHash[frameNumber] = hash;
+    framesNextInBucket[frameNumber] = dedupBuckets[hash % FRAME_NUMBER];
+    dedupBuckets[hash % FRAME_NUMBER] = frameNumber;
+    framesIsIndexed[frameNumber] = 1;
+    pthread_mutex_unlock(&dedupLock);
+}
+
+/**
+ * Function that removes a frame from the index of the page hashes (if it is
+ * indexed). The frame is locked by the calling thread.
+ *
+ * @param frameNumber the frame to remove
+ *
+ * @return void
+ */
+void unindexFrame(int frameNumber) {
+    int *link;
+
+    if (!framesIsIndexed[frameNumber]) {
+        return;
+    }
+    pthread_mutex_lock(&dedupLock);
+    for (link = &dedupBuckets[framesHash[frameNumber] % FRAME_NUMBER]; *link != frameNumber;
+         link = &framesNextInBucket[*link]) {
+    }
+    *link = framesNextInBucket[frameNumber];
+    framesIsIndexed[frameNumber] = 0;
+    pthread_mutex_unlock(&dedupLock);
+}
+
+/**
+ * Function that prints the statistics of the TLBs (see fetchInstructionVirtual)
+ * and of the LRU timestamps skipped (see updateLRURanking)
+ * @param void
+ * @return void
+ */
+void scriptsMemoryPrintStats() {
+    unsigned long hits, misses;
+
+    hits = __atomic_load_n(&tlbHits, __ATOMIC_RELAXED) + threadTLBHits;
+    misses = __atomic_load_n(&tlbMisses, __ATOMIC_RELAXED) + threadTLBMisses;
+    shellPrintf("TLB: %lu hits, %lu misses (%.1f%% hit rate), %lu LRU stamps skipped\n",
+                hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+                __atomic_load_n(&stampsSkipped, __ATOMIC_RELAXED) + threadStampsSkipped);
+#ifdef FRAME_QUOTAS
+    pthread_mutex_lock(&quotaLock);
+    shellPrintf("Frame quotas: %lu local replacements, %ld revolutions of the hand\n",
+                localReplacements, quotaRevolution);
+    pthread_mutex_unlock(&quotaLock);
+#endif
+}
+
+/**
+ * Function that counts a lookup in the TLB of the running thread
+ *
+ * @param isHit whether the translation was cached
+ *
+ * @return void
+ */
+void countTLBLookup(int isHit) {
+    if (isHit) {
+        threadTLBHits++;
+    } else {
+        threadTLBMisses++;
+    }
+    if (threadTLBHits + threadTLBMisses < TLB_STATS_FLUSH) {
+        return;
+    }
+    __atomic_add_fetch(&tlbHits, threadTLBHits, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&tlbMisses, threadTLBMisses, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stampsSkipped, threadStampsSkipped, __ATOMIC_RELAXED);
+    threadTLBHits = 0;
+    threadTLBMisses = 0;
+    threadStampsSkipped = 0;
+}
+
+/**
+ * Function that returns the entry of the TLB caching the translation of a page.
+ * The script is part of the index so that the first pages of the scripts
+ * running in turn don't evict each other.
+ *
+ * @param pageNumber the page number
+ * @param scriptInfo the struct of the script of the page
+ *
+ * @return the index of the entry
+ */
+int tlbSlot(int pageNumber, struct scriptFrames *scriptInfo) {
+    uintptr_t script = (uintptr_t)scriptInfo / sizeof(struct scriptFrames);
 
-    oldRank = framesMetadata[frameMostRecentlyUsed].LRU_idx;
+    return (int)((script * 0x9E3779B1u + (unsigned int)pageNumber) % TLB_ENTRIES);
+}
+
+/**
+ * Function that returns the LRU frame among the frames of a script (its
+ * sharers aside). The caller holds quotaLock.
+ *
+ * @param scriptInfo the struct of the script
+ *
+ * @return the frame index (locked by the calling thread) or -1 if every frame
+ * of the script is pinned or busy
+ */
+int findLocalLRUFrame(struct scriptFrames *scriptInfo) {
+    int frameIdx, LRUFrame = -1;
+    long oldest, lastUsed;
 
-    // Loop over the frames to update the ranking if needed
     for (frameIdx = 0; frameIdx < FRAME_NUMBER; frameIdx++) {
-        // Case where the frame was ranked more recently used that the
-        // frameMostRecentlyUsed
-        if (framesMetadata[frameIdx].LRU_idx < oldRank) {
-            // Update the ranking to "age" the frames concerned
-            framesMetadata[frameIdx].LRU_idx++;
-        } else if (framesMetadata[frameIdx].LRU_idx == oldRank) {
-            // Set the new most recently used frame's LRU rank
-            framesMetadata[frameIdx].LRU_idx = 0;
+        if (__atomic_load_n(&framesScript[frameIdx], __ATOMIC_RELAXED) != scriptInfo ||
+            __atomic_load_n(&framesPins[frameIdx], __ATOMIC_RELAXED)) {
+            continue;
+        }
+        lastUsed = __atomic_load_n(&framesLastUsed[frameIdx], __ATOMIC_RELAXED);
+        if (LRUFrame >= 0 && lastUsed >= oldest) {
+            continue;
+        }
+        if (pthread_mutex_trylock(&framesLock[frameIdx])) {
+            continue;
+        }
+        // The page may have been replaced before the frame got locked
+        if (framesScript[frameIdx] != scriptInfo) {
+            pthread_mutex_unlock(&framesLock[frameIdx]);
+            continue;
+        }
+        if (LRUFrame >= 0) {
+            pthread_mutex_unlock(&framesLock[LRUFrame]);
+        }
+        LRUFrame = frameIdx;
+        oldest = lastUsed;
+    }
+
+    return LRUFrame;
+}
+
+/**
+ * Function that moves the WSClock hand over the next frames, counting the
+ * frames used during the last WORKING_SET_WINDOW LRU timestamps in the working
+ * set of their script. The quotas are recomputed whenever the hand completes
+ * a revolution. The caller holds quotaLock.
+ * @param void
+ * @return void
+ */
+void advanceQuotaHand() {
+    int frameNumber, step;
+    long clock, lastUsed;
+    struct scriptFrames *owner;
+
+    clock = __atomic_load_n(&framesClock, __ATOMIC_RELAXED);
+    for (step = 0; step < QUOTA_HAND_STEPS; step++) {
+        frameNumber = quotaHand;
+        quotaHand = quotaHand + 1 < FRAME_NUMBER ? quotaHand + 1 : 0;
+        if (!quotaHand) {
+            rebalanceQuotas();
+        }
+        // The owner of a locked frame can't be freed
+        if (pthread_mutex_trylock(&framesLock[frameNumber])) {
+            continue;
+        }
+        owner = framesScript[frameNumber];
+        lastUsed = __atomic_load_n(&framesLastUsed[frameNumber], __ATOMIC_RELAXED);
+        if (owner && lastUsed > 0 && clock - lastUsed <= WORKING_SET_WINDOW) {
+            countWorkingSetFrame(owner);
+        }
+        pthread_mutex_unlock(&framesLock[frameNumber]);
+    }
+}
+
+/**
+ * Function that counts a frame of the working set of a script passed over by
+ * the WSClock hand. The caller holds quotaLock and the lock of the frame.
+ *
+ * @param scriptInfo the struct of the script owning the frame
+ *
+ * @return void
+ */
+void countWorkingSetFrame(struct scriptFrames *scriptInfo) {
+    if (scriptInfo->workingSetRevolution != quotaRevolution) {
+        scriptInfo->workingSetRevolution = quotaRevolution;
+        scriptInfo->workingSetFrames = 0;
+        // Keep the script until its quota is recomputed
+        __atomic_add_fetch(&scriptInfo->references, 1, __ATOMIC_RELAXED);
+        quotaScripts[quotaScriptsNumber++] = scriptInfo;
+    }
+    scriptInfo->workingSetFrames++;
+}
+
+/**
+ * Function that recomputes the quotas of the scripts seen by the WSClock hand
+ * once it completed a revolution. The frames are shared out by water filling:
+ * the smallest working sets are granted first and the largest ones split what
+ * is left. A script may still keep its fair share of the frames (or all of
+ * its pages if it is smaller) so that short scripts aren't confined to their
+ * working set. The caller holds quotaLock.
+ * @param void
+ * @return void
+ */
+void rebalanceQuotas() {
+    int scriptIdx, framesLeft = FRAME_NUMBER, quota, share;
+    struct scriptFrames *scriptInfo;
+
+    qsort(quotaScripts, quotaScriptsNumber, sizeof(struct scriptFrames *), compareWorkingSets);
+    for (scriptIdx = 0; scriptIdx < quotaScriptsNumber; scriptIdx++) {
+        scriptInfo = quotaScripts[scriptIdx];
+        quota = scriptInfo->workingSetFrames + QUOTA_GROWTH;
+        share = framesLeft / (quotaScriptsNumber - scriptIdx);
+        if (quota > share) {
+            quota = share;
+        }
+        share = FRAME_NUMBER / quotaScriptsNumber;
+        if (share > scriptInfo->lengthCode / PAGE_SIZE + 1) {
+            share = scriptInfo->lengthCode / PAGE_SIZE + 1;
+        }
+        if (quota < share) {
+            quota = share;
+        }
+        if (quota < QUOTA_MIN_FRAMES) {
+            quota = QUOTA_MIN_FRAMES;
         }
+        scriptInfo->framesQuota = quota;
+        framesLeft -= quota;
+        scriptsCacheRelease(scriptInfo);
     }
+    quotaScriptsNumber = 0;
+    quotaRevolution++;
+}
+
+/**
+ * Comparator for qsort of the scripts by size of working set
+ *
+ * @param script1 pointer to the first script
+ * @param script2 pointer to the second script
+ *
+ * @return negative, zero or positive as the first working set is smaller,
+ * as large or larger than the second
+ */
+int compareWorkingSets(const void *script1, const void *script2) {
+    return (*(struct scriptFrames *const *)script1)->workingSetFrames -
+           (*(struct scriptFrames *const *)script2)->workingSetFrames;
 }
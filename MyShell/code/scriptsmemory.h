@@ -1,3 +1,8 @@
+#include <limits.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
+
 #define PAGE_SIZE 3
 #define PAGE_TABLE_SIZE 100
 
@@ -5,18 +10,107 @@
 #define FRAME_STORE_SIZE 99
 #endif
 
-#define FRAME_NUMBER FRAME_STORE_SIZE/PAGE_SIZE
+#define FRAME_NUMBER (FRAME_STORE_SIZE / PAGE_SIZE)
+
+// Bytes of the text slab reserved for the lines of every frame (a multiple of
+// the cache line size)
+#ifndef FRAME_TEXT_SIZE
+#define FRAME_TEXT_SIZE 128
+#endif
+
+// Number of translations cached by the TLB of every thread
+#ifndef TLB_ENTRIES
+#define TLB_ENTRIES 16
+#endif
+// Number of TLB lookups a thread counts before adding them to the totals
+#define TLB_STATS_FLUSH 4096
+
+// Frame quotas (make quotas=1): a page used during the last
+// WORKING_SET_WINDOW LRU timestamps belongs to the working set of its script.
+// A script is granted its working set plus QUOTA_GROWTH frames (at least
+// QUOTA_MIN_FRAMES) and scripts with small working sets are served first. The
+// WSClock hand estimating the working sets inspects QUOTA_HAND_STEPS frames
+// on every page fault.
+#ifndef WORKING_SET_WINDOW
+#define WORKING_SET_WINDOW 8
+#endif
+#define QUOTA_MIN_FRAMES 2
+#define QUOTA_GROWTH 1
+#define QUOTA_HAND_STEPS 4
+
+// Initial value of the hash of a page (see hashPageLine)
+#define PAGE_HASH_SEED 0xcbf29ce484222325UL
+
+// Length of a streamed script (stdin) until its end is reached
+#define STREAM_UNKNOWN_LENGTH INT_MAX
+
+// Page table entries that aren't a frame number
+#define PAGE_NOT_RESIDENT -1
+#define PAGE_LOADING -2   // A thread is reading the page into a frame
+#define PAGE_EVICTING -3  // A thread is evicting the page from its frame
+
+// Lines of an evicted stream page, kept until the page faults back in since
+// the stream can't be read again
+struct streamSpill {
+    int pageNumber;
+    int linesNumber;
+    char *lines[PAGE_SIZE];
+    struct streamSpill *next;
+};
 
 struct scriptFrames {
     char *scriptName;
     int lengthCode;
-    int pageTable[PAGE_TABLE_SIZE];
-    int PCBsInUse;
-    int FramesInUse;
+    int pageTable[PAGE_TABLE_SIZE];  // Accessed atomically
+    // Number of PCBs, frames and lookups using the script (accessed
+    // atomically, see scriptsCacheRelease)
+    int references;
+    int FramesInUse;  // Accessed atomically
+    // Script cache related fields (see scriptscache.c)
+    FILE *scriptFile;   // NULL for streams and idle scripts
+    long *pageOffsets;  // Byte offset of the first line of every page
+    // Hash of the content of every page (NULL without deduplication)
+    unsigned long *pageHashes;
+    int victimPages;  // Pages in the victim cache (guarded by its lock)
+    int traceId;      // Id in the page-reference traces or 0 (see traceReference)
+    // Frame quota related fields (guarded by quotaLock, see findQuotaFrame)
+    int framesQuota;
+    int workingSetFrames;       // Frames in the working set seen by the hand
+    long workingSetRevolution;  // Revolution of the hand they were counted in
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modificationTime;
+    int watchDescriptor;
+    int isCached;  // Whether the script is still reachable from the cache
+    unsigned long lastUsed;
+    struct scriptFrames *nextInBucket;
+    // Stream related fields (only relevant if isStream)
+    int isStream;
+    int streamPagesRead;
+    struct streamSpill *streamSpills;  // Evicted pages not faulted back in yet
+};
+
+// Page held by a frame saved in a checkpoint (see checkpoint.c)
+struct frameSnapshot {
+    struct scriptFrames *scriptInfo;  // NULL if the frame is empty
+    int pageNumber;
+    long lastUsed;
 };
 
 void scripts_memory_init();
 char *fetchInstructionVirtual(int instructionVirtualAddress, struct scriptFrames *scriptInfo);
-void updateInstructionVirtual(int instructionVirtualAddress, struct scriptFrames *scriptInfo, char newInstruction[]);
+void releaseInstructionVirtual(int instructionVirtualAddress, struct scriptFrames *scriptInfo);
 void pageAssignment(int pageNumber, struct scriptFrames *scriptInfo, int setup);
+int virtualToPhysicalAddress(int instructionVirtualAddress, struct scriptFrames *scriptInfo);
 struct scriptFrames *findExistingScript(char script[]);
+struct scriptFrames *createStreamScript();
+void releaseStreamSpills(struct scriptFrames *scriptInfo);
+void scriptsMemorySnapshot(struct frameSnapshot frames[], long *clock, long *demotionClock);
+void scriptsMemoryRestore(struct frameSnapshot frames[], long clock, long demotionClock);
+int countColdFrames();
+void releaseScriptFrames(struct scriptFrames *scriptInfo);
+unsigned long hashPageLine(unsigned long hash, const char *line, size_t length);
+void scriptsMemoryPrintStats();
+
+extern struct pool sharersPool;
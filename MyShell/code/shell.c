@@ -1,141 +1,134 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #include "shell.h"
+#include "input.h"
 #include "interpreter.h"
-#include "scheduler.h"
-#include "scriptsmemory.h"
-#include "shellmemory.h"
 
 /*** FUNCTION SIGNATURES ***/
 
 int parseInput(char ui[]);
 int convertInputToOneLiners(char input[]);
+int executeCommands(char commands[], int commandsNumber);
 int wordEnding(char c);
-int countChar(char input[], char search);
+
+/*** PARSING FUNCTIONS ***/
 
 /**
- * Start of everything
+ * Converts a single line of commands into executable statements.
+ * This function takes a string containing multiple commands separated by
+ * semicolons (';') and processes each command to execute them one by one.
+ * The line is copied once since it may be an instruction stored in a frame.
  *
- * @param argc The number of command-line arguments passed to the program.
- * @param argv An array of pointers to the command-line arguments.
- * @return Returns an integer status code, 0 for success
+ * @param input A string containing commands separated by semicolons.
+ * @return Returns 0 on success, or a non-zero value on failure.
  */
-int main(int argc, char *argv[]) {
-    printf("Frame Store Size = %d; Variable Store Size = %d\n", FRAME_STORE_SIZE, VAR_MEMSIZE);
-    // help();  //Not printing the help text anymore at start of shell
-
-    char prompt = '$';               // Shell prompt
-    char userInput[MAX_USER_INPUT];  // user's input stored here
-    int errorCode = 0;               // zero means no error, default
+int convertInputToOneLiners(char input[]) {
+    char localCopy[MAX_USER_INPUT + 1], *commands = localCopy, *separator;
+    size_t length = strlen(input);
+    int commandsNumber = 1, errorCode;
 
-    // initialize user input
-    for (int i = 0; i < MAX_USER_INPUT; i++) {
-        userInput[i] = '\0';
+    if (length >= sizeof(localCopy)) {
+        commands = (char *)malloc(length + 1);
     }
+    memcpy(commands, input, length + 1);
 
-    // initialize shell memory array and associated concurrency variable
-    mem_init();
-    // initialize scheduler scripts memory array and associated concurrency
-    // variables
-    scheduler_init();
-    // initialize memory for scripts and associated concurrency variables
-    scripts_memory_init();
-
-    while (1) {
-        // In batch mode, check if eof is reached in which case we quit
-        if (feof(stdin)) {
+    // Terminate every command in place
+    for (separator = commands; (separator = strpbrk(separator, ";\n")); separator++) {
+        if (*separator == '\n') {
+            *separator = '\0';
             break;
         }
-
-        // if print the prompt only if the stdin is pointing to terminal
-        if (isatty(fileno(stdin))) {
-            printf("%c ", prompt);
-        }
-
-        fgets(userInput, MAX_USER_INPUT - 1, stdin);
-        convertInputToOneLiners(userInput);
-        memset(userInput, 0, sizeof(userInput));
+        *separator = '\0';
+        commandsNumber++;
     }
+    errorCode = executeCommands(commands, commandsNumber);
 
-    return 0;
+    if (commands != localCopy) {
+        free(commands);
+    }
+    return errorCode;
 }
 
-/*** PARSING FUNCTIONS ***/
-
 /**
- * Converts a single line of commands into executable statements.
- * This function takes a string containing multiple commands separated by
- * semicolons (';') and processes each command to execute them one by one.
+ * Executes a line of the stdin in place: its separators were found when it
+ * was read so its commands are only terminated where they end.
  *
- * @param input A string containing commands separated by semicolons.
+ * @param line The line to execute (modified).
  * @return Returns 0 on success, or a non-zero value on failure.
  */
-int convertInputToOneLiners(char input[]) {
-    int count;
-    char *start = input;
-    int errorCode = 0;  // zero means no error, default
-    int tokenCommandLen, inputRemainingLen;
+int executeInputLine(struct inputLine *line) {
+    size_t separatorIdx;
 
-    if (strlen(input) > MAX_USER_INPUT) {
-        return 1;  // Error, more than 1000 char
+    for (separatorIdx = 0; separatorIdx < line->separatorsNumber; separatorIdx++) {
+        line->data[line->separators[separatorIdx]] = '\0';
     }
-    count = countChar(input, ';');
-    if (count > 9) {
-        return 2;  // Error, more than 10 command
+    if (line->length > 0 && line->data[line->length - 1] == '\n') {
+        line->data[line->length - 1] = '\0';
+    } else {
+        line->data[line->length] = '\0';
     }
-    // strcspn(start, ";") will output length of the string if it doesn't find
-    // ";"
-    do {
-        tokenCommandLen = strcspn(start, ";");
-        inputRemainingLen = strlen(start);
-        // Temporary place to store the command to be called
-        char temp[MAX_USER_INPUT + 1];
-        // Store in temp the string from the pointer start to the index of 1st
-        // ";"
-        strncpy(temp, start, tokenCommandLen);
-        temp[tokenCommandLen] = '\0';  // Null-terminate the substring
-
-        errorCode = parseInput(temp);   // Copied from the original code
+
+    return executeCommands(line->data, line->separatorsNumber + 1);
+}
+
+/**
+ * Executes commands stored one after the other, each null terminated.
+ *
+ * @param commands The first command.
+ * @param commandsNumber The number of commands.
+ * @return Returns the error code of the last command.
+ */
+int executeCommands(char commands[], int commandsNumber) {
+    char *nextCommand;
+    int commandIdx, errorCode = 0;
+
+    for (commandIdx = 0; commandIdx < commandsNumber; commandIdx++) {
+        // The command is split in place by parseInput
+        nextCommand = commands + strlen(commands) + 1;
+        errorCode = parseInput(commands);
         if (errorCode == -1) exit(99);  // ignore all other errors
-        start += tokenCommandLen + 1;   // Move the pointer to go after the ";"
-    } while (tokenCommandLen < inputRemainingLen);
+        commands = nextCommand;
+    }
     return errorCode;
 }
 
 /**
  * The function takes as input a string containing the command and associated
- * arguments and it executes it.
+ * arguments and it executes it. The words are split in place.
  *
  * @param inp A string containing the command and arguments.
  * @return Returns 0 on success, or a non-zero value on failure.
  */
 int parseInput(char inp[]) {
-    char tmp[MAX_TOKEN_SIZE], *words[100];
-    int ix = 0, w = 0, wordlen, errorCode, token_idx;
+    char *localWords[LOCAL_WORDS_NUMBER], **words = localWords, ending;
+    int ix = 0, w = 0, wordsCapacity = LOCAL_WORDS_NUMBER, errorCode;
 
     // skip white spaces
-    for (ix = 0; inp[ix] == ' ' && ix < MAX_USER_INPUT; ix++);
-    while (inp[ix] != '\n' && inp[ix] != '\0' && ix < MAX_USER_INPUT) {
-        // extract a word
-        for (wordlen = 0; !wordEnding(inp[ix]) && ix < MAX_USER_INPUT &&
-                          wordlen < MAX_TOKEN_SIZE - 1;
-             ix++, wordlen++) {
-            tmp[wordlen] = inp[ix];
+    for (ix = 0; inp[ix] == ' '; ix++);
+    while (inp[ix] != '\n' && inp[ix] != '\0') {
+        if (w == wordsCapacity) {
+            wordsCapacity *= 2;
+            if (words == localWords) {
+                words = (char **)malloc(wordsCapacity * sizeof(char *));
+                memcpy(words, localWords, sizeof(localWords));
+            } else {
+                words = (char **)realloc(words, wordsCapacity * sizeof(char *));
+            }
         }
-        tmp[wordlen] = '\0';
-        words[w] = strdup(tmp);
-        w++;
-        if (inp[ix] == '\0') break;
+        // extract a word
+        words[w++] = inp + ix;
+        for (; !wordEnding(inp[ix]); ix++);
+        ending = inp[ix];
+        inp[ix] = '\0';
+        if (ending != ' ') break;
         ix++;
     }
     errorCode = interpreter(words, w);
 
-    // free allocated memory for input tokens
-    for (token_idx = 0; token_idx < w; token_idx++) {
-        free(words[token_idx]);
+    if (words != localWords) {
+        free(words);
     }
 
     return errorCode;
@@ -151,21 +144,3 @@ int parseInput(char inp[]) {
  * otherwise returns 0 (false)
  */
 int wordEnding(char c) { return c == '\0' || c == '\n' || c == ' '; }
-
-/**
- * Function that determines how many "search" chars are in the string "input"
- *
- * @param input A string in which to count occurrences of the character.
- * @param search The character to search from within the input string.
- * @return Returns the number of times the specified character appears in the
- * string.
- */
-int countChar(char input[], char search) {
-    int count = 0;
-    for (int i = 0; input[i] != '\0'; i++) {
-        if (input[i] == search) {
-            count++;
-        }
-    }
-    return count;
-}
\ No newline at end of file
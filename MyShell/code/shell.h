@@ -1,3 +1,8 @@
 #define MAX_USER_INPUT 1000
+// Number of words of a command parsed without allocating
+#define LOCAL_WORDS_NUMBER 100
+
+struct inputLine;
 
 int convertInputToOneLiners(char input[]);
+int executeInputLine(struct inputLine *line);
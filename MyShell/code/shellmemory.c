@@ -1,14 +1,44 @@
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "shell.h"
 #include "shellmemory.h"
 
+typedef enum valueKind_t {
+    VALUE_INLINE = 0,  // Short value stored in the variable
+    VALUE_SHARED,      // Reference-counted value on the heap
+    VALUE_MAPPED       // Value read in place from the attached variables file
+} valueKind_t;
+
+// Variable whose value is stored once as a length-prefixed string (its tokens
+// joined by spaces) with the end of every token recorded
 struct memory_struct {
     char *var;
-    char *value[MAX_VALUE_SIZE];
+    size_t length;
+    int tokensNumber;
+    size_t tokenEnds[MAX_VALUE_SIZE];
+    valueKind_t kind;
+    union {
+        char inlineData[VALUE_INLINE_SIZE];
+        struct sharedValue *shared;
+        const char *mapped;
+    } value;
+};
+
+// Header of a variables file, followed by one record per variable:
+//   uint32 nameLength, uint32 valueLength, uint32 tokensNumber,
+//   uint32 tokenEnds[tokensNumber], name + '\0', value + '\0'
+// padded to a multiple of 4 bytes (native byte order)
+struct varsFileHeader {
+    char magic[8];
+    unsigned int variablesNumber;
+    unsigned int reserved;
 };
 
 // Mutex lock used whenever the array for variables is accessed
@@ -16,9 +46,18 @@ pthread_mutex_t memoryVariableArrayLock;
 
 struct memory_struct shellmemory[VAR_MEMSIZE];
 
+// Variables file attached with mem_attach_file (mapped for the whole run so
+// that its values can be used in place) and written back by mem_sync_file
+char *attachedFileName = NULL;
+
 /*** FUNCTION SIGNATURES ***/
 
 void mem_clear_value(int mem_idx);
+int mem_get_variable_index_locked(char *var_in);
+int isValueInline(size_t length);
+int mem_store_value(char *var_in, struct memory_struct *newValue);
+int mem_read_records(const char *data, size_t size, int isMapped);
+const char *mem_map_file(char *fileName, size_t *size);
 
 /** SHELL MEMORY FUNCTIONS */
 
@@ -30,12 +69,12 @@ void mem_clear_value(int mem_idx);
  */
 void mem_init() {
     // Initialize variable and code shellmemory
-    int mem_idx, val_idx;
+    int mem_idx;
     for (mem_idx = 0; mem_idx < VAR_MEMSIZE; mem_idx++) {
         shellmemory[mem_idx].var = NULL;
-        for (val_idx = 0; val_idx < MAX_VALUE_SIZE; val_idx++) {
-            shellmemory[mem_idx].value[val_idx] = NULL;
-        }
+        shellmemory[mem_idx].length = 0;
+        shellmemory[mem_idx].tokensNumber = 0;
+        shellmemory[mem_idx].kind = VALUE_INLINE;
     }
 
     pthread_mutex_init(&memoryVariableArrayLock, NULL);
@@ -54,34 +93,43 @@ void mem_init() {
  * @return void
  */
 void mem_set_value(char *var_in, char *values_in[], int number_values) {
-    int mem_idx, val_idx, wasSet = 0;
+    struct memory_struct newValue;
+    size_t length = 0, tokenLength;
+    char *data;
+    int val_idx;
 
-    // If variable exists, we overwrite the values
-    for (mem_idx = 0; mem_idx < VAR_MEMSIZE; mem_idx++) {
-        pthread_mutex_lock(&memoryVariableArrayLock);
-        // Check to see if memory spot was not initialized (in which case we
-        // reached the end of initialized variables) or whether the memory spot
-        // corresponds to the variable passed as argument
-        if (shellmemory[mem_idx].var == NULL ||
-            strcmp(shellmemory[mem_idx].var, var_in) == 0) {
-            // Case where we reached end of known variables
-            if (shellmemory[mem_idx].var ==NULL) {
-                // Create our new variable in this spot
-                shellmemory[mem_idx].var = strdup(var_in);
-            } else {  // Case where variable already existed
-                // clear the old values of variable appropriately
-                mem_clear_value(mem_idx);
-            }
-            // In either case we populate the new values
-            for (val_idx = 0; val_idx < number_values; val_idx++) {
-                shellmemory[mem_idx].value[val_idx] = strdup(values_in[val_idx]);
-            }
-            wasSet = 1;
-        }
-        pthread_mutex_unlock(&memoryVariableArrayLock);
-        if (wasSet) {
-            break;
+    // Measure the value then assemble it (outside of the lock) where it is
+    // going to be stored
+    for (val_idx = 0; val_idx < number_values; val_idx++) {
+        length += strlen(values_in[val_idx]) + (val_idx != 0);
+    }
+    if (isValueInline(length)) {
+        newValue.kind = VALUE_INLINE;
+        data = newValue.value.inlineData;
+    } else {
+        newValue.kind = VALUE_SHARED;
+        newValue.value.shared =
+            (struct sharedValue *)malloc(sizeof(struct sharedValue) + length + 1);
+        newValue.value.shared->references = 1;
+        data = newValue.value.shared->data;
+    }
+    length = 0;
+    for (val_idx = 0; val_idx < number_values; val_idx++) {
+        // Adding space between the values of a variable
+        if (val_idx != 0) {
+            data[length++] = ' ';
         }
+        tokenLength = strlen(values_in[val_idx]);
+        memcpy(data + length, values_in[val_idx], tokenLength);
+        length += tokenLength;
+        newValue.tokenEnds[val_idx] = length;
+    }
+    data[length] = '\0';
+    newValue.length = length;
+    newValue.tokensNumber = number_values;
+
+    if (mem_store_value(var_in, &newValue) && newValue.kind == VALUE_SHARED) {
+        free(newValue.value.shared);  // The variable store is full
     }
 }
 
@@ -96,9 +144,296 @@ void mem_set_value(char *var_in, char *values_in[], int number_values) {
  * variable is not found.
  */
 int mem_get_variable_index(char *var_in) {
-    int mem_idx, val_idx, ret_idx = -1;
+    int ret_idx;
+
+    pthread_mutex_lock(&memoryVariableArrayLock);
+    ret_idx = mem_get_variable_index_locked(var_in);
+    pthread_mutex_unlock(&memoryVariableArrayLock);
+
+    return ret_idx;
+}
+
+/**
+ * This function takes an input key (variable name) and gives read access to
+ * its value without copying it (except for short values) so that it can be
+ * printed once the lock is released. The view must be released with
+ * mem_release_value.
+ *
+ * @param var_in A pointer to a string representing the input key (variable
+ * name).
+ * @param view A pointer to the view to fill with the value.
+ * @return 0 if the variable exists, -1 otherwise (the view is left empty)
+ */
+int mem_get_value(char *var_in, struct valueView *view) {
+    struct memory_struct *variable;
+    int mem_idx;
+
+    view->data = NULL;
+    view->length = 0;
+    view->tokensNumber = 0;
+    view->shared = NULL;
+
+    // The variable is looked up and read under the same lock so that a
+    // concurrent set can't replace it in between
+    pthread_mutex_lock(&memoryVariableArrayLock);
+    mem_idx = mem_get_variable_index_locked(var_in);
+    if (mem_idx < 0) {
+        pthread_mutex_unlock(&memoryVariableArrayLock);
+        return -1;
+    }
+    variable = &shellmemory[mem_idx];
+    view->length = variable->length;
+    view->tokensNumber = variable->tokensNumber;
+    if (variable->kind == VALUE_INLINE) {
+        memcpy(view->inlineCopy, variable->value.inlineData, variable->length + 1);
+        view->data = view->inlineCopy;
+    } else if (variable->kind == VALUE_MAPPED) {
+        // The file stays mapped until the shell exits
+        view->data = variable->value.mapped;
+    } else {
+        // The value stays alive until the view is released even if the
+        // variable is set again in the meantime
+        view->shared = variable->value.shared;
+        __atomic_add_fetch(&view->shared->references, 1, __ATOMIC_RELAXED);
+        view->data = view->shared->data;
+    }
+    pthread_mutex_unlock(&memoryVariableArrayLock);
+
+    return 0;
+}
+
+/**
+ * This function releases the access to a value given by mem_get_value
+ *
+ * @param view A pointer to the view to release.
+ * @return void
+ */
+void mem_release_value(struct valueView *view) {
+    if (view->shared &&
+        __atomic_sub_fetch(&view->shared->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(view->shared);
+    }
+    view->shared = NULL;
+}
+
+/*** FUNCTIONS FOR VARIABLES FILES ***/
+
+/**
+ * This function attaches a variables file to the shell memory: the variables
+ * it holds are defined without copying their values (they are read in place
+ * from the mapped file) and the file is rewritten with the variables of the
+ * shell by mem_sync_file. A file that doesn't exist yet is created then.
+ *
+ * The file isn't attached (so never rewritten) unless all of its variables
+ * could be defined.
+ *
+ * @param fileName A pointer to the name of the variables file.
+ * @return 0 on success, 1 if the file exists but isn't a valid variables file,
+ * 2 if it holds more variables than the variable store
+ */
+int mem_attach_file(char *fileName) {
+    const char *data;
+    size_t size;
+    int errorCode;
+
+    // A file that doesn't exist (or is empty) is created when syncing
+    data = mem_map_file(fileName, &size);
+    if (data == NULL && size != 0) {
+        return 1;
+    }
+    if (data != NULL && (errorCode = mem_read_records(data, size, 1))) {
+        return errorCode;
+    }
+
+    attachedFileName = strdup(fileName);
+    return 0;
+}
+
+/**
+ * This function writes the variables back to the attached variables file (if
+ * any). It is called when the shell exits.
+ * @param void
+ * @return void
+ */
+void mem_sync_file() {
+    if (attachedFileName) {
+        mem_save_file(attachedFileName);
+    }
+}
+
+/**
+ * This function writes all the variables into a variables file in a single
+ * write. The file is written aside then renamed so that a mapping of the
+ * previous file (e.g. the attached one) stays valid.
+ *
+ * @param fileName A pointer to the name of the file to write.
+ * @return 0 on success, non-zero if the file can't be written
+ */
+int mem_save_file(char *fileName) {
+    char *buffer, temporaryName[strlen(fileName) + 8];
+    size_t size;
+    int fd, errorCode;
+
+    buffer = mem_export(&size);
+
+    sprintf(temporaryName, "%s.tmp", fileName);
+    fd = open(temporaryName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    errorCode = fd < 0 || write(fd, buffer, size) != (ssize_t)size;
+    if (fd >= 0) {
+        errorCode |= close(fd) != 0;
+    }
+    if (!errorCode) {
+        errorCode = rename(temporaryName, fileName) != 0;
+    } else {
+        unlink(temporaryName);
+    }
+    free(buffer);
+
+    return errorCode;
+}
+
+/**
+ * This function removes all the variables (e.g. when a host embedding the
+ * shell switches to another context).
+ * @param void
+ * @return void
+ */
+void mem_clear_all() {
+    int mem_idx;
+
+    pthread_mutex_lock(&memoryVariableArrayLock);
+    for (mem_idx = 0; mem_idx < VAR_MEMSIZE && shellmemory[mem_idx].var; mem_idx++) {
+        mem_clear_value(mem_idx);
+        free(shellmemory[mem_idx].var);
+        shellmemory[mem_idx].var = NULL;
+    }
+    pthread_mutex_unlock(&memoryVariableArrayLock);
+}
+
+/**
+ * This function serializes all the variables in the format of the variables
+ * files (e.g. to be embedded in a checkpoint).
+ *
+ * @param size A pointer set to the size of the serialized variables.
+ * @return an allocated buffer holding the variables (to be freed)
+ */
+char *mem_export(size_t *size) {
+    struct varsFileHeader *header;
+    struct memory_struct *variable;
+    char *buffer, *position;
+    const char *data;
+    size_t nameLength;
+    unsigned int fields[3 + MAX_VALUE_SIZE];
+    int mem_idx, token_idx;
 
+    *size = sizeof(struct varsFileHeader);
     pthread_mutex_lock(&memoryVariableArrayLock);
+    for (mem_idx = 0; mem_idx < VAR_MEMSIZE && shellmemory[mem_idx].var; mem_idx++) {
+        variable = &shellmemory[mem_idx];
+        *size += (3 + variable->tokensNumber) * sizeof(unsigned int) +
+                 ((strlen(variable->var) + variable->length + 2 + 3) & ~(size_t)3);
+    }
+
+    buffer = (char *)calloc(1, *size);
+    header = (struct varsFileHeader *)buffer;
+    memcpy(header->magic, VARS_FILE_MAGIC, sizeof(header->magic));
+    header->variablesNumber = mem_idx;
+    position = buffer + sizeof(struct varsFileHeader);
+    for (mem_idx = 0; mem_idx < VAR_MEMSIZE && shellmemory[mem_idx].var; mem_idx++) {
+        variable = &shellmemory[mem_idx];
+        nameLength = strlen(variable->var);
+        data = variable->kind == VALUE_INLINE   ? variable->value.inlineData
+               : variable->kind == VALUE_MAPPED ? variable->value.mapped
+                                                : variable->value.shared->data;
+
+        fields[0] = nameLength;
+        fields[1] = variable->length;
+        fields[2] = variable->tokensNumber;
+        for (token_idx = 0; token_idx < variable->tokensNumber; token_idx++) {
+            fields[3 + token_idx] = variable->tokenEnds[token_idx];
+        }
+        memcpy(position, fields, (3 + variable->tokensNumber) * sizeof(unsigned int));
+        position += (3 + variable->tokensNumber) * sizeof(unsigned int);
+        memcpy(position, variable->var, nameLength + 1);
+        memcpy(position + nameLength + 1, data, variable->length + 1);
+        position += (nameLength + variable->length + 2 + 3) & ~(size_t)3;
+    }
+    pthread_mutex_unlock(&memoryVariableArrayLock);
+
+    return buffer;
+}
+
+/**
+ * This function defines (or overwrites) the variables serialized by
+ * mem_export with their values copied into the shell memory.
+ *
+ * @param data A pointer to the serialized variables (4 bytes aligned).
+ * @param size The size of the serialized variables.
+ * @return 0 on success, non-zero if the variables are invalid or don't fit
+ * in the variable store
+ */
+int mem_import(const char *data, size_t size) {
+    return mem_read_records(data, size, 0);
+}
+
+/**
+ * This function defines (or overwrites) all the variables of a variables file
+ * with their values copied into the shell memory.
+ *
+ * @param fileName A pointer to the name of the file to read.
+ * @return 0 on success, non-zero if the file can't be read, is invalid or
+ * doesn't fit in the variable store
+ */
+int mem_load_file(char *fileName) {
+    const char *data;
+    size_t size;
+    int errorCode;
+
+    data = mem_map_file(fileName, &size);
+    if (data == NULL) {
+        return 1;
+    }
+    errorCode = mem_read_records(data, size, 0);
+    munmap((void *)data, size);
+
+    return errorCode;
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * This function takes the memory index of a variable and clears its value,
+ * effectively resetting it to an uninitialized state.
+ *
+ * @param mem_idx The memory index of the variable whose value is to be cleared.
+ * @return void
+ */
+void mem_clear_value(int mem_idx) {
+    struct sharedValue *shared;
+
+    if (shellmemory[mem_idx].kind == VALUE_SHARED) {
+        shared = shellmemory[mem_idx].value.shared;
+        if (__atomic_sub_fetch(&shared->references, 1, __ATOMIC_ACQ_REL) == 0) {
+            free(shared);
+        }
+    }
+    shellmemory[mem_idx].length = 0;
+    shellmemory[mem_idx].tokensNumber = 0;
+    shellmemory[mem_idx].kind = VALUE_INLINE;
+}
+
+/**
+ * This function searches for the index of a variable in memory. The caller
+ * holds the lock of the variables.
+ *
+ * @param var_in A pointer to a string representing the variable name to be
+ * searched.
+ * @return Returns the index of the variable entry on success, or -1 if the
+ * variable is not found.
+ */
+int mem_get_variable_index_locked(char *var_in) {
+    int mem_idx;
+
     for (mem_idx = 0; mem_idx < VAR_MEMSIZE; mem_idx++) {
         // Case where we reached end of initialized memory
         if (shellmemory[mem_idx].var == NULL) {
@@ -106,65 +441,165 @@ int mem_get_variable_index(char *var_in) {
         }
         // Check if we found the variable
         if (strcmp(shellmemory[mem_idx].var, var_in) == 0) {
-            ret_idx = mem_idx;
-            break;
+            return mem_idx;
         }
     }
-    pthread_mutex_unlock(&memoryVariableArrayLock);
 
-    return ret_idx;
+    return -1;
 }
 
 /**
- * This function takes an input key (variable name) and retrieves its
- * corresponding value from memory, storing the result in the provided buffer.
+ * Predicate determining whether a value is stored in the variable itself
  *
- * @param var_in A pointer to a string representing the input key (variable
- * name).
- * @param buffer A pointer to a buffer where the retrieved value will be stored.
- * @return void
+ * @param length The length of the value (without the null byte).
+ * @return Returns 1 (true) if the value is stored inline, otherwise 0 (false)
  */
-void mem_get_value(char *var_in, char *buffer) {
-    int mem_idx, val_idx;
-    char *space = " ";
+int isValueInline(size_t length) { return length < VALUE_INLINE_SIZE; }
 
-    // Assume there is an error
-    strcpy(buffer, "Variable does not exist");
+/**
+ * This function stores a value prepared by the caller in a variable, creating
+ * the variable if needed. The value (and its heap string) belongs to the
+ * variable afterwards unless the variable store is full.
+ *
+ * @param var_in A pointer to the name of the variable.
+ * @param newValue A pointer to the prepared value (its var field is unused).
+ * @return 0 on success, -1 if the variable store is full
+ */
+int mem_store_value(char *var_in, struct memory_struct *newValue) {
+    int mem_idx, wasSet = 0;
 
-    mem_idx = mem_get_variable_index(var_in);
-    if (mem_idx > -1) {
-        // Assemble the values
-        buffer[0] = '\0';  // Initialize buffer with null character
-        val_idx = 0;
+    // If variable exists, we overwrite the values
+    for (mem_idx = 0; mem_idx < VAR_MEMSIZE; mem_idx++) {
         pthread_mutex_lock(&memoryVariableArrayLock);
-        while (val_idx < MAX_VALUE_SIZE && shellmemory[mem_idx].value[val_idx] != NULL) {
-            // Adding space between the values of a variable when outputting
-            // them
-            if (val_idx != 0) {
-                strcat(buffer, space);
+        // Check to see if memory spot was not initialized (in which case we
+        // reached the end of initialized variables) or whether the memory spot
+        // corresponds to the variable passed as argument
+        if (shellmemory[mem_idx].var == NULL ||
+            strcmp(shellmemory[mem_idx].var, var_in) == 0) {
+            // Case where we reached end of known variables
+            if (shellmemory[mem_idx].var ==NULL) {
+                // Create our new variable in this spot
+                shellmemory[mem_idx].var = strdup(var_in);
+            } else {  // Case where variable already existed
+                // clear the old values of variable appropriately
+                mem_clear_value(mem_idx);
             }
-            strcat(buffer, shellmemory[mem_idx].value[val_idx]);
-            val_idx++;
+            // In either case we populate the new values
+            newValue->var = shellmemory[mem_idx].var;
+            shellmemory[mem_idx] = *newValue;
+            wasSet = 1;
         }
         pthread_mutex_unlock(&memoryVariableArrayLock);
-        return;
+        if (wasSet) {
+            return 0;
+        }
     }
+
+    return -1;
 }
 
-/*** HELPER FUNCTIONS ***/
+/**
+ * This function defines the variables of the records of a variables file.
+ *
+ * @param data A pointer to the content of the file.
+ * @param size The size of the file.
+ * @param isMapped Whether the values are used in place (the content must stay
+ * mapped for the whole run) rather than copied.
+ * @return 0 on success, 1 if the content isn't a valid variables file, 2 if
+ * the variable store is full (the records before the one failing are defined)
+ */
+int mem_read_records(const char *data, size_t size, int isMapped) {
+    const struct varsFileHeader *header = (const struct varsFileHeader *)data;
+    const unsigned int *fields;
+    struct memory_struct newValue;
+    size_t position = sizeof(struct varsFileHeader), fieldsSize, stringsSize;
+    unsigned int record_idx, token_idx;
+    const char *name, *value;
+
+    if (size < sizeof(struct varsFileHeader) ||
+        memcmp(header->magic, VARS_FILE_MAGIC, sizeof(header->magic)) != 0) {
+        return 1;
+    }
+
+    for (record_idx = 0; record_idx < header->variablesNumber; record_idx++) {
+        // Make sure that the record lies within the file and is consistent
+        fields = (const unsigned int *)(data + position);
+        if (size - position < 3 * sizeof(unsigned int) || fields[2] == 0 ||
+            fields[2] > MAX_VALUE_SIZE) {
+            return 1;
+        }
+        fieldsSize = (3 + fields[2]) * sizeof(unsigned int);
+        stringsSize = ((size_t)fields[0] + fields[1] + 2 + 3) & ~(size_t)3;
+        if (size - position < fieldsSize || size - position - fieldsSize < stringsSize) {
+            return 1;
+        }
+        name = data + position + fieldsSize;
+        value = name + fields[0] + 1;
+        if (name[fields[0]] != '\0' || value[fields[1]] != '\0' ||
+            fields[3 + fields[2] - 1] != fields[1]) {
+            return 1;
+        }
+        position += fieldsSize + stringsSize;
+
+        newValue.length = fields[1];
+        newValue.tokensNumber = fields[2];
+        for (token_idx = 0; token_idx < fields[2]; token_idx++) {
+            newValue.tokenEnds[token_idx] = fields[3 + token_idx];
+        }
+        if (isMapped) {
+            newValue.kind = VALUE_MAPPED;
+            newValue.value.mapped = value;
+        } else if (isValueInline(newValue.length)) {
+            newValue.kind = VALUE_INLINE;
+            memcpy(newValue.value.inlineData, value, newValue.length + 1);
+        } else {
+            newValue.kind = VALUE_SHARED;
+            newValue.value.shared =
+                (struct sharedValue *)malloc(sizeof(struct sharedValue) + newValue.length + 1);
+            newValue.value.shared->references = 1;
+            memcpy(newValue.value.shared->data, value, newValue.length + 1);
+        }
+
+        if (mem_store_value((char *)name, &newValue)) {
+            // The variable store is full, the records left can't be defined
+            if (newValue.kind == VALUE_SHARED) {
+                free(newValue.value.shared);
+            }
+            return 2;
+        }
+    }
+
+    return 0;
+}
 
 /**
- * This function takes the memory index of a variable and clears its value,
- * effectively resetting it to an uninitialized state.
+ * This function maps a whole file in memory (read-only)
  *
- * @param mem_idx The memory index of the variable whose value is to be cleared.
- * @return void
+ * @param fileName A pointer to the name of the file.
+ * @param size A pointer set to the size of the file (0 if it doesn't exist).
+ * @return the content of the file or NULL if it can't be mapped or is empty
  */
-void mem_clear_value(int mem_idx) {
-    int val_idx = 0;
-    while (val_idx < MAX_VALUE_SIZE && shellmemory[mem_idx].value[val_idx] != NULL) {
-        free(shellmemory[mem_idx].value[val_idx]);
-        shellmemory[mem_idx].value[val_idx] = NULL;
-        val_idx++;
+const char *mem_map_file(char *fileName, size_t *size) {
+    struct stat fileStat;
+    void *data;
+    int fd;
+
+    *size = 0;
+    fd = open(fileName, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &fileStat) != 0) {
+        close(fd);
+        return NULL;
     }
-}
\ No newline at end of file
+    *size = fileStat.st_size;
+    if (*size == 0) {
+        close(fd);
+        return NULL;
+    }
+    data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    return data == MAP_FAILED ? NULL : (const char *)data;
+}
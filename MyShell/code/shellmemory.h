@@ -2,14 +2,43 @@
 
 #define MAX_VALUE_SIZE 5
 #define MAX_TOKEN_SIZE 200
-#define MAX_VARIABLE_VALUE_SIZE \
-    ((MAX_VALUE_SIZE * MAX_TOKEN_SIZE) + MAX_VALUE_SIZE)
-    
+
 #ifndef VAR_MEMSIZE
 #define VAR_MEMSIZE 10
 #endif
 
+// Values up to this length (terminating null byte inclusive) are stored in the
+// variable itself, longer ones in a reference-counted immutable string
+#define VALUE_INLINE_SIZE 48
+
+// First bytes of the files written by mem_save_file
+#define VARS_FILE_MAGIC "MYSHVAR1"
+
+// Immutable value shared by a variable and the readers still printing it
+struct sharedValue {
+    int references;
+    char data[];
+};
+
+// Read-only access to the value of a variable: its tokens joined by spaces
+// (as printed), null terminated. Must be released with mem_release_value.
+struct valueView {
+    const char *data;
+    size_t length;
+    int tokensNumber;
+    struct sharedValue *shared;
+    char inlineCopy[VALUE_INLINE_SIZE];
+};
+
 void mem_init();
-void mem_get_value(char *var, char *buffer);
+int mem_get_value(char *var_in, struct valueView *view);
+void mem_release_value(struct valueView *view);
 void mem_set_value(char *var_in, char *values_in[], int number_values);
 int mem_get_variable_index(char *var_in);
+int mem_attach_file(char *fileName);
+void mem_sync_file();
+int mem_save_file(char *fileName);
+int mem_load_file(char *fileName);
+void mem_clear_all();
+char *mem_export(size_t *size);
+int mem_import(const char *data, size_t size);
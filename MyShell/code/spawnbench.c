@@ -0,0 +1,128 @@
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Benchmark of the number of external commands the shell can launch per
+// second with posix_spawn (used by the spawn command) compared to fork+exec.
+// Usage: ./spawnbench [launches] [resident MB] [command]
+// The resident memory simulates a large shell: fork has to copy its page
+// tables while posix_spawn doesn't.
+
+#define BATCH_SIZE 64
+
+extern char **environ;
+
+typedef enum launchMethod_t {
+    LAUNCH_POSIX_SPAWN = 0,
+    LAUNCH_FORK_EXEC
+} launchMethod_t;
+
+/*** FUNCTION SIGNATURES ***/
+
+double now();
+int launch(launchMethod_t method, char *argv[]);
+double benchmark(launchMethod_t method, char *argv[], int launches);
+
+/**
+ * Runs the benchmark for both launch methods
+ *
+ * @param argc The number of command-line arguments passed to the program.
+ * @param argv An array of pointers to the command-line arguments.
+ * @return Returns an integer status code, 0 for success
+ */
+int main(int argc, char *argv[]) {
+    int launches = argc > 1 ? atoi(argv[1]) : 2000;
+    size_t residentSize = (size_t)(argc > 2 ? atoi(argv[2]) : 256) << 20;
+    char *command[] = {argc > 3 ? argv[3] : "/bin/true", NULL};
+    double spawnRate, forkRate;
+    char *resident;
+
+    // Touch every page so that it is part of the resident set
+    resident = (char *)malloc(residentSize);
+    memset(resident, 1, residentSize);
+
+    spawnRate = benchmark(LAUNCH_POSIX_SPAWN, command, launches);
+    forkRate = benchmark(LAUNCH_FORK_EXEC, command, launches);
+
+    printf("%d launches of %s with %zu MB resident\n", launches, command[0],
+           residentSize >> 20);
+    printf("posix_spawn: %10.0f launches/s\n", spawnRate);
+    printf("fork+exec:   %10.0f launches/s\n", forkRate);
+    printf("speedup:     %10.2fx\n", spawnRate / forkRate);
+
+    free(resident);
+    return 0;
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * Function that returns the current time of a monotonic clock
+ * @param void
+ * @return the current time in seconds
+ */
+double now() {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Function that launches a command without waiting for it
+ *
+ * @param method how to launch the command
+ * @param argv the command and its arguments (NULL terminated)
+ * @return 0 if the command was launched, non-zero otherwise
+ */
+int launch(launchMethod_t method, char *argv[]) {
+    pid_t pid;
+
+    if (method == LAUNCH_POSIX_SPAWN) {
+        return posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    return pid < 0;
+}
+
+/**
+ * Function that launches a command repeatedly, reaping the children in
+ * batches like the shell does
+ *
+ * @param method how to launch the command
+ * @param argv the command and its arguments (NULL terminated)
+ * @param launches the number of times to launch the command
+ * @return the number of launches per second
+ */
+double benchmark(launchMethod_t method, char *argv[], int launches) {
+    int launchIdx, running = 0;
+    double start;
+
+    start = now();
+    for (launchIdx = 0; launchIdx < launches; launchIdx++) {
+        if (launch(method, argv)) {
+            perror("launch");
+            exit(1);
+        }
+        running++;
+        if (running >= BATCH_SIZE) {
+            while (waitpid(-1, NULL, WNOHANG) > 0) {
+                running--;
+            }
+        }
+    }
+    while (running > 0 && waitpid(-1, NULL, 0) > 0) {
+        running--;
+    }
+
+    return launches / (now() - start);
+}
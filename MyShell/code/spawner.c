@@ -0,0 +1,214 @@
+#include <errno.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "spawner.h"
+
+extern char **environ;
+
+// External commands launched that weren't reaped yet. Only these are waited
+// for: a host embedding the shell may have children of its own. The number is
+// also read without the lock so that nothing is done when there are none.
+pid_t *spawnedPids;
+int spawnedChildren;
+int spawnedCapacity;
+pthread_mutex_t spawnedLock;
+
+/*** FUNCTION SIGNATURES ***/
+
+void addSpawnedPid(pid_t pid);
+int removeSpawnedPid(pid_t pid);
+void waitChild(pid_t pid);
+
+/*** FUNCTIONS FOR EXTERNAL COMMANDS ***/
+
+/**
+ * This function intializes the bookkeeping of the external commands.
+ * @param void
+ * @return void
+ */
+void spawner_init() {
+    spawnedPids = NULL;
+    spawnedChildren = 0;
+    spawnedCapacity = 0;
+    pthread_mutex_init(&spawnedLock, NULL);
+}
+
+/**
+ * Function that launches an external command without waiting for it.
+ * posix_spawnp doesn't copy the page tables of the shell (vfork semantics)
+ * so launching a command doesn't depend on the size of the shell's memory.
+ * Note that the command writes directly to the stdout so its output isn't
+ * ordered with the buffered output of the processes run by the workers.
+ *
+ * @param args the name of the command followed by its arguments
+ * @param argsNumber the number of elements in args
+ * @return 0 if the command was launched, non-zero otherwise
+ */
+int spawnCommand(char *args[], int argsNumber) {
+    // Children that exited since the last command are reaped in one go
+    reapChildren(0);
+
+    // What the shell printed so far must come before the command's output
+    fflush(stdout);
+    return spawnProcess(args, argsNumber, -1, -1) < 0;
+}
+
+/**
+ * Function that launches an external command with its stdin and stdout
+ * connected to the given file descriptors without waiting for it. The file
+ * descriptors of the shell should be opened with O_CLOEXEC so that the command
+ * doesn't inherit them (it wouldn't see the end of its pipes otherwise).
+ *
+ * @param args the name of the command followed by its arguments
+ * @param argsNumber the number of elements in args
+ * @param inputFd the file descriptor to use as stdin or -1 to inherit it
+ * @param outputFd the file descriptor to use as stdout or -1 to inherit it
+ * @return the pid of the command or -1 if it couldn't be launched
+ */
+pid_t spawnProcess(char *args[], int argsNumber, int inputFd, int outputFd) {
+    posix_spawn_file_actions_t fileActions;
+    char *argv[argsNumber + 1];
+    pid_t pid;
+    int argIdx, error;
+
+    for (argIdx = 0; argIdx < argsNumber; argIdx++) {
+        argv[argIdx] = args[argIdx];
+    }
+    argv[argsNumber] = NULL;
+
+    posix_spawn_file_actions_init(&fileActions);
+    if (inputFd >= 0) {
+        posix_spawn_file_actions_adddup2(&fileActions, inputFd, STDIN_FILENO);
+    }
+    if (outputFd >= 0) {
+        posix_spawn_file_actions_adddup2(&fileActions, outputFd, STDOUT_FILENO);
+    }
+    error = posix_spawnp(&pid, argv[0], &fileActions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fileActions);
+    if (error != 0) {
+        return -1;
+    }
+    addSpawnedPid(pid);
+
+    return pid;
+}
+
+/**
+ * Function that blocks until a command launched with spawnProcess exited
+ *
+ * @param pid the pid of the command
+ * @return void
+ */
+void waitProcess(pid_t pid) {
+    // The command is taken out of the table first so that reapChildren on
+    // another thread leaves it alone (unless it was reaped already)
+    if (removeSpawnedPid(pid)) {
+        waitChild(pid);
+    }
+}
+
+/**
+ * Function that reaps the external commands that exited. Nothing is done
+ * (not even a system call) if there are no commands running. Every command is
+ * waited for by its pid, the other children of the process are left alone.
+ *
+ * @param isWaitingAll whether to block until every command exited
+ * @return void
+ */
+void reapChildren(int isWaitingAll) {
+    pid_t *pids;
+    int pidIdx, pidsNumber;
+
+    if (__atomic_load_n(&spawnedChildren, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&spawnedLock);
+    if (isWaitingAll) {
+        // The commands are taken out of the table to be waited for without
+        // holding the lock
+        pids = spawnedPids;
+        pidsNumber = spawnedChildren;
+        spawnedPids = NULL;
+        spawnedCapacity = 0;
+        __atomic_store_n(&spawnedChildren, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&spawnedLock);
+        for (pidIdx = 0; pidIdx < pidsNumber; pidIdx++) {
+            waitChild(pids[pidIdx]);
+        }
+        free(pids);
+        return;
+    }
+
+    pidIdx = 0;
+    while (pidIdx < spawnedChildren) {
+        // A command that exited (or can't be waited for) leaves the table and
+        // the last one takes its place
+        if (waitpid(spawnedPids[pidIdx], NULL, WNOHANG) != 0) {
+            spawnedPids[pidIdx] = spawnedPids[spawnedChildren - 1];
+            __atomic_sub_fetch(&spawnedChildren, 1, __ATOMIC_RELAXED);
+        } else {
+            pidIdx++;
+        }
+    }
+    pthread_mutex_unlock(&spawnedLock);
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * Function that adds a command to the table of the commands launched
+ *
+ * @param pid the pid of the command
+ * @return void
+ */
+void addSpawnedPid(pid_t pid) {
+    pthread_mutex_lock(&spawnedLock);
+    if (spawnedChildren == spawnedCapacity) {
+        spawnedCapacity = spawnedCapacity ? 2 * spawnedCapacity : 16;
+        spawnedPids = (pid_t *)realloc(spawnedPids, spawnedCapacity * sizeof(pid_t));
+    }
+    spawnedPids[spawnedChildren] = pid;
+    __atomic_add_fetch(&spawnedChildren, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&spawnedLock);
+}
+
+/**
+ * Function that removes a command from the table of the commands launched
+ *
+ * @param pid the pid of the command
+ * @return 1 if the command was in the table, 0 if it was reaped already
+ */
+int removeSpawnedPid(pid_t pid) {
+    int pidIdx, wasFound = 0;
+
+    pthread_mutex_lock(&spawnedLock);
+    for (pidIdx = 0; pidIdx < spawnedChildren; pidIdx++) {
+        if (spawnedPids[pidIdx] == pid) {
+            spawnedPids[pidIdx] = spawnedPids[spawnedChildren - 1];
+            __atomic_sub_fetch(&spawnedChildren, 1, __ATOMIC_RELAXED);
+            wasFound = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&spawnedLock);
+
+    return wasFound;
+}
+
+/**
+ * Function that blocks until a child exited (a signal interrupting the wait
+ * doesn't leave it a zombie)
+ *
+ * @param pid the pid of the child
+ * @return void
+ */
+void waitChild(pid_t pid) {
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+}
@@ -0,0 +1,7 @@
+#include <sys/types.h>
+
+void spawner_init();
+int spawnCommand(char *args[], int argsNumber);
+pid_t spawnProcess(char *args[], int argsNumber, int inputFd, int outputFd);
+void waitProcess(pid_t pid);
+void reapChildren(int isWaitingAll);
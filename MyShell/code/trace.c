@@ -0,0 +1,409 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "trace.h"
+
+// Ring buffer of the events recorded by a single thread. Only the owning
+// thread writes in it so no lock is needed to record an event.
+struct traceRing {
+    struct traceRecord records[TRACE_RING_SIZE];
+    unsigned long head;  // Number of events ever recorded in the ring
+    int threadIdx;
+    struct traceRing *next;
+};
+
+__thread struct traceRing *threadRing = NULL;
+
+// List of the rings of all the threads that recorded events
+struct traceRing *traceRings;
+int traceRingsNumber;
+pthread_mutex_t traceRingsLock;
+
+int isTracing;
+unsigned long long traceEpoch;
+
+// Functions notified synchronously of every event of a given type, whether
+// the events are recorded or not
+traceConsumer_t traceConsumers[TRACE_EVENTS_NUMBER][TRACE_MAX_CONSUMERS];
+int traceConsumersNumber[TRACE_EVENTS_NUMBER];
+
+// Page-reference trace being recorded (NULL if none), the last reference
+// written in it and the number of ids given to the scripts
+FILE *referencesFile;
+int isRecordingReferences;
+int lastReferenceScript;
+int lastReferencePage;
+int referenceScriptsNumber;
+pthread_mutex_t referencesLock;
+
+/*** FUNCTION SIGNATURES ***/
+
+unsigned long long traceNow();
+struct traceRing *getThreadRing();
+void dumpRecord(FILE *p, struct traceRecord *record, int threadIdx);
+void writeVarint(FILE *p, unsigned long value);
+
+/*** FUNCTIONS FOR THE EVENT TRACE ***/
+
+/**
+ * This function intializes the event trace and the associated concurrency
+ * variables. Nothing is recorded until traceStart is called.
+ * @param void
+ * @return void
+ */
+void trace_init() {
+    int type;
+
+    traceRings = NULL;
+    traceRingsNumber = 0;
+    isTracing = 0;
+    traceEpoch = 0;
+    referencesFile = NULL;
+    isRecordingReferences = 0;
+    referenceScriptsNumber = 0;
+    for (type = 0; type < TRACE_EVENTS_NUMBER; type++) {
+        traceConsumersNumber[type] = 0;
+    }
+
+    pthread_mutex_init(&traceRingsLock, NULL);
+    pthread_mutex_init(&referencesLock, NULL);
+}
+
+/**
+ * Function that registers a function to call on every event of a type
+ *
+ * @param type the type of events to consume
+ * @param consumer the function to call
+ * @return void
+ */
+void traceSubscribe(traceEvent_t type, traceConsumer_t consumer) {
+    if (traceConsumersNumber[type] < TRACE_MAX_CONSUMERS) {
+        traceConsumers[type][traceConsumersNumber[type]++] = consumer;
+    }
+}
+
+/**
+ * Function that notifies the consumers of an event and records it in the ring
+ * of the running thread if the trace is started
+ *
+ * @param type the type of the event
+ * @param pid the pid of the process concerned (0 if none)
+ * @param arg0 first argument of the event (see traceEvent_t)
+ * @param arg1 second argument of the event (see traceEvent_t)
+ * @param subject pointer to the object concerned (see traceEvent_t)
+ * @return void
+ */
+void traceEmit(traceEvent_t type, int pid, long long arg0, long long arg1, const void *subject) {
+    struct traceRecord record;
+    struct traceRing *ring;
+    int consumerIdx, isRecording;
+    unsigned long head;
+
+    isRecording = __atomic_load_n(&isTracing, __ATOMIC_RELAXED);
+    if (!isRecording && !traceConsumersNumber[type]) {
+        return;
+    }
+
+    record.timestamp = isRecording ? traceNow() - traceEpoch : 0;
+    record.type = type;
+    record.pid = pid;
+    record.arg0 = arg0;
+    record.arg1 = arg1;
+    record.subject = subject;
+
+    for (consumerIdx = 0; consumerIdx < traceConsumersNumber[type]; consumerIdx++) {
+        traceConsumers[type][consumerIdx](&record);
+    }
+
+    if (isRecording) {
+        ring = getThreadRing();
+        head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        ring->records[head % TRACE_RING_SIZE] = record;
+        __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Function that locks a mutex and records how long the thread waited for it
+ * if it was contended
+ *
+ * @param lock the mutex to lock
+ * @param lockName the name of the lock in the trace
+ * @return void
+ */
+void traceLock(pthread_mutex_t *lock, const char *lockName) {
+    unsigned long long waitStart;
+
+    if (!__atomic_load_n(&isTracing, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(lock);
+        return;
+    }
+    if (pthread_mutex_trylock(lock) == 0) {
+        return;
+    }
+    waitStart = traceNow();
+    pthread_mutex_lock(lock);
+    traceEmit(TRACE_LOCK_WAIT, 0, traceNow() - waitStart, 0, lockName);
+}
+
+/**
+ * Function that clears the rings and starts recording events
+ * @param void
+ * @return void
+ */
+void traceStart() {
+    struct traceRing *ring;
+
+    pthread_mutex_lock(&traceRingsLock);
+    for (ring = traceRings; ring; ring = ring->next) {
+        __atomic_store_n(&ring->head, 0, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&traceRingsLock);
+
+    traceEpoch = traceNow();
+    __atomic_store_n(&isTracing, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Function that stops recording events (the recorded events are kept) and
+ * closes the page-reference trace
+ * @param void
+ * @return void
+ */
+void traceStop() {
+    __atomic_store_n(&isTracing, 0, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&referencesLock);
+    __atomic_store_n(&isRecordingReferences, 0, __ATOMIC_RELEASE);
+    if (referencesFile) {
+        fclose(referencesFile);
+        referencesFile = NULL;
+    }
+    pthread_mutex_unlock(&referencesLock);
+}
+
+/**
+ * Function that stops recording and writes the recorded events as a Chrome
+ * trace-event JSON file (viewable in Perfetto or chrome://tracing)
+ *
+ * @param fileName the name of the file to write
+ * @return 0 on success, non-zero if the file can't be written
+ */
+int traceDump(char *fileName) {
+    struct traceRing *ring;
+    unsigned long head, recordIdx;
+    int isFirst = 1;
+    FILE *p;
+
+    traceStop();
+
+    p = fopen(fileName, "w");
+    if (p == NULL) {
+        return 1;
+    }
+
+    fprintf(p, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    pthread_mutex_lock(&traceRingsLock);
+    for (ring = traceRings; ring; ring = ring->next) {
+        fprintf(p, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                   "\"args\":{\"name\":\"thread %d\"}}",
+                isFirst ? "" : ",", ring->threadIdx, ring->threadIdx);
+        isFirst = 0;
+
+        // Only the last TRACE_RING_SIZE events are still in the ring
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        recordIdx = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for (; recordIdx < head; recordIdx++) {
+            dumpRecord(p, &ring->records[recordIdx % TRACE_RING_SIZE], ring->threadIdx);
+        }
+    }
+    pthread_mutex_unlock(&traceRingsLock);
+    fprintf(p, "\n]}\n");
+
+    return fclose(p) != 0;
+}
+
+/**
+ * Function that starts recording the pages referenced by the instructions
+ * fetched into a binary trace (see REFERENCE_TRACE_MAGIC), replacing the trace
+ * being recorded if any. The trace is written until traceStop is called.
+ *
+ * @param fileName the name of the file to write
+ * @param pageSize the number of lines of a page
+ * @param framesNumber the number of frames of the shell
+ * @return 0 on success, non-zero if the file can't be written
+ */
+int traceRecordReferences(char *fileName, int pageSize, int framesNumber) {
+    FILE *p;
+
+    traceStop();
+
+    p = fopen(fileName, "wb");
+    if (p == NULL) {
+        return 1;
+    }
+    fwrite(REFERENCE_TRACE_MAGIC, 1, REFERENCE_TRACE_MAGIC_SIZE, p);
+    writeVarint(p, pageSize);
+    writeVarint(p, framesNumber);
+
+    pthread_mutex_lock(&referencesLock);
+    referencesFile = p;
+    lastReferenceScript = 0;
+    lastReferencePage = -1;
+    __atomic_store_n(&isRecordingReferences, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&referencesLock);
+
+    return 0;
+}
+
+/**
+ * Function that writes a page reference in the page-reference trace if one is
+ * recorded. A reference to the page referenced last is skipped since it can't
+ * fault nor change the order of the pages under any replacement policy.
+ *
+ * @param scriptId the id of the script in the traces, given on its first
+ * reference (0 until then)
+ * @param pageNumber the page referenced
+ * @return void
+ */
+void traceReference(int *scriptId, int pageNumber) {
+    if (!__atomic_load_n(&isRecordingReferences, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    pthread_mutex_lock(&referencesLock);
+    if (!referencesFile) {
+        pthread_mutex_unlock(&referencesLock);
+        return;
+    }
+    if (!*scriptId) {
+        *scriptId = ++referenceScriptsNumber;
+    }
+    if (*scriptId == lastReferenceScript && pageNumber == lastReferencePage) {
+        pthread_mutex_unlock(&referencesLock);
+        return;
+    }
+    writeVarint(referencesFile,
+                (unsigned long)pageNumber << 1 | (*scriptId != lastReferenceScript));
+    if (*scriptId != lastReferenceScript) {
+        writeVarint(referencesFile, *scriptId);
+    }
+    lastReferenceScript = *scriptId;
+    lastReferencePage = pageNumber;
+    pthread_mutex_unlock(&referencesLock);
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * Function that returns the current time of a monotonic clock
+ * @param void
+ * @return the current time in nanoseconds
+ */
+unsigned long long traceNow() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Function that returns the ring of the running thread, creating it the first
+ * time the thread records an event
+ * @param void
+ * @return the ring of the running thread
+ */
+struct traceRing *getThreadRing() {
+    if (!threadRing) {
+        threadRing = (struct traceRing *)malloc(sizeof(struct traceRing));
+        threadRing->head = 0;
+
+        pthread_mutex_lock(&traceRingsLock);
+        threadRing->threadIdx = traceRingsNumber++;
+        threadRing->next = traceRings;
+        traceRings = threadRing;
+        pthread_mutex_unlock(&traceRingsLock);
+    }
+
+    return threadRing;
+}
+
+/**
+ * Function that writes a recorded event as a Chrome trace event. Process time
+ * slices and page faults become duration events, lock waits complete events
+ * and evictions, suspensions and readmissions instant events.
+ *
+ * @param p the file to write into
+ * @param record the recorded event
+ * @param threadIdx the index of the thread that recorded the event
+ * @return void
+ */
+void dumpRecord(FILE *p, struct traceRecord *record, int threadIdx) {
+    double timestamp = record->timestamp / 1000.0;
+
+    // The thread metadata of the ring always precedes its events
+    fprintf(p, ",\n");
+    switch (record->type) {
+        case TRACE_DISPATCH:
+            fprintf(p, "{\"name\":\"pid %d\",\"cat\":\"scheduler\",\"ph\":\"B\","
+                       "\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"pid\":%d}}",
+                    record->pid, timestamp, threadIdx, record->pid);
+            break;
+        case TRACE_PREEMPT:
+        case TRACE_TERMINATE:
+            fprintf(p, "{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+                       "\"args\":{\"end\":\"%s\"}}",
+                    timestamp, threadIdx,
+                    record->type == TRACE_PREEMPT ? "preempted" : "terminated");
+            break;
+        case TRACE_PAGE_FAULT:
+            fprintf(p, "{\"name\":\"%s\",\"cat\":\"paging\",\"ph\":\"B\","
+                       "\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"pid\":%d,\"page\":%lld}}",
+                    record->arg1 ? "initial page load" : "page fault", timestamp,
+                    threadIdx, record->pid, record->arg0);
+            break;
+        case TRACE_PAGE_IN:
+            fprintf(p, "{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+                       "\"args\":{\"frame\":%lld}}",
+                    timestamp, threadIdx, record->arg1);
+            break;
+        case TRACE_EVICT:
+            fprintf(p, "{\"name\":\"eviction\",\"cat\":\"paging\",\"ph\":\"i\",\"s\":\"t\","
+                       "\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"page\":%lld,\"frame\":%lld}}",
+                    timestamp, threadIdx, record->arg0, record->arg1);
+            break;
+        case TRACE_LOCK_WAIT:
+            fprintf(p, "{\"name\":\"wait %s\",\"cat\":\"lock\",\"ph\":\"X\","
+                       "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                    (const char *)record->subject, timestamp - record->arg0 / 1000.0,
+                    record->arg0 / 1000.0, threadIdx);
+            break;
+        case TRACE_SUSPEND:
+        case TRACE_READMIT:
+            fprintf(p, "{\"name\":\"%s\",\"cat\":\"scheduler\",\"ph\":\"i\",\"s\":\"t\","
+                       "\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"pid\":%d}}",
+                    record->type == TRACE_SUSPEND ? "suspension" : "readmission", timestamp,
+                    threadIdx, record->pid);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Function that writes an unsigned integer as a varint (LEB128): 7 bits per
+ * byte, the high bit set on every byte but the last one
+ *
+ * @param p the file to write into
+ * @param value the integer to write
+ * @return void
+ */
+void writeVarint(FILE *p, unsigned long value) {
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7f) | 0x80, p);
+        value >>= 7;
+    }
+    fputc((int)value, p);
+}
@@ -0,0 +1,50 @@
+#include <pthread.h>
+
+// Number of events each thread can hold before the oldest are overwritten
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 65536
+#endif
+
+#define TRACE_MAX_CONSUMERS 4
+
+// Page-reference traces (see traceReference and pagesim.c) start with
+// REFERENCE_TRACE_MAGIC, followed by the page size and the number of frames of
+// the shell that recorded them. Every reference is then a varint (LEB128) of
+// page << 1 | isOtherScript, followed by the varint of the id of the script if
+// it isn't the script of the previous reference.
+#define REFERENCE_TRACE_MAGIC "MYSHREF1"
+#define REFERENCE_TRACE_MAGIC_SIZE 8
+
+typedef enum traceEvent_t {
+    TRACE_DISPATCH = 0,  // A process starts a time slice
+    TRACE_PREEMPT,       // A process is preempted
+    TRACE_TERMINATE,     // A process terminated
+    TRACE_PAGE_FAULT,    // arg0: page, arg1: whether a page is evicted
+    TRACE_PAGE_IN,       // arg0: page, arg1: frame
+    TRACE_EVICT,         // arg0: page, arg1: frame (subject: victim script)
+    TRACE_LOCK_WAIT,     // arg0: wait in ns (subject: lock name)
+    TRACE_SUSPEND,       // A process is suspended by the load control
+    TRACE_READMIT,       // A suspended process is readmitted
+    TRACE_EVENTS_NUMBER
+} traceEvent_t;
+
+struct traceRecord {
+    unsigned long long timestamp;  // Nanoseconds since the trace started
+    traceEvent_t type;
+    int pid;
+    long long arg0;
+    long long arg1;
+    const void *subject;  // Only valid while the consumers are notified
+};
+
+typedef void (*traceConsumer_t)(struct traceRecord *record);
+
+void trace_init();
+void traceSubscribe(traceEvent_t type, traceConsumer_t consumer);
+void traceEmit(traceEvent_t type, int pid, long long arg0, long long arg1, const void *subject);
+void traceLock(pthread_mutex_t *lock, const char *lockName);
+void traceStart();
+void traceStop();
+int traceDump(char *fileName);
+int traceRecordReferences(char *fileName, int pageSize, int framesNumber);
+void traceReference(int *scriptId, int pageNumber);
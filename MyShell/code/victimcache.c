@@ -0,0 +1,442 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+#include "scriptsmemory.h"
+#include "shell.h"
+#include "victimcache.h"
+
+// Second tier of the frame store: the pages of files evicted from their frame
+// are kept compressed (LZ4 block format) so that a page fault on them doesn't
+// need to read the file again. A page leaves the cache as soon as it is back
+// in a frame and the least recently evicted pages are dropped once the cache
+// is over VICTIM_CACHE_BUDGET bytes.
+struct victimPage {
+    struct scriptFrames *scriptInfo;
+    int pageNumber;
+    int linesNumber;
+    size_t textSize;    // Size of the lines (each followed by a null character)
+    size_t dataSize;    // Size of the data (textSize if it isn't compressed)
+    int isCompressed;
+    struct victimPage *older;
+    struct victimPage *newer;
+    struct victimPage *nextInBucket;
+    char data[];
+};
+
+// Hash index of the cached pages keyed by script and page number
+struct victimPage *victimCache[VICTIM_CACHE_BUCKETS];
+
+// Pages of the cache from the least to the most recently evicted
+struct victimPage *victimCacheOldest;
+struct victimPage *victimCacheNewest;
+
+// Bytes taken by the cached pages
+size_t victimCacheSize;
+
+// Statistics of the cache
+unsigned long victimCacheHits;
+unsigned long victimCacheMisses;
+unsigned long victimCacheDropped;      // Pages dropped to stay within the budget
+unsigned long victimCacheBytesSaved;   // Bytes of the pages served by the cache
+unsigned long victimCacheTextBytes;    // Bytes of the pages put in the cache
+unsigned long victimCacheStoredBytes;  // Bytes they took once compressed
+
+// Mutex lock used whenever the victim cache is accessed
+pthread_mutex_t victimCacheLock;
+
+/*** FUNCTION SIGNATURES ***/
+
+unsigned int hashVictimPage(struct scriptFrames *scriptInfo, int pageNumber);
+struct victimPage **findVictimPage(struct scriptFrames *scriptInfo, int pageNumber);
+void removeVictimPage(struct victimPage **link);
+size_t compressPageText(const char *text, size_t textSize, char *data, size_t dataCapacity);
+size_t decompressPageText(const char *data, size_t dataSize, char *text, size_t textCapacity);
+int writeSequenceLength(char *data, size_t *dataIdx, size_t dataCapacity, size_t length);
+
+/*** FUNCTIONS FOR THE VICTIM CACHE ***/
+
+/**
+ * This function intializes the victim cache.
+ * @param void
+ * @return void
+ */
+void victim_cache_init() {
+    int bucketIdx;
+
+    for (bucketIdx = 0; bucketIdx < VICTIM_CACHE_BUCKETS; bucketIdx++) {
+        victimCache[bucketIdx] = NULL;
+    }
+    victimCacheOldest = NULL;
+    victimCacheNewest = NULL;
+    victimCacheSize = 0;
+    pthread_mutex_init(&victimCacheLock, NULL);
+}
+
+/**
+ * Function that keeps the lines of an evicted page in the cache
+ *
+ * @param scriptInfo the script of the page (a file)
+ * @param pageNumber the page evicted
+ * @param text the lines of the page, each followed by a null character
+ * @param textSize the size of the lines
+ * @param linesNumber the number of lines
+ *
+ * @return void
+ */
+void victimCachePut(struct scriptFrames *scriptInfo, int pageNumber, const char *text,
+                    size_t textSize, int linesNumber) {
+    char data[PAGE_SIZE * MAX_USER_INPUT];
+    size_t dataSize;
+    struct victimPage *page, **link;
+
+    if (sizeof(struct victimPage) + textSize > VICTIM_CACHE_BUDGET) {
+        return;
+    }
+
+    // Pages that don't get smaller are kept as they are
+    dataSize = compressPageText(text, textSize, data, textSize - 1);
+    page = (struct victimPage *)malloc(sizeof(struct victimPage) +
+                                       (dataSize ? dataSize : textSize));
+    page->scriptInfo = scriptInfo;
+    page->pageNumber = pageNumber;
+    page->linesNumber = linesNumber;
+    page->textSize = textSize;
+    page->isCompressed = dataSize != 0;
+    page->dataSize = dataSize ? dataSize : textSize;
+    memcpy(page->data, dataSize ? data : text, page->dataSize);
+
+    pthread_mutex_lock(&victimCacheLock);
+    link = findVictimPage(scriptInfo, pageNumber);
+    if (*link) {
+        removeVictimPage(link);
+    }
+    page->nextInBucket = victimCache[hashVictimPage(scriptInfo, pageNumber)];
+    victimCache[hashVictimPage(scriptInfo, pageNumber)] = page;
+    page->older = victimCacheNewest;
+    page->newer = NULL;
+    if (victimCacheNewest) {
+        victimCacheNewest->newer = page;
+    } else {
+        victimCacheOldest = page;
+    }
+    victimCacheNewest = page;
+    victimCacheSize += sizeof(struct victimPage) + page->dataSize;
+    scriptInfo->victimPages++;
+    victimCacheTextBytes += textSize;
+    victimCacheStoredBytes += page->dataSize;
+
+    // Make room by dropping the least recently evicted pages
+    while (victimCacheSize > VICTIM_CACHE_BUDGET) {
+        removeVictimPage(findVictimPage(victimCacheOldest->scriptInfo,
+                                        victimCacheOldest->pageNumber));
+        victimCacheDropped++;
+    }
+    pthread_mutex_unlock(&victimCacheLock);
+}
+
+/**
+ * Function that takes the lines of a page out of the cache
+ *
+ * @param scriptInfo the script of the page
+ * @param pageNumber the page to find
+ * @param text buffer receiving the lines
+ * @param textCapacity the size of the buffer
+ * @param lines set to the lines of the page (in the buffer)
+ * @param lengths set to the length of every line
+ *
+ * @return the number of lines of the page or -1 if it isn't cached
+ */
+int victimCacheTake(struct scriptFrames *scriptInfo, int pageNumber, char *text,
+                    size_t textCapacity, char *lines[], size_t lengths[]) {
+    struct victimPage *page, **link;
+    int linesNumber, lineIdx;
+
+    pthread_mutex_lock(&victimCacheLock);
+    link = findVictimPage(scriptInfo, pageNumber);
+    page = *link;
+    if (!page || page->textSize > textCapacity) {
+        victimCacheMisses++;
+        pthread_mutex_unlock(&victimCacheLock);
+        return -1;
+    }
+    if (page->isCompressed) {
+        decompressPageText(page->data, page->dataSize, text, page->textSize);
+    } else {
+        memcpy(text, page->data, page->textSize);
+    }
+    linesNumber = page->linesNumber;
+    victimCacheHits++;
+    victimCacheBytesSaved += page->textSize;
+    // The page is about to be back in a frame
+    removeVictimPage(link);
+    pthread_mutex_unlock(&victimCacheLock);
+
+    for (lineIdx = 0; lineIdx < linesNumber; lineIdx++) {
+        lines[lineIdx] = text;
+        lengths[lineIdx] = strlen(text);
+        text += lengths[lineIdx] + 1;
+    }
+
+    return linesNumber;
+}
+
+/**
+ * Function that drops the cached pages of a script (before it is freed)
+ *
+ * @param scriptInfo the script whose pages are dropped
+ *
+ * @return void
+ */
+void victimCacheDrop(struct scriptFrames *scriptInfo) {
+    struct victimPage **link;
+    int bucketIdx;
+
+    pthread_mutex_lock(&victimCacheLock);
+    for (bucketIdx = 0; bucketIdx < VICTIM_CACHE_BUCKETS && scriptInfo->victimPages;
+         bucketIdx++) {
+        link = &victimCache[bucketIdx];
+        while (*link) {
+            if ((*link)->scriptInfo == scriptInfo) {
+                removeVictimPage(link);
+            } else {
+                link = &(*link)->nextInBucket;
+            }
+        }
+    }
+    pthread_mutex_unlock(&victimCacheLock);
+}
+
+/**
+ * Function that prints the statistics of the victim cache
+ * @param void
+ * @return void
+ */
+void victimCachePrintStats() {
+    pthread_mutex_lock(&victimCacheLock);
+    shellPrintf("Victim cache: %lu hits, %lu misses, %lu bytes of file reads saved, "
+                "%lu bytes compressed to %lu, %lu pages dropped, %lu bytes in use\n",
+                victimCacheHits, victimCacheMisses, victimCacheBytesSaved,
+                victimCacheTextBytes, victimCacheStoredBytes, victimCacheDropped,
+                (unsigned long)victimCacheSize);
+    pthread_mutex_unlock(&victimCacheLock);
+}
+
+/*** HELPER FUNCTIONS ***/
+
+/**
+ * Function that returns the bucket of a page in the victim cache
+ *
+ * @param scriptInfo the script of the page
+ * @param pageNumber the page number
+ *
+ * @return the bucket index
+ */
+unsigned int hashVictimPage(struct scriptFrames *scriptInfo, int pageNumber) {
+    uintptr_t hash = (uintptr_t)scriptInfo / sizeof(void *);
+
+    hash = hash * 31 + (unsigned int)pageNumber;
+    return (unsigned int)(hash * 2654435761u) % VICTIM_CACHE_BUCKETS;
+}
+
+/**
+ * Function that finds a page in the victim cache. The victimCacheLock must be
+ * held.
+ *
+ * @param scriptInfo the script of the page
+ * @param pageNumber the page number
+ *
+ * @return the link to the page in its bucket (pointing to NULL if the page
+ * isn't cached)
+ */
+struct victimPage **findVictimPage(struct scriptFrames *scriptInfo, int pageNumber) {
+    struct victimPage **link;
+
+    link = &victimCache[hashVictimPage(scriptInfo, pageNumber)];
+    while (*link && ((*link)->scriptInfo != scriptInfo || (*link)->pageNumber != pageNumber)) {
+        link = &(*link)->nextInBucket;
+    }
+    return link;
+}
+
+/**
+ * Function that removes a page from the victim cache and frees it. The
+ * victimCacheLock must be held.
+ *
+ * @param link the link to the page in its bucket
+ *
+ * @return void
+ */
+void removeVictimPage(struct victimPage **link) {
+    struct victimPage *page = *link;
+
+    *link = page->nextInBucket;
+    if (page->older) {
+        page->older->newer = page->newer;
+    } else {
+        victimCacheOldest = page->newer;
+    }
+    if (page->newer) {
+        page->newer->older = page->older;
+    } else {
+        victimCacheNewest = page->older;
+    }
+    victimCacheSize -= sizeof(struct victimPage) + page->dataSize;
+    page->scriptInfo->victimPages--;
+    free(page);
+}
+
+/**
+ * Function that compresses the text of a page in the LZ4 block format:
+ * sequences of literals followed by a match (2 byte offset) of at least 4
+ * bytes, the last sequence only has literals.
+ *
+ * @param text the text to compress
+ * @param textSize the size of the text
+ * @param data buffer receiving the compressed text
+ * @param dataCapacity the size of the buffer
+ *
+ * @return the size of the compressed text or 0 if it doesn't fit in the buffer
+ */
+size_t compressPageText(const char *text, size_t textSize, char *data, size_t dataCapacity) {
+    // Position + 1 of the last sequence of 4 bytes with every hash (0 if none)
+    uint16_t table[1 << VICTIM_CACHE_HASH_BITS];
+    size_t textIdx = 0, anchor = 0, dataIdx = 0, matchLength, literalsLength;
+    long candidate;
+    uint32_t sequence, hashIdx;
+
+    if (textSize > 0xFFFF) {
+        return 0;
+    }
+    memset(table, 0, sizeof(table));
+
+    while (1) {
+        matchLength = 0;
+        // Find the next match of at least 4 bytes
+        while (textIdx + 4 <= textSize) {
+            memcpy(&sequence, text + textIdx, 4);
+            hashIdx = (sequence * 2654435761u) >> (32 - VICTIM_CACHE_HASH_BITS);
+            candidate = (long)table[hashIdx] - 1;
+            table[hashIdx] = (uint16_t)(textIdx + 1);
+            if (candidate >= 0 && textIdx - candidate <= 0xFFFF &&
+                memcmp(text + candidate, text + textIdx, 4) == 0) {
+                matchLength = 4;
+                while (textIdx + matchLength < textSize &&
+                       text[candidate + matchLength] == text[textIdx + matchLength]) {
+                    matchLength++;
+                }
+                break;
+            }
+            textIdx++;
+        }
+        if (!matchLength) {
+            textIdx = textSize;
+        }
+
+        // Token, literals and (unless it is the last sequence) the match
+        literalsLength = textIdx - anchor;
+        if (dataIdx >= dataCapacity) {
+            return 0;
+        }
+        data[dataIdx++] = (char)(((literalsLength < 15 ? literalsLength : 15) << 4) |
+                                 (matchLength ? (matchLength - 4 < 15 ? matchLength - 4 : 15) : 0));
+        if (literalsLength >= 15 &&
+            writeSequenceLength(data, &dataIdx, dataCapacity, literalsLength - 15)) {
+            return 0;
+        }
+        if (dataIdx + literalsLength > dataCapacity) {
+            return 0;
+        }
+        memcpy(data + dataIdx, text + anchor, literalsLength);
+        dataIdx += literalsLength;
+        if (!matchLength) {
+            return dataIdx;
+        }
+        if (dataIdx + 2 > dataCapacity) {
+            return 0;
+        }
+        data[dataIdx++] = (char)((textIdx - candidate) & 0xFF);
+        data[dataIdx++] = (char)((textIdx - candidate) >> 8);
+        if (matchLength - 4 >= 15 &&
+            writeSequenceLength(data, &dataIdx, dataCapacity, matchLength - 4 - 15)) {
+            return 0;
+        }
+        textIdx += matchLength;
+        anchor = textIdx;
+    }
+}
+
+/**
+ * Function that decompresses a text compressed by compressPageText
+ *
+ * @param data the compressed text
+ * @param dataSize the size of the compressed text
+ * @param text buffer receiving the text
+ * @param textCapacity the size of the buffer (the size of the text)
+ *
+ * @return the size of the text
+ */
+size_t decompressPageText(const char *data, size_t dataSize, char *text, size_t textCapacity) {
+    size_t dataIdx = 0, textIdx = 0, length, offset;
+    unsigned char token, extra;
+
+    while (dataIdx < dataSize) {
+        token = (unsigned char)data[dataIdx++];
+        length = token >> 4;
+        if (length == 15) {
+            do {
+                extra = (unsigned char)data[dataIdx++];
+                length += extra;
+            } while (extra == 255);
+        }
+        memcpy(text + textIdx, data + dataIdx, length);
+        textIdx += length;
+        dataIdx += length;
+        if (dataIdx >= dataSize) {
+            break;
+        }
+
+        offset = (unsigned char)data[dataIdx] | (unsigned char)data[dataIdx + 1] << 8;
+        dataIdx += 2;
+        length = (token & 15) + 4;
+        if ((token & 15) == 15) {
+            do {
+                extra = (unsigned char)data[dataIdx++];
+                length += extra;
+            } while (extra == 255);
+        }
+        // The match may overlap the bytes it produces
+        for (; length && textIdx < textCapacity; length--, textIdx++) {
+            text[textIdx] = text[textIdx - offset];
+        }
+    }
+
+    return textIdx;
+}
+
+/**
+ * Function that writes the part of a length that doesn't fit in the token of
+ * a sequence (as bytes of 255 followed by the remainder)
+ *
+ * @param data buffer receiving the length
+ * @param dataIdx position in the buffer (moved past the length)
+ * @param dataCapacity the size of the buffer
+ * @param length the length to write
+ *
+ * @return 1 if the length doesn't fit in the buffer, 0 otherwise
+ */
+int writeSequenceLength(char *data, size_t *dataIdx, size_t dataCapacity, size_t length) {
+    while (1) {
+        if (*dataIdx >= dataCapacity) {
+            return 1;
+        }
+        if (length < 255) {
+            data[(*dataIdx)++] = (char)length;
+            return 0;
+        }
+        data[(*dataIdx)++] = (char)255;
+        length -= 255;
+    }
+}
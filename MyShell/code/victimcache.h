@@ -0,0 +1,23 @@
+#include <stddef.h>
+
+// Bytes the compressed pages of the victim cache can take (make
+// victimcache=N, 0 disables the cache)
+#ifndef VICTIM_CACHE_BUDGET
+#define VICTIM_CACHE_BUDGET (256 << 10)
+#endif
+
+#define VICTIM_CACHE_BUCKETS 1024
+
+// Size of the hash table of the compressor (in bits). Pages are small so a
+// small table is enough and cheap to clear for every page.
+#define VICTIM_CACHE_HASH_BITS 8
+
+struct scriptFrames;
+
+void victim_cache_init();
+void victimCachePut(struct scriptFrames *scriptInfo, int pageNumber, const char *text,
+                    size_t textSize, int linesNumber);
+int victimCacheTake(struct scriptFrames *scriptInfo, int pageNumber, char *text,
+                    size_t textCapacity, char *lines[], size_t lengths[]);
+void victimCacheDrop(struct scriptFrames *scriptInfo);
+void victimCachePrintStats();
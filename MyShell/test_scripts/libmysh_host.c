@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "libmysh.h"
+
+// Host program embedding the shell (libmysh.a) for the tests: two contexts
+// take turns running commands and scripts, their output is collected and a
+// child of the host must still be there to be waited for by the host once the
+// shell reaped its external commands
+
+/**
+ * Function that prints the output collected from a context
+ *
+ * @param name the name of the context
+ * @param context the context
+ * @return void
+ */
+void printCollected(const char *name, struct myshContext *context) {
+    size_t length;
+    char *output = myshCollect(context, &length);
+
+    printf("[%s, %zu bytes]\n%s", name, length, output);
+    free(output);
+}
+
+/**
+ * Start of everything
+ *
+ * @param argc The number of command-line arguments passed to the program.
+ * @param argv An array of pointers to the command-line arguments.
+ * @return Returns an integer status code, 0 for success
+ */
+int main(int argc, char *argv[]) {
+    struct myshContext *first, *second;
+    char *scripts[] = {"prog7", "prog8"};
+    pid_t hostChild;
+    int status;
+
+    (void)argc;
+    (void)argv;
+
+    // A child of the host that exited before the shell reaps its commands
+    hostChild = fork();
+    if (hostChild == 0) {
+        _exit(7);
+    }
+    usleep(100000);
+
+    first = myshCreate(1);
+    second = myshCreate(1);
+
+    // Every context has its own variables
+    myshSubmit(first, "set x first\nset y 1\n");
+    myshSubmit(second, "set x second\nprint y\n");
+    myshSubmit(first, "print x\nprint y\nspawn true\nspawn true | spawn true\n");
+    myshSubmit(second, "print x\n");
+
+    // The output is kept until it is collected and the jobs are waited for
+    myshSubmit(first, "exec prog9 prog10 RR MT\n");
+    printCollected("first", first);
+    printCollected("second", second);
+
+    myshRun(second, scripts, 2, "FCFS");
+    printCollected("second", second);
+    printCollected("first", first);
+
+    myshDestroy(first);
+    myshDestroy(second);
+
+    if (waitpid(hostChild, &status, 0) == hostChild && WIFEXITED(status)) {
+        printf("Host child exited with %d\n", WEXITSTATUS(status));
+    } else {
+        printf("Host child was reaped by the shell\n");
+    }
+
+    return 0;
+}
@@ -34,7 +34,9 @@ def count_similarity(a: Counter, b: Counter):
     return inter / total, a_extra, b_extra
 
 
-def rebuild(build_dir: str, prev_dir: str, frame_size: str, var_size: str):
+def rebuild(
+    build_dir: str, prev_dir: str, frame_size: str, var_size: str, options: list[str]
+):
     os.chdir(build_dir)
 
     res = subprocess.run(["make", "clean", "--silent"])
@@ -48,6 +50,7 @@ def rebuild(build_dir: str, prev_dir: str, frame_size: str, var_size: str):
             "mysh",
             f"framesize={frame_size}",
             f"varmemsize={var_size}",
+            *options,
             "--silent",
         ]
     )
@@ -87,7 +90,13 @@ def run_test(
                 print(f"{RED}Failed to read macro values from result file.")
                 return False
             frame_size, var_size = matches[0]
-            rebuild(os.path.dirname(executable), test_dir, frame_size, var_size)
+            # The build options of a test (e.g. dedup=1) are listed in its
+            # .make file
+            options = []
+            if os.path.isfile(f"{test_name}.make"):
+                with open(f"{test_name}.make") as f:
+                    options = f.read().split()
+            rebuild(os.path.dirname(executable), test_dir, frame_size, var_size, options)
 
         shell_res = subprocess.run(
             [executable],